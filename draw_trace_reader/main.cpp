@@ -0,0 +1,151 @@
+// Copyright (C) 2023 Jason Bunk
+//
+// Reads a draw call trace recorded by the addon (render_target_stats/draw_trace_recorder.hpp),
+// prints per-frame draw counts (by draw type and by render target),
+// and optionally exports it as Chrome trace event JSON (viewable in chrome://tracing or ui.perfetto.dev),
+// with one track per recording thread and draws nested within frames.
+//
+#include "render_target_stats/draw_trace_format.hpp"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstring>
+#include <string>
+using std::endl;
+
+static bool read_trace(const std::string& filepath, draw_trace_file_header& header, std::vector<draw_trace_record>& records) {
+	std::ifstream infile(filepath, std::ios::binary);
+	if (!infile.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+		std::cout << "failed to read header of " << filepath << endl;
+		return false;
+	}
+	const draw_trace_file_header expected;
+	if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version || header.record_size != sizeof(draw_trace_record)) {
+		std::cout << filepath << " is not a draw trace of version " << expected.version << endl;
+		return false;
+	}
+	records.resize(header.num_records);
+	infile.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(draw_trace_record));
+	const size_t num_read = static_cast<size_t>(infile.gcount()) / sizeof(draw_trace_record);
+	if (num_read < records.size()) {
+		std::cout << "warning: trace is truncated, read " << num_read << " of " << records.size() << " records" << endl;
+		records.resize(num_read);
+	}
+	// records are only in order within each recording thread
+	std::stable_sort(records.begin(), records.end(), [](const draw_trace_record& a, const draw_trace_record& b) { return a.timestamp_ns < b.timestamp_ns; });
+	return true;
+}
+
+struct frame_summary {
+	uint64_t draws_by_type[DrawTrace_number_of_types] = {};
+	uint64_t total_vertices = 0;
+	std::map<uint64_t, uint64_t> draws_by_rt0; // render target resource -> draws
+	uint64_t first_ns = 0;
+	uint64_t present_ns = 0;
+	std::map<uint32_t, uint64_t> last_ns_by_thread; // recording thread -> its last record in this frame
+};
+
+static std::map<uint32_t, frame_summary> summarize_frames(const std::vector<draw_trace_record>& records) {
+	std::map<uint32_t, frame_summary> frames;
+	for (const draw_trace_record& rec : records) {
+		frame_summary& fs = frames[rec.frameidx];
+		if (fs.first_ns == 0) fs.first_ns = rec.timestamp_ns;
+		if (rec.type >= DrawTrace_number_of_types) continue;
+		fs.last_ns_by_thread[rec.thread_id] = rec.timestamp_ns;
+		fs.draws_by_type[rec.type]++;
+		if (rec.type == DrawTrace_Present) {
+			fs.present_ns = rec.timestamp_ns;
+		} else {
+			fs.total_vertices += static_cast<uint64_t>(rec.vertices) * rec.instances;
+			fs.draws_by_rt0[rec.rt0_resource] += (rec.type == DrawTrace_DrawIndirect) ? rec.instances : 1u;
+		}
+	}
+	return frames;
+}
+
+static void print_frame_summaries(const std::map<uint32_t, frame_summary>& frames, size_t max_render_targets) {
+	for (const auto& [frameidx, fs] : frames) {
+		std::cout << "frame " << std::setw(6) << frameidx << ":";
+		for (uint32_t tt = 0; tt < DrawTrace_Present; ++tt) std::cout << " " << std::setw(6) << fs.draws_by_type[tt] << " " << DrawTraceRecordTypeNames[tt] << ",";
+		std::cout << " " << fs.total_vertices << " vertices";
+		if (fs.present_ns > fs.first_ns) std::cout << ", " << std::fixed << std::setprecision(3) << (fs.present_ns - fs.first_ns) * 1e-6 << " ms to present";
+		std::cout << endl;
+		std::vector<std::pair<uint64_t, uint64_t>> byrt(fs.draws_by_rt0.begin(), fs.draws_by_rt0.end());
+		std::sort(byrt.begin(), byrt.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+		for (size_t ii = 0; ii < std::min(max_render_targets, byrt.size()); ++ii) {
+			std::cout << "    rt 0x" << std::hex << std::setw(16) << std::setfill('0') << byrt[ii].first << std::dec << std::setfill(' ')
+				<< ": " << byrt[ii].second << " draws" << endl;
+		}
+	}
+}
+
+// each draw becomes a short complete event (they have no duration on the CPU side worth showing), each frame a span up to its present,
+// repeated on the track of every thread that recorded in that frame so that its draws nest within it
+static bool write_chrome_trace(const std::string& filepath, const std::vector<draw_trace_record>& records, const std::map<uint32_t, frame_summary>& frames) {
+	std::ofstream outfile(filepath);
+	if (!outfile) {
+		std::cout << "failed to open " << filepath << endl;
+		return false;
+	}
+	const uint64_t t0 = records.empty() ? 0 : records.front().timestamp_ns;
+	auto us = [t0](uint64_t ns) { return static_cast<double>(ns - t0) * 1e-3; };
+	outfile << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" << endl;
+	bool first = true;
+	auto sep = [&]() { if (!first) outfile << "," << endl; first = false; };
+	const double draw_dur_us = 0.1;
+	for (const auto& [frameidx, fs] : frames) {
+		if (fs.present_ns <= fs.first_ns) continue;
+		for (const auto& [thread_id, last_ns] : fs.last_ns_by_thread) {
+			const double end_us = std::max(us(fs.present_ns), us(last_ns) + draw_dur_us); // a draw can be recorded just after another thread presents
+			sep();
+			outfile << "{\"name\":\"frame " << frameidx << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread_id << ",\"ts\":" << us(fs.first_ns) << ",\"dur\":" << end_us - us(fs.first_ns) << "}";
+		}
+	}
+	for (const draw_trace_record& rec : records) {
+		if (rec.type >= DrawTrace_number_of_types) continue;
+		sep();
+		if (rec.type == DrawTrace_Present) {
+			outfile << "{\"name\":\"present\",\"ph\":\"i\",\"s\":\"p\",\"pid\":1,\"tid\":" << rec.thread_id << ",\"ts\":" << us(rec.timestamp_ns)
+				<< ",\"args\":{\"frame\":" << rec.frameidx << "}}";
+			continue;
+		}
+		outfile << "{\"name\":\"" << DrawTraceRecordTypeNames[rec.type] << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << rec.thread_id
+			<< ",\"ts\":" << us(rec.timestamp_ns) << ",\"dur\":" << draw_dur_us << ",\"args\":{\"frame\":" << rec.frameidx
+			<< ",\"vertices\":" << rec.vertices << ",\"instances\":" << rec.instances << ",\"num_rtvs\":" << static_cast<uint32_t>(rec.num_rtvs)
+			<< std::hex << ",\"cmdlist\":\"0x" << rec.cmdlist << "\",\"rt0\":\"0x" << rec.rt0_resource << "\",\"dsv\":\"0x" << rec.dsv
+			<< "\",\"vs\":\"0x" << rec.pipeline_vs << "\",\"ps\":\"0x" << rec.pipeline_ps << "\"}}" << std::dec;
+	}
+	outfile << endl << "]}" << endl;
+	return static_cast<bool>(outfile);
+}
+
+int main(int argc, char** argv) {
+	std::string tracefile, jsonfile;
+	size_t max_render_targets = 5;
+	bool badargs = false;
+	for (int ii = 1; ii < argc; ++ii) {
+		const std::string arg(argv[ii]);
+		if (arg == "-j" && ii + 1 < argc) jsonfile = argv[++ii];
+		else if (arg == "-r" && ii + 1 < argc) max_render_targets = static_cast<size_t>(std::max(0, std::atoi(argv[++ii])));
+		else if (tracefile.empty() && !arg.empty() && arg[0] != '-') tracefile = arg;
+		else badargs = true;
+	}
+	if (badargs || tracefile.empty()) {
+		std::cout << "usage: draw_trace_reader trace.bin [-j chrome_trace.json] [-r render_targets_listed_per_frame]" << endl;
+		return 1;
+	}
+	draw_trace_file_header header;
+	std::vector<draw_trace_record> records;
+	if (!read_trace(tracefile, header, records)) return 1;
+	std::cout << records.size() << " records, " << header.num_dropped << " dropped while recording" << endl;
+	const std::map<uint32_t, frame_summary> frames = summarize_frames(records);
+	print_frame_summaries(frames, max_render_targets);
+	if (!jsonfile.empty()) {
+		if (!write_chrome_trace(jsonfile, records, frames)) return 1;
+		std::cout << "wrote " << jsonfile << endl;
+	}
+	return 0;
+}
@@ -21,7 +21,7 @@ bool GameHorizonZeroDawn::get_camera_matrix(CamMatrixData& rcam, std::string& er
 	if (!init_in_game()) return false;
 	const UINT_PTR dll4cambaseaddr = (UINT_PTR)camera_dll;
 	SIZE_T nbytesread = 0;
-	const uint64_t camlocstart = camera_dll_mem_start();
+	const uint64_t camlocstart = camera_mem_offset();
 	float readbuf[25];
 	Vec3 campos, camdir;
 	if (tryreadmemory(gamename_verbose() + std::string("_camandlook"), errstr, mygame_handle_exe,
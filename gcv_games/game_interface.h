@@ -31,4 +31,13 @@ public:
 
 	// memory scans
 	virtual bool scan_all_memory_for_scripted_cam_matrix(std::string& errstr) { errstr += "not implemented"; return false; }
+
+	// a search for the camera running in the background (e.g. a memory scan), if the game needs one
+	virtual bool camera_search_pending() const { return false; }
+	virtual std::string camera_search_status() const { return std::string(); } // empty if there is nothing to report
+	virtual void update_camera_search() {} // called every frame, so that the search starts (and retries) before the camera is first asked for
+	virtual void stop_camera_search() {}
+
+	// the owner calls this before deleting: background work may call virtual functions, so it must stop while the derived object is still whole
+	void shutdown() { stop_camera_search(); }
 };
@@ -3,19 +3,83 @@
 #include "gcv_utils/miscutils.h"
 #include "gcv_utils/memread.h"
 #include "gcv_utils/scan_for_camera_matrix.h"
+#include <reshade.hpp>
+#include <filesystem>
+#include <algorithm>
 
 bool GameWithCameraDataInOneDLL::init_in_game() {
   if (camera_dll != 0)
     return true;
+  if (camera_dll_matrix_format() == GameCamDLLMatrix_allmemscanrequiredtofindscriptedcambuf && cambuf_scan_state.load() == CamBufScan_NotStarted)
+    start_cambuf_scan_in_background();
   if (camera_dll_name().empty()) {
     camera_dll = GetModuleHandle(0); // use the memory space of the main exe, not a dll
-    return camera_dll != 0;
-
+  } else {
+    camera_dll = GetModuleHandle(wstring_from_string(camera_dll_name()).c_str());
   }
-  camera_dll = GetModuleHandle(wstring_from_string(camera_dll_name()).c_str());
+  if (camera_dll != 0 && camera_dll_matrix_format() != GameCamDLLMatrix_allmemscanrequiredtofindscriptedcambuf)
+    find_camera_dll_mem_offset();
   return camera_dll != 0;
 }
 
+// reads the dll's headers and code and data sections, laid out as loaded
+static bool read_loaded_module_image(HANDLE hProcess, HMODULE module, std::vector<uint8_t>& image, pe_headers& headers, std::string& errstr) {
+  const UINT_PTR modulebase = (UINT_PTR)module;
+  std::vector<uint8_t> headerbuf(4096);
+  SIZE_T nbytesread = 0;
+  if (!tryreadmemory("module headers", errstr, hProcess, (LPCVOID)(modulebase), headerbuf.data(), headerbuf.size(), &nbytesread)
+      || !parse_pe_headers(headerbuf.data(), headerbuf.size(), headers, errstr))
+    return false;
+  image.assign(headers.size_of_image, 0u);
+  memcpy(image.data(), headerbuf.data(), std::min<size_t>(headerbuf.size(), image.size()));
+  for (const pe_section& section : headers.sections) {
+    if (section.name != ".text" && section.name != ".data") continue;
+    if (static_cast<uint64_t>(section.rva) + section.virtual_size > image.size()) continue;
+    ReadProcessMemory(hProcess, (LPCVOID)(modulebase + section.rva), image.data() + section.rva, section.virtual_size, &nbytesread);
+  }
+  return true;
+}
+
+// only a hint for writing a signature, so it runs on its own thread: copying the image and searching its code takes a while
+static void log_camera_signature_candidate(HANDLE hProcess, HMODULE module, uint64_t target_rva) {
+  std::vector<uint8_t> image;
+  pe_headers headers;
+  std::string errstr;
+  module_signature candidate;
+  if (read_loaded_module_image(hProcess, module, image, headers, errstr)
+      && make_rip_reference_signature(image.data(), image.size(), headers, target_rva, candidate, errstr)) {
+    reshade::log_message(reshade::log_level::info, (std::string("no camera signature; a candidate for this build: \"") + candidate.pattern
+      + std::string("\" (displacement at ") + std::to_string(candidate.rip_disp_offset) + std::string(", instruction end at ") + std::to_string(candidate.rip_instr_end) + std::string(")")).c_str());
+  }
+}
+
+void GameWithCameraDataInOneDLL::find_camera_dll_mem_offset() {
+  camera_dll_mem_offset = camera_dll_mem_start();
+  const module_signature sig = camera_dll_mem_signature();
+  if (sig.pattern.empty()) {
+    if (camera_dll_mem_start() != 0 && !signature_hint_thread.joinable())
+      signature_hint_thread = std::thread(log_camera_signature_candidate, mygame_handle_exe, camera_dll, camera_dll_mem_start());
+    return;
+  }
+  const auto t0 = std::chrono::steady_clock::now();
+  std::vector<uint8_t> image;
+  pe_headers headers;
+  std::string errstr;
+  if (!read_loaded_module_image(mygame_handle_exe, camera_dll, image, headers, errstr)) {
+    reshade::log_message(reshade::log_level::warning, (std::string("failed to read the camera dll's image: ") + errstr).c_str());
+    return;
+  }
+  const uint64_t rva = find_module_signature_rva(image.data(), image.size(), headers, sig, errstr);
+  const int64_t millis = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+  if (rva == signature_notfound || rva >= image.size()) {
+    reshade::log_message(reshade::log_level::warning, (std::string("camera signature: ") + errstr + std::string("; using the hardcoded offset ") + std::to_string(camera_dll_mem_start())).c_str());
+    return;
+  }
+  camera_dll_mem_offset = rva;
+  reshade::log_message(reshade::log_level::info, (std::string("camera signature found offset ") + std::to_string(rva) + std::string(" in ") + std::to_string(millis)
+    + std::string(" ms (hardcoded: ") + std::to_string(camera_dll_mem_start()) + std::string(")")).c_str());
+}
+
 
 static bool dummy_check_scriptedcambuf(const void* scanctx, const uint8_t* buf, uint64_t buflen) {
     return true;
@@ -25,19 +89,79 @@ scriptedcam_checkbuf_funptr GameWithCameraDataInOneDLL::get_scriptedcambuf_check
 }
 
 
+void GameWithCameraDataInOneDLL::start_cambuf_scan_in_background() {
+  if (cambuf_scan_state.load() == CamBufScan_Running) return;
+  if (cambuf_scan_thread.joinable()) cambuf_scan_thread.join(); // already finished
+  cam_matrix_mem_loc_saved = 0ull;
+  cambuf_scan_progress.cancel = false;
+  cambuf_scan_progress.bytes_total = 0ull;
+  cambuf_scan_progress.bytes_scanned = 0ull;
+  cambuf_scan_state = CamBufScan_Running;
+  cambuf_scan_thread = std::thread([this]() {
+    std::string errstr;
+    const bool found = scan_all_memory_for_scripted_cam_matrix(errstr);
+    cambuf_scan_finished_time = std::chrono::steady_clock::now();
+    if (!found && !cambuf_scan_progress.cancel.load()) {
+      reshade::log_message(reshade::log_level::warning, (std::string("memory scan did not find the scripted camera buffer") + (errstr.empty() ? std::string() : std::string(": ") + errstr)).c_str());
+    }
+    cambuf_scan_state = found ? CamBufScan_Found : CamBufScan_Failed;
+  });
+}
+
+bool GameWithCameraDataInOneDLL::cambuf_scan_due() const {
+  const int scanstate = cambuf_scan_state.load();
+  return scanstate == CamBufScan_NotStarted || (scanstate == CamBufScan_Failed
+    && std::chrono::steady_clock::now() - cambuf_scan_finished_time > std::chrono::seconds(cambuf_scan_retry_seconds));
+}
+
+void GameWithCameraDataInOneDLL::update_camera_search() {
+  if (!init_in_game()) return;
+  if (camera_dll_matrix_format() == GameCamDLLMatrix_allmemscanrequiredtofindscriptedcambuf && cam_matrix_mem_loc_saved.load() == 0ull && cambuf_scan_due())
+    start_cambuf_scan_in_background();
+}
+
+void GameWithCameraDataInOneDLL::stop_camera_search() {
+  cambuf_scan_progress.cancel = true;
+  if (cambuf_scan_thread.joinable()) cambuf_scan_thread.join();
+  if (signature_hint_thread.joinable()) signature_hint_thread.join();
+}
+
+bool GameWithCameraDataInOneDLL::camera_search_pending() const {
+  return camera_dll_matrix_format() == GameCamDLLMatrix_allmemscanrequiredtofindscriptedcambuf && cambuf_scan_state.load() == CamBufScan_Running;
+}
+
+std::string GameWithCameraDataInOneDLL::camera_search_status() const {
+  switch (cambuf_scan_state.load()) {
+  case CamBufScan_Running:
+    return std::string("scanning memory for the camera (") + std::string(cambuf_scan_is_slow.load() ? "slow" : "fast") + std::string(" scan): ")
+      + std::to_string(static_cast<int>(100.0f * cambuf_scan_progress.fraction())) + std::string("%");
+  case CamBufScan_Failed:
+    return std::string("camera not found by the last memory scan, will retry");
+  default:
+    return std::string();
+  }
+}
+
 bool GameWithCameraDataInOneDLL::read_scripted_cambuf_and_copy_to_matrix(CamMatrixData& rcam, std::string& errstr) {
-  if (cam_matrix_mem_loc_saved == 0 && !scan_all_memory_for_scripted_cam_matrix(errstr)) return false;
+  const uint64_t camloc = cam_matrix_mem_loc_saved.load();
+  if (camloc == 0) {
+    if (cambuf_scan_due()) start_cambuf_scan_in_background();
+    errstr += "camera pending (memory scan in progress)";
+    return false;
+  }
   std::vector<uint8_t> copybuf(get_scriptedcambuf_sizebytes());
   SIZE_T nbytesread = 0;
-  if (tryreadmemory(gamename_verbose() + std::string("scriptedcam"), errstr, mygame_handle_exe, (LPCVOID)(cam_matrix_mem_loc_saved), (LPVOID)(copybuf.data()), get_scriptedcambuf_sizebytes(), &nbytesread)) {
+  if (tryreadmemory(gamename_verbose() + std::string("scriptedcam"), errstr, mygame_handle_exe, (LPCVOID)(camloc), (LPVOID)(copybuf.data()), get_scriptedcambuf_sizebytes(), &nbytesread)) {
     if (get_scriptedcambuf_checkfun()(nullptr, copybuf.data(), get_scriptedcambuf_sizebytes())) {
       return copy_scriptedcambuf_to_matrix(copybuf.data(), nbytesread, rcam, errstr);
     } else {
-      errstr += std::string("after reading memory at ") + std::to_string(cam_matrix_mem_loc_saved) + std::string(", float hash failed");
+      errstr += std::string("after reading memory at ") + std::to_string(camloc) + std::string(", float hash failed; rescanning");
     }
   } else {
-    errstr += std::string("failed to read memory at ") + std::to_string(cam_matrix_mem_loc_saved) + std::string(", tryreadmem failed");
+    errstr += std::string("failed to read memory at ") + std::to_string(camloc) + std::string(", tryreadmem failed; rescanning");
   }
+  // the buffer moved (e.g. the script's table was garbage collected), so look for it again
+  start_cambuf_scan_in_background();
   return false;
 }
 
@@ -55,7 +179,7 @@ bool GameWithCameraDataInOneDLL::get_raw_camera_matrix(CamMatrixData& rcam, std:
   }
   SIZE_T nbytesread = 0;
   UINT_PTR dll4cambaseaddr = (UINT_PTR)camera_dll;
-  const uint64_t camloc = camera_dll_mem_start();
+  const uint64_t camloc = camera_mem_offset();
   float cambuf[12];
   if (mattype == GameCamDLLMatrix_3x4) {
     if (tryreadmemory(gamename_verbose() + std::string("_3x4cam"), errstr, mygame_handle_exe,
@@ -92,8 +216,6 @@ bool GameWithCameraDataInOneDLL::get_camera_matrix(CamMatrixData& rcam, std::str
   return matrix_ok;
 }
 
-#include <reshade.hpp>
-
 bool GameWithCameraDataInOneDLL::scan_all_memory_for_scripted_cam_matrix(std::string& errstr)
 {
   const GameCamDLLMatrixType mattype = camera_dll_matrix_format();
@@ -104,20 +226,50 @@ bool GameWithCameraDataInOneDLL::scan_all_memory_for_scripted_cam_matrix(std::st
   const uint64_t bufbytes = get_scriptedcambuf_sizebytes();
   constexpr uint64_t magicbytes = 4429373075689993337ull; // should rarely occur in game memory; so, easy to search for
 
-  AllMemScanner scanner(mygame_handle_exe, bufbytes, errstr, magicbytes, true);
-  uint64_t foundloc = 0;
-  const uint8_t* foundbuf = nullptr;
-  uint64_t f_b_l = 0;
-  while (scanner.iterate_next(foundloc, foundbuf, f_b_l, nullptr, get_scriptedcambuf_checkfun())) {
-    cam_matrix_mem_loc_saved = foundloc;
-    return true; // immediately break upon first finding a matching array (with a valid float hash)
+  // where previous scans found it, persisted next to the game's exe; loaded once, then only used by the scan thread
+  if (cambuf_hit_profile_path.empty()) {
+    wchar_t exe_path[MAX_PATH] = L"";
+    GetModuleFileNameW(nullptr, exe_path, ARRAYSIZE(exe_path));
+    cambuf_hit_profile_path = (std::filesystem::path(exe_path).parent_path()
+      / (std::wstring(L"gcv_memscan_profile_") + wstring_from_string(gamename_simpler()) + std::wstring(L".json"))).wstring();
+    std::string profilelog;
+    const bool loaded = cambuf_hit_profile.load_json_file(cambuf_hit_profile_path, profilelog);
+    reshade::log_message(loaded ? reshade::log_level::info : reshade::log_level::warning, profilelog.c_str());
   }
-  reshade::log_message(reshade::log_level::warning, "fast memory scan failed, trying slow scan");
-  scanner.fastscan = false;
-  scanner.reset_iterator_to_beginning();
-  while (scanner.iterate_next(foundloc, foundbuf, f_b_l, nullptr, get_scriptedcambuf_checkfun())) {
-    cam_matrix_mem_loc_saved = foundloc;
-    return true;
+
+  // the camera buffer is the first signature; the game's extra ones are found in the same pass
+  std::vector<AllMemScanner::scan_signature> signatures(1);
+  signatures[0].triggerbytes = magicbytes;
+  signatures[0].minlen = bufbytes;
+  signatures[0].check = get_scriptedcambuf_checkfun();
+  std::vector<AllMemScanner::scan_signature> extrasigs = get_extra_scan_signatures();
+  if (extrasigs.size() > max_extra_scan_signatures) extrasigs.resize(max_extra_scan_signatures);
+  signatures.insert(signatures.end(), extrasigs.begin(), extrasigs.end());
+
+  AllMemScanner scanner(mygame_handle_exe, bufbytes, errstr, magicbytes, true);
+  scanner.progress = &cambuf_scan_progress;
+  std::vector<AllMemScanner::signature_hit> hits;
+  // the first matching array (with a valid float hash), in regions similar to (then nearest) where it was found before, else at the lowest address
+  for (const bool fastscan : { true, false }) {
+    if (!fastscan) {
+      if (cambuf_scan_progress.cancel.load()) return false;
+      reshade::log_message(reshade::log_level::warning, "fast memory scan failed, trying slow scan");
+    }
+    scanner.fastscan = fastscan;
+    cambuf_scan_is_slow = !fastscan;
+    std::vector<AllMemScanner::mem_region> regions = scanner.enumerate_regions();
+    cambuf_hit_profile.prioritize(regions);
+    scanner.find_first_each(regions, signatures, hits);
+    if (hits[0].found) {
+      for (size_t ee = 0; ee < max_extra_scan_signatures; ++ee)
+        extra_scan_mem_locs[ee] = (ee + 1 < hits.size() && hits[ee + 1].found) ? hits[ee + 1].address : 0ull;
+      cam_matrix_mem_loc_saved = hits[0].address;
+      cambuf_hit_profile.record(hits[0].address, hits[0].region);
+      std::string profilelog;
+      if (!cambuf_hit_profile.save_json_file(cambuf_hit_profile_path, profilelog))
+        reshade::log_message(reshade::log_level::warning, profilelog.c_str());
+      return true;
+    }
   }
   return false;
 }
@@ -1,6 +1,12 @@
 #pragma once
 // Copyright (C) 2022 Jason Bunk
 #include "game_interface.h"
+#include "gcv_utils/scan_for_camera_matrix.h"
+#include "gcv_utils/module_signature_scan.h"
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
 
 enum GameCamDLLMatrixType {
   GameCamDLLMatrix_positiononly,
@@ -16,7 +22,7 @@ typedef bool (*scriptedcam_checkbuf_funptr)(const void*, const uint8_t*, uint64_
 class GameWithCameraDataInOneDLL : public GameInterface {
 protected:
   HMODULE camera_dll = 0;
-  uint64_t cam_matrix_mem_loc_saved = 0; // used if all memory needs to be scanned
+  std::atomic<uint64_t> cam_matrix_mem_loc_saved = { 0ull }; // used if all memory needs to be scanned; written by the scan thread
 
   // if you subclass from this, you need to implement these,
   // and also the two from GameInterface returning the string name of the game
@@ -24,13 +30,50 @@ protected:
   virtual uint64_t camera_dll_mem_start() const = 0;
   virtual GameCamDLLMatrixType camera_dll_matrix_format() const = 0;
 
+  // optional: finds the camera in the dll by a byte signature when the game starts, so that it survives game patches (camera_dll_mem_start() is the fallback);
+  // while there is none, a candidate referring to camera_dll_mem_start() is found in the background and logged
+  virtual module_signature camera_dll_mem_signature() const { return module_signature(); }
+  uint64_t camera_mem_offset() const { return camera_dll_mem_offset; } // from the dll's base, as found by the signature or else camera_dll_mem_start()
+
   virtual void camera_matrix_postprocess_rotate(CamMatrixData& rcam) const {};
 
   virtual scriptedcam_checkbuf_funptr get_scriptedcambuf_checkfun() const;
   virtual uint64_t get_scriptedcambuf_sizebytes() const { return 0; }
   virtual bool copy_scriptedcambuf_to_matrix(uint8_t* buf, uint64_t buflen, CamMatrixData& rcam, std::string& errstr) const { return false; }
 
+  // other values (e.g. FOV, near/far planes, time of day) to find in the same memory scan as the scripted camera buffer, at no extra cost;
+  // the scan ends once the camera buffer is found, so these are only found if they come before it in the scan order (or in the same chunk);
+  // where each was found (0 if not) is then given by extra_scan_mem_loc(), in the same order
+  static constexpr size_t max_extra_scan_signatures = 8;
+  virtual std::vector<AllMemScanner::scan_signature> get_extra_scan_signatures() const { return {}; }
+  uint64_t extra_scan_mem_loc(size_t idx) const { return idx < max_extra_scan_signatures ? extra_scan_mem_locs[idx].load() : 0ull; }
+
 private:
+  // The memory scan runs in the background, started by update_camera_search() on the first frame, again after it fails,
+  // and whenever the buffer is lost (e.g. moved by the garbage collector), so that the render thread never waits for it;
+  // until it finds the buffer, camera requests fail with "camera pending". The owner stops it with shutdown() before deleting the game.
+  enum CamBufScanState : int {
+    CamBufScan_NotStarted = 0,
+    CamBufScan_Running,
+    CamBufScan_Found,
+    CamBufScan_Failed,
+  };
+  static constexpr int64_t cambuf_scan_retry_seconds = 10; // after a failed scan (e.g. not in game yet)
+  std::atomic<int> cambuf_scan_state = { CamBufScan_NotStarted };
+  std::atomic<bool> cambuf_scan_is_slow = { false };
+  AllMemScanProgress cambuf_scan_progress;
+  std::thread cambuf_scan_thread;
+  std::chrono::steady_clock::time_point cambuf_scan_finished_time;
+  std::atomic<uint64_t> extra_scan_mem_locs[max_extra_scan_signatures] = {}; // written by the scan thread
+  AllMemScanHitProfile cambuf_hit_profile; // only used by the scan thread
+  std::wstring cambuf_hit_profile_path;
+  void start_cambuf_scan_in_background(); // only called from the render thread
+  bool cambuf_scan_due() const; // not started yet, or the last scan failed long enough ago
+
+  uint64_t camera_dll_mem_offset = 0ull;
+  void find_camera_dll_mem_offset(); // when the dll is first found
+  std::thread signature_hint_thread; // while there is no signature, logs a candidate in the background
+
   bool read_scripted_cambuf_and_copy_to_matrix(CamMatrixData& rcam, std::string& errstr); // not virtual, no need to override; just override the above three
   bool get_raw_camera_matrix(CamMatrixData& rcam, std::string& errstr); // no post-processing (such as rotation)
 
@@ -38,5 +81,9 @@ public:
   virtual bool init_in_game() override;
   virtual bool get_camera_matrix(CamMatrixData& rcam, std::string& errstr) override;
   // memory scans
-  virtual bool scan_all_memory_for_scripted_cam_matrix(std::string& errstr) override;
+  virtual bool scan_all_memory_for_scripted_cam_matrix(std::string& errstr) override; // blocking
+  virtual bool camera_search_pending() const override;
+  virtual std::string camera_search_status() const override;
+  virtual void update_camera_search() override;
+  virtual void stop_camera_search() override;
 };
@@ -7,7 +7,6 @@
 #include <reshade.hpp>
 #include "copy_texture_into_packedbuf.h"
 #include "tex_buffer_utils.h"
-#include "xxhash.h"
 #include "render_target_stats/reshade_tex_format_info.hpp"
 
 using namespace reshade::api;
@@ -313,28 +312,8 @@ bool copy_texture_image_given_ready_resource_into_packedbuf(
 		if (tex_interp != TexInterp_IndexedSeg) return false;
 		dstBuf.width *= 2;
 		dstBuf.height *= 2;
-		if (!dstBuf.set_pixfmt_and_alloc_bytes(BUF_PIX_FMT_RGB24)) {
-			return false;
-		} else {
-			uint32_t seg_idx_color;
-			uint8_t *const hash_color_channels = reinterpret_cast<uint8_t*>(&seg_idx_color);
-			size_t chC = 0;
-			for (size_t chY = 0; chY < 2; ++chY) {
-				for (size_t chX = 0; chX < 2; ++chX) {
-					data_p = static_cast<uint8_t*>(data.data);
-					for (size_t y = 0; y < desc.texture.height; ++y, data_p += data.row_pitch) {
-						for (size_t x = 0; x < desc.texture.width; ++x) {
-							seg_idx_color = XXH32(data_p + x * 16 + chC*4, 4, 0);
-							uint8_t* const dst = dstBuf.entryptr<uint8_t>(y + chY*desc.texture.height, x + chX*desc.texture.width);
-							dst[0] = hash_color_channels[0];
-							dst[1] = hash_color_channels[1];
-							dst[2] = hash_color_channels[2];
-						}
-					}
-					chC++;
-				}
-			}
-		}
+		if (!dstBuf.set_pixfmt_and_alloc_bytes(BUF_PIX_FMT_RGB24)) return false;
+		indexed_seg_rgba32_hash_mosaic(dstBuf, desc, data);
 		break;
 	default: {
 		// Unsupported format
@@ -33,6 +33,11 @@ void image_writer_thread_pool::cleanup_clear_all() {
 }
 
 image_writer_thread_pool::~image_writer_thread_pool() {
+	if (game != nullptr) {
+		game->shutdown();
+		delete game;
+		game = nullptr;
+	}
 	cleanup_clear_all();
 }
 
@@ -99,9 +104,12 @@ void image_writer_thread_pool::change_num_threads(size_t new_num) {
 
 bool image_writer_thread_pool::init_on_startup() {
 	if (game != nullptr) return true;
+	if (game_unrecognized) return false; // by the exe's name, which won't change
 	game = GameInterfaceFactory::get().getGameInterface(lowercasenameofcurrentprocessexe());
-	if (game == nullptr)
+	if (game == nullptr) {
+		game_unrecognized = true;
 		return false;
+	}
 	return game->init_on_startup();
 }
 bool image_writer_thread_pool::init_in_game() {
@@ -131,6 +139,18 @@ bool image_writer_thread_pool::get_camera_matrix(CamMatrixData &rcam, std::strin
 	}
 	return game->get_camera_matrix(rcam, errstr);
 }
+bool image_writer_thread_pool::camera_search_pending() {
+	if (game == nullptr) return false;
+	return game->camera_search_pending();
+}
+std::string image_writer_thread_pool::camera_search_status() {
+	if (game == nullptr) return "";
+	return game->camera_search_status();
+}
+void image_writer_thread_pool::update_camera_search() {
+	if (!init_on_startup()) return;
+	game->update_camera_search();
+}
 
 bool image_writer_thread_pool::save_texture_image_needing_resource_barrier_copy(
 	const std::string &base_filename, uint64_t image_writers,
@@ -163,30 +183,81 @@ bool image_writer_thread_pool::save_texture_image_needing_resource_barrier_copy(
 }
 
 bool image_writer_thread_pool::save_segmentation_app_indexed_image_needing_resource_barrier_copy(
-	const std::string& base_filename, reshade::api::command_queue* queue, nlohmann::json& metajson)
+	const std::string& base_filename, reshade::api::command_queue* queue, reshade::api::resource depth_tex, nlohmann::json& metajson)
 {
 	if (num_threads() == 0) change_num_threads(3);
 	if (num_threads() == 0) return false;
 	init_in_game();
-	queue_item_image2write* qseg = new queue_item_image2write(ImageWriter_STB_png, output_filepath_creates_outdir_if_needed(base_filename+std::string("semseg")));
+	// COCO RLE masks of each segment are encoded by the writer threads, from the same buffers as the images
+	const uint64_t cocorle = save_coco_rle_masks ? ImageWriter_cocorle : ImageWriter_none;
+	queue_item_image2write* qseg = new queue_item_image2write(ImageWriter_STB_png | cocorle, output_filepath_creates_outdir_if_needed(base_filename+std::string("semseg")));
 	queue_item_image2write* qtri = new queue_item_image2write(ImageWriter_STB_png, output_filepath_creates_outdir_if_needed(base_filename+std::string("trireg")));
-	if (qseg == nullptr || qtri == nullptr) {
+	queue_item_image2write* qmap = new queue_item_image2write(ImageWriter_rawbin, output_filepath_creates_outdir_if_needed(base_filename+std::string("colormaps")));
+	if (qseg == nullptr || qtri == nullptr || qmap == nullptr) {
 		reshade::log_message(reshade::log_level::error, "failed to allocate new queue entry");
+		delete qseg;
+		delete qtri;
+		delete qmap;
 		return false;
 	}
 	auto& segmapp = queue->get_device()->get_private_data<segmentation_app_data>();
-	if (!segmapp.copy_and_index_seg_tex_needing_resource_barrier_into_packedbuf_and_metajson(
-			queue, qseg->mybuf, qtri->mybuf, metajson)) {
+	// 16-bit class IDs: saved as numpy, since the png writer only does 8 bits per channel
+	queue_item_image2write* qcls = segmapp.semantic_labels.empty() ? nullptr
+		: new queue_item_image2write(ImageWriter_numpy | cocorle, output_filepath_creates_outdir_if_needed(base_filename+std::string("semclass")));
+	queue_item_image2write* qins = !segmapp.save_grouped_instances ? nullptr
+		: new queue_item_image2write(ImageWriter_numpy | cocorle, output_filepath_creates_outdir_if_needed(base_filename+std::string("instances")));
+	// the depth continuity rule of the instance grouping needs its own copy of the depth buffer
+	simple_packed_buf depthbuf;
+	const bool have_depth = qins != nullptr && depth_tex.handle != 0ull && segmapp.instance_grouping.max_relative_depth_step > 0.0f
+		&& copy_texture_image_needing_resource_barrier_into_packedbuf(game, depthbuf, queue, depth_tex, TexInterp_Depth, depth_settings);
+	if (have_depth && depthbuf.pixfmt == BUF_PIX_FMT_GRAYU32) {
+		// raw depth bits (game can't linearize them): still monotonic, so good enough for continuity
+		for (size_t ii = 0; ii < depthbuf.width * depthbuf.height; ++ii)
+			depthbuf.data<float>()[ii] = static_cast<float>(depthbuf.data<uint32_t>()[ii]);
+		depthbuf.pixfmt = BUF_PIX_FMT_GRAYF32;
+	}
+	if (!segmapp.copy_and_index_seg_tex_needing_resource_barrier_into_packedbufs(
+			queue, qseg->mybuf, qtri->mybuf, qcls != nullptr ? &qcls->mybuf : nullptr, qmap->mybuf,
+			qins != nullptr ? &qins->mybuf : nullptr, have_depth ? &depthbuf : nullptr)) {
 		delete qseg;
 		delete qtri;
+		delete qmap;
+		delete qcls;
+		delete qins;
 		return false;
 	}
+	// the colors in the semseg and trireg pngs are explained by binary tables in this file (see load_colormaps.py)
+	metajson["seg_tri_colormaps_file"] = base_filename + std::string("colormaps.bin");
+	if (qins != nullptr) metajson["instance_grouping_used_depth"] = have_depth;
+	if (save_coco_rle_masks) metajson["semseg_coco_rle_file"] = base_filename + std::string("semseg_cocorle.json");
 	if (!images2writequeue.enqueue(qseg)) {
 		delete qseg;
+		delete qtri;
+		delete qmap;
+		delete qcls;
+		delete qins;
 		return false;
 	}
 	if (!images2writequeue.enqueue(qtri)) {
 		delete qtri;
+		delete qmap;
+		delete qcls;
+		delete qins;
+		return false;
+	}
+	if (!images2writequeue.enqueue(qmap)) {
+		delete qmap;
+		delete qcls;
+		delete qins;
+		return false;
+	}
+	if (qcls != nullptr && !images2writequeue.enqueue(qcls)) {
+		delete qcls;
+		delete qins;
+		return false;
+	}
+	if (qins != nullptr && !images2writequeue.enqueue(qins)) {
+		delete qins;
 		return false;
 	}
 	return true;
@@ -18,6 +18,7 @@ class __declspec(uuid("3cc75b62-7d40-444c-aef8-574977a58346")) image_writer_thre
 	std::vector<std::atomic<int> *> threadkeepalives;
 	moodycamel::ConcurrentQueue<queue_item_image2write *> images2writequeue;
 	GameInterface *game = nullptr;
+	bool game_unrecognized = false;
 
 	void create_threads(size_t howmany);
 	void join_and_delete_threads(size_t howmany);
@@ -29,6 +30,8 @@ public:
 
 	bool camcoordsinitialized = false;
 	bool grabcamcoords = false;
+	bool save_coco_rle_masks = false; // segmentation captures also save per-segment COCO RLE masks, bboxes, and areas
+	bool overlay_drawn_since_last_frame = false; // the draw hooks stay active while the overlay is open
 
 	// methods from GameInterface
 	bool init_on_startup();
@@ -37,6 +40,9 @@ public:
 	std::string gamename_simpler();
 	std::string gamename_verbose();
 	bool get_camera_matrix(CamMatrixData &rcam, std::string &errstr);
+	bool camera_search_pending();
+	std::string camera_search_status();
+	void update_camera_search();
 
 	std::string output_filepath_creates_outdir_if_needed(const std::string &base_filename);
 
@@ -52,5 +58,5 @@ public:
 		TextureInterpretation tex_interp);
 
 	bool save_segmentation_app_indexed_image_needing_resource_barrier_copy(
-		const std::string& base_filename, reshade::api::command_queue* queue, nlohmann::json & metajson);
+		const std::string& base_filename, reshade::api::command_queue* queue, reshade::api::resource depth_tex, nlohmann::json & metajson);
 };
@@ -4,7 +4,9 @@
 #include "generic_depth_struct.h"
 #include "gcv_games/game_interface_factory.h"
 #include "gcv_utils/miscutils.h"
+#include "gcv_utils/hook_activity.hpp"
 #include "render_target_stats/render_target_stats_tracking.hpp"
+#include "render_target_stats/draw_trace_recorder.hpp"
 #include "segmentation/reshade_hooks.hpp"
 #include "segmentation/segmentation_app_data.hpp"
 #include <fstream>
@@ -18,6 +20,8 @@ static void on_init(reshade::api::device* device)
 }
 static void on_destroy(reshade::api::device* device)
 {
+	hook_activity_publish(0u, hook_activity_bit(HookFeature_DrawTrace));
+	draw_trace_recorder::get().stop();
 	device->get_private_data<image_writer_thread_pool>().change_num_threads(0);
 	device->get_private_data<image_writer_thread_pool>().print_waiting_log_messages();
 	device->destroy_private_data<image_writer_thread_pool>();
@@ -27,6 +31,7 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime *runtime,
 	reshade::api::command_list *, reshade::api::resource_view rtv, reshade::api::resource_view)
 {
 	auto &shdata = runtime->get_device()->get_private_data<image_writer_thread_pool>();
+	shdata.update_camera_search(); // starts a background camera search on the first frame, rather than on the first capture
 	CamMatrixData gamecam;
 	std::string errstr;
 	bool shaderupdatedwithcampos = false;
@@ -35,7 +40,9 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime *runtime,
 	auto& segmapp = device->get_private_data<segmentation_app_data>();
 
 	// returns true if frame capture requested
-	if (segmentation_app_update_on_finish_effects(runtime, runtime->is_key_pressed(VK_F11)))
+	const bool overlay_open = shdata.overlay_drawn_since_last_frame;
+	shdata.overlay_drawn_since_last_frame = false;
+	if (segmentation_app_update_on_finish_effects(runtime, runtime->is_key_pressed(VK_F11), overlay_open))
 	{
 		generic_depth_data &genericdepdata = runtime->get_private_data<generic_depth_data>();
 		reshade::api::command_queue *cmdqueue = runtime->get_command_queue();
@@ -60,7 +67,7 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime *runtime,
 		}
 
 		if (shdata.save_segmentation_app_indexed_image_needing_resource_barrier_copy(
-					basefilen, cmdqueue, metajson)) {
+					basefilen, cmdqueue, genericdepdata.selected_depth_stencil, metajson)) {
 			capmessage << "semseg good; ";
 		} else {
 			capmessage << "semseg failed; ";
@@ -72,7 +79,7 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime *runtime,
 			gamecam.into_json(metajson);
 			metajson["time_us"] = microelapsedstr;
 		} else {
-			capmessage << "camjson: failed to get any camera data";
+			capmessage << (shdata.camera_search_pending() ? "camjson: camera pending" : "camjson: failed to get any camera data");
 			capgood = false;
 		}
 		if (!errstr.empty()) {
@@ -147,12 +154,13 @@ static void on_reshade_finish_effects(reshade::api::effect_runtime *runtime,
 		shdata.camcoordsinitialized = true;
 	}
 	shdata.print_waiting_log_messages();
-	segmapp.r_counter_buf.reset_at_end_of_frame();
+	segmapp.r_counter_buf.reset_at_end_of_frame(device);
 }
 
 static void draw_settings_overlay(reshade::api::effect_runtime *runtime)
 {
 	auto &shdata = runtime->get_device()->get_private_data<image_writer_thread_pool>();
+	shdata.overlay_drawn_since_last_frame = true;
 	ImGui::Checkbox("Depth map: verbose mode", &shdata.depth_settings.more_verbose);
 	if (shdata.depth_settings.more_verbose) {
 		ImGui::Checkbox("Depth map: debug mode", &shdata.depth_settings.debug_mode);
@@ -163,6 +171,11 @@ static void draw_settings_overlay(reshade::api::effect_runtime *runtime)
 		ImGui::SliderInt("Depth map: bytes per pix to keep", &shdata.depth_settings.depthbyteskeep, 0, 8);
 	}
 	ImGui::Checkbox("Grab camera coordinates every frame?", &shdata.grabcamcoords);
+	const std::string camsearchstatus = shdata.camera_search_status();
+	if (!camsearchstatus.empty()) ImGui::TextUnformatted(camsearchstatus.c_str());
+#ifdef RENDERDOC_FOR_SHADERS
+	ImGui::Checkbox("Segmentation: also save COCO RLE masks?", &shdata.save_coco_rle_masks);
+#endif
 	if (shdata.grabcamcoords) {
 		CamMatrixData lcam; std::string errstr;
 		if (shdata.get_camera_matrix(lcam, errstr) != CamMatrix_Uninitialized) {
@@ -174,6 +187,45 @@ static void draw_settings_overlay(reshade::api::effect_runtime *runtime)
 			ImGui::Text(errstr.c_str());
 		}
 	}
+	if (ImGui::TreeNode("Draw hook cost (sampled CPU ticks per draw)")) {
+		const char* featurenames[HookFeature_count] = { "render target stats", "segmentation", "draw trace" };
+		const uint64_t overhead = hook_cost_timer_overhead_ticks();
+		for (uint32_t ff = 0; ff < HookFeature_count; ++ff) {
+			const double idle = hook_cost_meters[ff].average_ticks(false, overhead);
+			const double active = hook_cost_meters[ff].average_ticks(true, overhead);
+			ImGui::Text("%-20s idle %8.1f, active %8.1f", featurenames[ff], idle, active);
+		}
+		if (ImGui::Button("Reset hook cost")) {
+			for (uint32_t ff = 0; ff < HookFeature_count; ++ff) hook_cost_meters[ff].reset();
+		}
+		ImGui::TreePop();
+	}
+	if (ImGui::TreeNode("Draw call trace")) {
+		draw_trace_recorder& recorder = draw_trace_recorder::get();
+		if (!recorder.is_recording()) {
+			if (ImGui::Button("Start recording draw trace")) {
+				std::string errstr;
+				const int64_t microseconds_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(hiresclock::now() - shdata.init_time).count();
+				const std::string tracefile = shdata.output_filepath_creates_outdir_if_needed(shdata.gamename_simpler() + std::string("_")
+					+ get_datestr_yyyy_mm_dd() + std::string("_") + std::to_string(microseconds_elapsed) + std::string("_drawtrace.bin"));
+				const bool started = recorder.start(tracefile, errstr);
+				hook_activity_publish(started ? hook_activity_bit(HookFeature_DrawTrace) : 0u, hook_activity_bit(HookFeature_DrawTrace));
+				if (started) reshade::log_message(reshade::log_level::info, (std::string("recording draw trace to ") + tracefile).c_str());
+				else reshade::log_message(reshade::log_level::error, errstr.c_str());
+			}
+		} else if (ImGui::Button("Stop recording draw trace")) {
+			hook_activity_publish(0u, hook_activity_bit(HookFeature_DrawTrace));
+			recorder.stop();
+		}
+		const draw_trace_recorder::status st = recorder.get_status();
+		if (!st.filepath.empty()) {
+			ImGui::Text("%s: %llu records (%llu dropped), %.1f MB", st.recording ? "recording" : "stopped",
+				st.num_records, st.num_dropped, static_cast<double>(st.file_bytes) / (1024.0 * 1024.0));
+			ImGui::TextUnformatted(st.filepath.c_str());
+		}
+		if (!st.error.empty()) ImGui::TextUnformatted(st.error.c_str());
+		ImGui::TreePop();
+	}
 	ImGui::Text("Render targets:");
 	imgui_draw_rgb_render_target_stats_in_reshade_overlay(runtime);
 	imgui_draw_custom_shader_debug_viz_in_reshade_overlay(runtime);
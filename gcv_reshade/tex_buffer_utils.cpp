@@ -4,6 +4,8 @@
  * SPDX-License-Identifier: BSD-3-Clause OR MIT
  */
 #include "tex_buffer_utils.h"
+#include "gcv_utils/xxh32_4byte_simd.h"
+#include <cstring>
 
 void unpack_r5g6b5(uint16_t data, uint8_t rgb[3])
 {
@@ -244,3 +246,24 @@ void bc5_block_copy(simple_packed_buf &dstBuf, const reshade::api::resource_desc
 		}
 	}
 }
+
+void indexed_seg_rgba32_hash_mosaic(simple_packed_buf &dstBuf, const reshade::api::resource_desc &desc, const reshade::api::subresource_data &data)
+{
+	// one pass: the 4 channels of a pixel are hashed together, and written to the 4 quadrants
+	// (same colors as XXH32(channel, 4, 0), which this used to call once per channel, in one pass per channel)
+	const size_t width = desc.texture.width;
+	const size_t height = desc.texture.height;
+	uint32_t hashes[4];
+	for (size_t y = 0; y < height; ++y) {
+		const uint32_t *const src = reinterpret_cast<const uint32_t *>(static_cast<const uint8_t *>(data.data) + y * data.row_pitch);
+		uint8_t *const top = dstBuf.rowptr<uint8_t>(y);
+		uint8_t *const bottom = dstBuf.rowptr<uint8_t>(y + height);
+		for (size_t x = 0; x < width; ++x) {
+			xxh32_of_4_bytes_x4(src + x * 4, 0u, hashes);
+			memcpy(top + x * 3, &hashes[0], 3);
+			memcpy(top + (x + width) * 3, &hashes[1], 3);
+			memcpy(bottom + x * 3, &hashes[2], 3);
+			memcpy(bottom + (x + width) * 3, &hashes[3], 3);
+		}
+	}
+}
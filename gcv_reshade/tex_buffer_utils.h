@@ -18,3 +18,6 @@ void bc1_block_copy(simple_packed_buf &dstBuf, const reshade::api::resource_desc
 void bc3_block_copy(simple_packed_buf &dstBuf, const reshade::api::resource_desc &desc, const reshade::api::subresource_data &data);
 void bc4_block_copy(simple_packed_buf &dstBuf, const reshade::api::resource_desc &desc, const reshade::api::subresource_data &data);
 void bc5_block_copy(simple_packed_buf &dstBuf, const reshade::api::resource_desc &desc, const reshade::api::subresource_data &data);
+
+// IndexedSeg debug dump of an r32g32b32a32 texture: each channel is hashed to a color, channels laid out as a 2x2 mosaic (dstBuf is 2x wide and tall)
+void indexed_seg_rgba32_hash_mosaic(simple_packed_buf &dstBuf, const reshade::api::resource_desc &desc, const reshade::api::subresource_data &data);
@@ -0,0 +1,82 @@
+#pragma once
+// Copyright (C) 2023 Jason Bunk
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+* Threads kept alive between frames, for per-frame work split into bands (e.g. rows of the live segmentation view):
+* run() hands out the bands to the pool's threads and the calling thread, and returns when every band is done.
+* Between calls the threads sleep on a condition variable, so an idle pool costs nothing, and no thread is created per frame.
+*/
+class band_worker_pool {
+	std::vector<std::thread> threads;
+	std::mutex mut;
+	std::condition_variable cv_work;
+	std::condition_variable cv_done;
+	const std::function<void(uint32_t)>* job = nullptr;
+	uint32_t job_num_bands = 0u;
+	uint64_t job_generation = 0ull;
+	uint32_t num_busy = 0u;
+	bool stopping = false;
+	std::atomic<uint32_t> next_band = { 0u };
+
+	void take_bands(const std::function<void(uint32_t)>& fn, uint32_t num_bands) {
+		for (uint32_t band = next_band.fetch_add(1u); band < num_bands; band = next_band.fetch_add(1u)) fn(band);
+	}
+	void worker_loop() {
+		uint64_t seen_generation = 0ull;
+		for (;;) {
+			const std::function<void(uint32_t)>* fn = nullptr;
+			uint32_t num_bands = 0u;
+			{
+				std::unique_lock<std::mutex> lock(mut);
+				cv_work.wait(lock, [&] { return stopping || job_generation != seen_generation; });
+				if (stopping) return;
+				seen_generation = job_generation;
+				fn = job;
+				num_bands = job_num_bands;
+			}
+			take_bands(*fn, num_bands);
+			std::lock_guard<std::mutex> lock(mut);
+			if (--num_busy == 0u) cv_done.notify_one();
+		}
+	}
+
+public:
+	// the calling thread of run() also works, so this is one less than the total parallelism
+	explicit band_worker_pool(uint32_t num_extra_threads) {
+		for (uint32_t tt = 0; tt < num_extra_threads; ++tt) threads.emplace_back(&band_worker_pool::worker_loop, this);
+	}
+	~band_worker_pool() {
+		{
+			std::lock_guard<std::mutex> lock(mut);
+			stopping = true;
+		}
+		cv_work.notify_all();
+		for (std::thread& thr : threads) thr.join();
+	}
+	band_worker_pool(const band_worker_pool&) = delete;
+	band_worker_pool& operator=(const band_worker_pool&) = delete;
+
+	// calls fn(band) once for each band in [0, num_bands); not reentrant
+	void run(uint32_t num_bands, const std::function<void(uint32_t)>& fn) {
+		{
+			std::lock_guard<std::mutex> lock(mut);
+			job = &fn;
+			job_num_bands = num_bands;
+			next_band.store(0u);
+			num_busy = static_cast<uint32_t>(threads.size());
+			++job_generation;
+		}
+		cv_work.notify_all();
+		take_bands(fn, num_bands);
+		std::unique_lock<std::mutex> lock(mut);
+		cv_done.wait(lock, [&] { return num_busy == 0u; });
+		job = nullptr;
+	}
+};
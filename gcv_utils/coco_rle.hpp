@@ -0,0 +1,159 @@
+#pragma once
+// Copyright (C) 2023 Jason Bunk
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define GCV_COCO_RLE_SSE2 1
+#endif
+
+/*
+* Run-length encoded masks in the COCO format, for every segment (pixels sharing a key, like a color) of an image, in one pass.
+* COCO RLE is column-major: counts alternate between runs of 0s and 1s, starting with 0s, scanning down each column.
+* Images are row-major, so the image is encoded in strips of a few columns: each strip is transposed into a column-major buffer
+* (read in tiles of a few rows, so every cache line read is used), then that buffer is scanned front to back,
+* comparing 4 keys at a time against the current run's key. A run may continue from the bottom of one column into the next.
+* Has no dependencies, so that it can be reused outside of the addon; python_threedee/load_coco_rle.py decodes the output.
+*/
+struct coco_rle_segment {
+	uint32_t key = 0;
+	uint64_t area = 0;
+	uint32_t xmin = 0, ymin = 0, xmax = 0, ymax = 0; // inclusive
+	uint64_t next_pos = 0; // column-major index just past this segment's last run
+	std::vector<uint32_t> counts;
+};
+
+namespace coco_rle {
+constexpr uint32_t strip_cols = 32; // a strip of a 1080 row image is 135 KB, and fits in L2
+
+// dst[cc * dststride + rr] = src[rr * strip_cols + cc], in 4x4 blocks where possible
+inline void transpose_tile(const uint32_t* src, uint32_t nrows, uint32_t ncols, uint32_t* dst, uint64_t dststride) {
+	uint32_t rr4 = 0;
+#if GCV_COCO_RLE_SSE2
+	for (; rr4 + 4u <= nrows; rr4 += 4u) {
+		uint32_t cc4 = 0;
+		for (; cc4 + 4u <= ncols; cc4 += 4u) {
+			const uint32_t* s = src + rr4 * strip_cols + cc4;
+			const __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+			const __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + strip_cols));
+			const __m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 2u * strip_cols));
+			const __m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 3u * strip_cols));
+			const __m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpacklo_epi32(r2, r3);
+			const __m128i t2 = _mm_unpackhi_epi32(r0, r1), t3 = _mm_unpackhi_epi32(r2, r3);
+			uint32_t* d = dst + cc4 * dststride + rr4;
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(d), _mm_unpacklo_epi64(t0, t1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(d + dststride), _mm_unpackhi_epi64(t0, t1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(d + 2u * dststride), _mm_unpacklo_epi64(t2, t3));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(d + 3u * dststride), _mm_unpackhi_epi64(t2, t3));
+		}
+		for (; cc4 < ncols; ++cc4)
+			for (uint32_t rr = rr4; rr < rr4 + 4u; ++rr) dst[cc4 * dststride + rr] = src[rr * strip_cols + cc4];
+	}
+#endif
+	for (uint32_t cc = 0; cc < ncols; ++cc)
+		for (uint32_t rr = rr4; rr < nrows; ++rr) dst[cc * dststride + rr] = src[rr * strip_cols + cc];
+}
+
+// the index just past the run of keys equal to keys[pos]
+inline uint64_t run_end(const uint32_t* keys, uint64_t pos, uint64_t num) {
+	const uint32_t key = keys[pos];
+	uint64_t ii = pos + 1ull;
+#if GCV_COCO_RLE_SSE2
+	const __m128i vkey = _mm_set1_epi32(static_cast<int>(key));
+	for (; ii + 4ull <= num; ii += 4ull) {
+		const __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + ii)), vkey);
+		const int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+		if (mask != 0xF) {
+			const int differs = ~mask & 0xF;
+			return ii + ((differs & 1) ? 0u : (differs & 2) ? 1u : (differs & 4) ? 2u : 3u);
+		}
+	}
+#endif
+	while (ii < num && keys[ii] == key) ++ii;
+	return ii;
+}
+}
+
+// keys_of_span(y, x0, n, keys) writes the segment keys of pixels x0 ... x0+n-1 of row y to keys;
+// segments are returned sorted by key, each with counts summing to width*height
+template<typename SpanKeysFn>
+void coco_rle_encode_segments(uint32_t width, uint32_t height, const SpanKeysFn& keys_of_span, std::vector<coco_rle_segment>& segments) {
+	segments.clear();
+	const uint64_t num_pixels = static_cast<uint64_t>(width) * height;
+	if (num_pixels == 0ull) return;
+	constexpr uint32_t tile = coco_rle::strip_cols;
+	std::unordered_map<uint32_t, size_t> key2seg;
+	std::vector<uint32_t> colmajor(static_cast<size_t>(tile) * height);
+	uint32_t rowtile[tile * tile];
+	for (uint32_t x0 = 0; x0 < width; x0 += tile) {
+		const uint32_t ncols = std::min(tile, width - x0);
+		// 1: transpose the strip, a tile of rows at a time
+		for (uint32_t y0 = 0; y0 < height; y0 += tile) {
+			const uint32_t nrows = std::min(tile, height - y0);
+			for (uint32_t rr = 0; rr < nrows; ++rr) keys_of_span(y0 + rr, x0, ncols, rowtile + rr * tile);
+			coco_rle::transpose_tile(rowtile, nrows, ncols, colmajor.data() + y0, height);
+		}
+		// 2: runs of equal keys, with one lookup per run
+		const uint64_t stripstart = static_cast<uint64_t>(x0) * height;
+		const uint64_t stripsize = static_cast<uint64_t>(ncols) * height;
+		for (uint64_t ii = 0; ii < stripsize; ) {
+			const uint32_t key = colmajor[ii];
+			const uint64_t iiend = coco_rle::run_end(colmajor.data(), ii, stripsize);
+			const uint64_t runstart = stripstart + ii, runend = stripstart + iiend;
+			const uint32_t rx0 = static_cast<uint32_t>(runstart / height), ry0 = static_cast<uint32_t>(runstart % height);
+			const uint32_t rx1 = static_cast<uint32_t>((runend - 1ull) / height), ry1 = static_cast<uint32_t>((runend - 1ull) % height);
+			// a run continuing into later columns reaches the bottom of its first column and the top of the next
+			const uint32_t ymin = (rx1 > rx0) ? 0u : ry0;
+			const uint32_t ymax = (rx1 > rx0) ? height - 1u : ry1;
+			auto found = key2seg.find(key);
+			if (found == key2seg.end()) {
+				found = key2seg.emplace(key, segments.size()).first;
+				segments.emplace_back();
+				coco_rle_segment& newseg = segments.back();
+				newseg.key = key;
+				newseg.xmin = rx0;
+				newseg.ymin = ymin;
+				newseg.ymax = ymax;
+			}
+			coco_rle_segment& seg = segments[found->second];
+			if (seg.next_pos == runstart && !seg.counts.empty()) {
+				seg.counts.back() += static_cast<uint32_t>(runend - runstart); // continues a run from the end of the previous strip
+			} else {
+				seg.counts.push_back(static_cast<uint32_t>(runstart - seg.next_pos));
+				seg.counts.push_back(static_cast<uint32_t>(runend - runstart));
+			}
+			seg.next_pos = runend;
+			seg.area += runend - runstart;
+			seg.xmax = rx1;
+			seg.ymin = std::min(seg.ymin, ymin);
+			seg.ymax = std::max(seg.ymax, ymax);
+			ii = iiend;
+		}
+	}
+	for (coco_rle_segment& seg : segments) {
+		if (seg.next_pos < num_pixels) seg.counts.push_back(static_cast<uint32_t>(num_pixels - seg.next_pos));
+	}
+	std::sort(segments.begin(), segments.end(), [](const coco_rle_segment& a, const coco_rle_segment& b) { return a.key < b.key; });
+}
+
+// the compressed string form of the counts, as written by pycocotools (rleToString in maskApi.c)
+inline std::string coco_rle_counts_to_string(const std::vector<uint32_t>& counts) {
+	std::string str;
+	str.reserve(counts.size() * 2);
+	for (size_t ii = 0; ii < counts.size(); ++ii) {
+		int64_t val = counts[ii];
+		if (ii > 2) val -= static_cast<int64_t>(counts[ii - 2]);
+		bool more = true;
+		while (more) {
+			char ch = static_cast<char>(val & 0x1f);
+			val >>= 5;
+			more = (ch & 0x10) ? (val != -1) : (val != 0);
+			if (more) ch |= 0x20;
+			str.push_back(static_cast<char>(ch + 48));
+		}
+	}
+	return str;
+}
@@ -0,0 +1,98 @@
+#pragma once
+// Copyright (C) 2023 Jason Bunk
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+#include <intrin.h>
+
+/*
+* The draw hooks run on every draw of every frame, but most of the time nobody is capturing, looking at the overlay,
+* or watching the live segmentation view. Each hook first checks its feature's bit of this mask (one load) and returns
+* right away if the feature is idle. The mask is recomputed once per frame, at the end of effects, from the current modes.
+*/
+enum HookFeature : uint32_t {
+	HookFeature_RenderTargetStats = 0, // count draws per render target, to suggest which ones to segment
+	HookFeature_SegmentationDraws, // redirect draws to also write the segmentation buffer
+	HookFeature_DrawTrace, // record every draw into the trace file
+	HookFeature_count,
+};
+constexpr uint32_t hook_activity_bit(HookFeature feature) { return 1u << feature; }
+
+inline std::atomic<uint32_t> hook_activity_mask = { 0u };
+
+inline uint32_t hook_activity_bits() {
+	return hook_activity_mask.load(std::memory_order_acquire);
+}
+inline bool hook_activity_enabled(HookFeature feature) {
+	return (hook_activity_bits() & hook_activity_bit(feature)) != 0u;
+}
+// sets the bits of the given features to those of activity, leaving the others; only called from the present thread.
+// the state that newly enabled hooks read (textures, clicked render targets) must be written before publishing
+inline void hook_activity_publish(uint32_t activity, uint32_t features) {
+	const uint32_t old = hook_activity_mask.load(std::memory_order_relaxed);
+	hook_activity_mask.store((old & ~features) | (activity & features), std::memory_order_release);
+}
+
+/*
+* Measures the cost of the hooks, in CPU timestamp counter ticks per call, separately for calls made while idle and while active.
+* Only one in every sample_every calls (per thread) is timed, so that the idle path stays cheap.
+*/
+struct hook_cost_meter {
+	static constexpr uint32_t sample_every = 64;
+	std::atomic<uint64_t> ticks_idle = { 0ull };
+	std::atomic<uint64_t> samples_idle = { 0ull };
+	std::atomic<uint64_t> ticks_active = { 0ull };
+	std::atomic<uint64_t> samples_active = { 0ull };
+
+	inline void record(bool active, uint64_t ticks) {
+		(active ? ticks_active : ticks_idle).fetch_add(ticks, std::memory_order_relaxed);
+		(active ? samples_active : samples_idle).fetch_add(1ull, std::memory_order_relaxed);
+	}
+	// average ticks per call, minus the cost of reading the timestamp counter twice; negative if nothing was sampled
+	inline double average_ticks(bool active, uint64_t timer_overhead_ticks) const {
+		const uint64_t nn = (active ? samples_active : samples_idle).load(std::memory_order_relaxed);
+		if (nn == 0ull) return -1.0;
+		const double avg = static_cast<double>((active ? ticks_active : ticks_idle).load(std::memory_order_relaxed)) / static_cast<double>(nn);
+		return std::max(0.0, avg - static_cast<double>(timer_overhead_ticks));
+	}
+	inline void reset() {
+		ticks_idle = 0ull;
+		samples_idle = 0ull;
+		ticks_active = 0ull;
+		samples_active = 0ull;
+	}
+};
+inline hook_cost_meter hook_cost_meters[HookFeature_count];
+
+// cheapest of many back-to-back reads, measured once
+inline uint64_t hook_cost_timer_overhead_ticks() {
+	static const uint64_t overhead = []() {
+		uint64_t best = ~0ull;
+		for (int ii = 0; ii < 256; ++ii) {
+			const uint64_t t0 = __rdtsc();
+			best = std::min<uint64_t>(best, __rdtsc() - t0);
+		}
+		return best;
+	}();
+	return overhead;
+}
+
+// put one on the stack around a hook call: times the call if it is this thread's turn to sample
+class hook_cost_sample {
+	HookFeature feature;
+	bool active = false;
+	uint64_t t0 = 0ull;
+public:
+	inline explicit hook_cost_sample(HookFeature feature_) : feature(feature_) {
+		static thread_local uint32_t counters[HookFeature_count] = {};
+		if (++counters[feature] % hook_cost_meter::sample_every == 0u) {
+			active = hook_activity_enabled(feature);
+			t0 = __rdtsc();
+		}
+	}
+	inline ~hook_cost_sample() {
+		if (t0 != 0ull) hook_cost_meters[feature].record(active, __rdtsc() - t0);
+	}
+	hook_cost_sample(const hook_cost_sample&) = delete;
+	hook_cost_sample& operator=(const hook_cost_sample&) = delete;
+};
@@ -1,6 +1,9 @@
 // Copyright (C) 2022 Jason Bunk
 #include "gcv_utils/image_queue_entry.h"
+#include "gcv_utils/coco_rle.hpp"
 #include <cnpy.h>
+#include <nlohmann/json.hpp>
+#include <fstream>
 #include <fpzip/fpzip.h>
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -9,6 +12,7 @@
 #include <cmath>
 #include <algorithm>
 #include <queue>
+#include <cstring>
 
 #define RobustNth 50
 
@@ -70,6 +74,8 @@ bool save_packedbuf_as_8bit_png_image(const std::string &filepath,
 		if (!pack_32bitgray_into_8bitrgb<float>(srcBuf, dstBuf)) return false;
 	} else if(srcBuf.pixfmt == BUF_PIX_FMT_GRAYU32) {
 		if (!pack_32bitgray_into_8bitrgb<uint32_t>(srcBuf, dstBuf)) return false;
+	} else if(srcBuf.pixfmt == BUF_PIX_FMT_GRAYU16) {
+		if (!pack_32bitgray_into_8bitrgb<uint16_t>(srcBuf, dstBuf)) return false;
 	} else {
 		errstr += std::string("save_8bitpng: unrecognized buf format ") + std::to_string(srcBuf.pixfmt);
 		return false;
@@ -110,6 +116,62 @@ bool save_packedbuf_f32_using_fpzip(const std::string &filepath,
 	return true;
 }
 
+// segments are the distinct colors of RGB images (key r + 256*g + 65536*b, as in the colormaps), or the distinct values of integer images
+bool save_packedbuf_segments_as_coco_rle_json(const std::string &filepath,
+	const simple_packed_buf &srcBuf, std::string &errstr)
+{
+	const uint32_t width = static_cast<uint32_t>(srcBuf.width);
+	const uint32_t height = static_cast<uint32_t>(srcBuf.height);
+	std::vector<coco_rle_segment> segments;
+	switch (srcBuf.pixfmt) {
+	case BUF_PIX_FMT_RGB24: case BUF_PIX_FMT_RGBA: {
+		const size_t bpp = srcBuf.bytes_per_pixel();
+		coco_rle_encode_segments(width, height, [&srcBuf, bpp](uint32_t y, uint32_t x0, uint32_t n, uint32_t* keys) {
+			const uint8_t* px = srcBuf.crowptr<uint8_t>(y) + x0 * bpp;
+			for (uint32_t xx = 0; xx < n; ++xx, px += bpp) {
+				keys[xx] = static_cast<uint32_t>(px[0]) | (static_cast<uint32_t>(px[1]) << 8) | (static_cast<uint32_t>(px[2]) << 16);
+			}
+		}, segments);
+		break;
+	}
+	case BUF_PIX_FMT_GRAYU32:
+		coco_rle_encode_segments(width, height, [&srcBuf](uint32_t y, uint32_t x0, uint32_t n, uint32_t* keys) {
+			memcpy(keys, srcBuf.crowptr<uint32_t>(y) + x0, n * sizeof(uint32_t));
+		}, segments);
+		break;
+	case BUF_PIX_FMT_GRAYU16:
+		coco_rle_encode_segments(width, height, [&srcBuf](uint32_t y, uint32_t x0, uint32_t n, uint32_t* keys) {
+			const uint16_t* px = srcBuf.crowptr<uint16_t>(y) + x0;
+			for (uint32_t xx = 0; xx < n; ++xx) keys[xx] = static_cast<uint32_t>(px[xx]);
+		}, segments);
+		break;
+	default:
+		errstr += std::string("cocorle: only writes color or integer images; refusing ")
+			+ filepath + std::string(" of type ") + std::to_string(srcBuf.pixfmt);
+		return false;
+	}
+	nlohmann::json outjson;
+	outjson["width"] = width;
+	outjson["height"] = height;
+	outjson["key"] = (srcBuf.pixfmt == BUF_PIX_FMT_RGB24 || srcBuf.pixfmt == BUF_PIX_FMT_RGBA) ? "color" : "value";
+	nlohmann::json& jsegs = outjson["segments"] = nlohmann::json::array();
+	for (const coco_rle_segment& seg : segments) {
+		nlohmann::json jseg;
+		jseg["key"] = seg.key;
+		jseg["area"] = seg.area;
+		jseg["bbox"] = { seg.xmin, seg.ymin, seg.xmax + 1u - seg.xmin, seg.ymax + 1u - seg.ymin };
+		jseg["segmentation"] = { {"size", {height, width}}, {"counts", coco_rle_counts_to_string(seg.counts)} };
+		jsegs.push_back(std::move(jseg));
+	}
+	std::ofstream outfile(filepath);
+	if (!outfile.is_open()) {
+		errstr += std::string("cocorle: failed to open file ") + filepath;
+		return false;
+	}
+	outfile << outjson.dump() << std::endl;
+	return static_cast<bool>(outfile);
+}
+
 bool queue_item_image2write::write_to_disk(std::string &errstr) const {
 	if (writers == ImageWriter_none || writers >= ImageWriter_end) return false;
 	bool allgood = true;
@@ -128,6 +190,11 @@ bool queue_item_image2write::write_to_disk(std::string &errstr) const {
 				mybuf.cdata<uint32_t>(), { static_cast<size_t>(mybuf.height), static_cast<size_t>(mybuf.width) });
 			break;
 		}
+		case BUF_PIX_FMT_GRAYU16: {
+			cnpy::npy_save<uint16_t>(filepath_noexten + std::string(".npy"),
+				mybuf.cdata<uint16_t>(), { static_cast<size_t>(mybuf.height), static_cast<size_t>(mybuf.width) });
+			break;
+		}
 		case BUF_PIX_FMT_GRAYF32: {
 			cnpy::npy_save<float>(filepath_noexten + std::string(".npy"),
 				mybuf.cdata<float>(), { static_cast<size_t>(mybuf.height), static_cast<size_t>(mybuf.width) });
@@ -136,6 +203,20 @@ bool queue_item_image2write::write_to_disk(std::string &errstr) const {
 		default: allgood = false;
 		}
 	}
+	if (writers & ImageWriter_rawbin) {
+		FILE* file = fopen((filepath_noexten + std::string(".bin")).c_str(), "wb");
+		if (file) {
+			allgood &= fwrite(mybuf.bytes.data(), 1, mybuf.bytes.size(), file) == mybuf.bytes.size();
+			fclose(file);
+		} else {
+			errstr += std::string("rawbin: failed to open file ") + filepath_noexten;
+			allgood = false;
+		}
+	}
+	if (writers & ImageWriter_cocorle) {
+		allgood &= save_packedbuf_segments_as_coco_rle_json(filepath_noexten + std::string("_cocorle.json"),
+			mybuf, errstr);
+	}
 	if (writers & ImageWriter_fpzip) {
 		allgood &= save_packedbuf_f32_using_fpzip(filepath_noexten + std::string(".fpzip"),
 			mybuf, errstr);
@@ -8,7 +8,9 @@ enum ImageWriterType {
 	ImageWriter_STB_png = (1 << 0),
 	ImageWriter_numpy   = (1 << 1),
 	ImageWriter_fpzip   = (1 << 2),
-	ImageWriter_end     = (1 << 3),
+	ImageWriter_rawbin  = (1 << 3), // writes the bytes as-is (not an image), as .bin
+	ImageWriter_cocorle = (1 << 4), // COCO run-length encoded mask of each color (or value) in the image, as _cocorle.json
+	ImageWriter_end     = (1 << 5),
 };
 
 struct queue_item_image2write {
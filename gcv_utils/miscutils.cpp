@@ -1,6 +1,12 @@
 // Copyright (C) 2022 Jason Bunk
 #include "gcv_utils/miscutils.h"
 #include "gcv_utils/geometry.h"
+#include "gcv_utils/xxh32_4byte_simd.h"
+#include "xxhash.h"
+#include "segmentation/colormap_util.hpp"
+#include "render_target_stats/flat_handle_map.hpp"
+#include "gcv_utils/trigger_search_simd.h"
+#include "gcv_utils/module_signature_scan.h"
 #include <locale>
 #include <codecvt>
 #include <algorithm>
@@ -84,6 +90,132 @@ std::string run_utils_tests() {
 	if (std::string().length() > 0) RETURNFAILST("A: empty string not empty!?");
 	if (std::string("").length() > 0) RETURNFAILST("B: empty string not empty!?");
 	if (basename_from_filepath("/hello/x").compare("x")) RETURNFAILST("basename_from_filepath");
+
+	{
+		// the unrolled and SIMD 4-byte hashes must give the same colors as XXH32
+		uint32_t hin[4] = { 0u, 1u, 0x7FFFFFFFu, 0xFFFFFFFFu }, hout[4];
+		for (uint32_t seed = 0; seed < 3; ++seed) {
+			for (uint32_t ii = 0; ii < 64; ++ii, hin[ii & 3u] = hin[ii & 3u] * 2654435761u + ii) {
+				xxh32_of_4_bytes_x4(hin, seed, hout);
+				for (int ch = 0; ch < 4; ++ch) {
+					if (hout[ch] != XXH32(&hin[ch], 4, seed) || xxh32_of_4_bytes(hin[ch], seed) != hout[ch])
+						RETURNFAILST("xxh32_of_4_bytes_x4 of ") + std::to_string(hin[ch]);
+				}
+			}
+		}
+	}
+	for (uint32_t ii = 0; ii < (1u << 24); ii += 997u) {
+		const std::array<uint8_t, 3> rgb = morton_halton_curve_rgb_3d(ii);
+		if (morton_halton_curve_rgb_3d_packed(ii) != (rgb[0] | (rgb[1] << 8) | (rgb[2] << 16))) RETURNFAILST("morton_halton_curve_rgb_3d_packed of ") + std::to_string(ii);
+	}
+	{
+		// erasing from the middle of probe chains must not lose the entries after them
+		flat_handle_map<uint64_t> fmap;
+		for (uint64_t hh = 1; hh <= 300; ++hh) fmap[hh * 16ull] = hh;
+		for (uint64_t hh = 2; hh <= 300; hh += 2) fmap.erase(hh * 16ull);
+		for (uint64_t hh = 1; hh <= 300; ++hh) {
+			const uint64_t* found = fmap.find(hh * 16ull);
+			if ((found != nullptr) != ((hh & 1ull) != 0ull) || (found != nullptr && *found != hh)) RETURNFAILST("flat_handle_map erase ") + std::to_string(hh);
+		}
+		if (fmap.size() != 150) RETURNFAILST("flat_handle_map size");
+	}
+	{
+		// the vectorized trigger search must accept the same offsets as checking every candidate, including in the scalar tail
+		constexpr uint64_t magic = 4429373075689993337ull;
+		std::vector<uint8_t> buf(301 + 8, 0x79u); // 0x79 is the magic's first byte, so partial matches are everywhere
+		for (uint64_t pp = 0; pp < 12; ++pp) memcpy(buf.data() + (pp * pp * 7u + pp) % 301u, &magic, sizeof(magic));
+		for (uint64_t llast = 0; llast < 301; llast += 7) {
+			for (uint32_t accept = 0; accept < 4; ++accept) {
+				uint32_t seen1 = 0, seen4 = 0;
+				const uint64_t simd1 = find_u64_pattern<1>(buf.data(), llast, magic, [&](uint64_t) { return seen1++ == accept; });
+				const uint64_t simd4 = find_u64_pattern<4>(buf.data(), llast, magic, [&](uint64_t) { return seen4++ == accept; });
+				seen1 = seen4 = 0;
+				if (simd1 != trigger_search::find_scalar<1>(buf.data(), 0, llast, magic, [&](uint64_t) { return seen1++ == accept; })) RETURNFAILST("find_u64_pattern<1> up to ") + std::to_string(llast);
+				if (simd4 != trigger_search::find_scalar<4>(buf.data(), 0, llast, magic, [&](uint64_t) { return seen4++ == accept; })) RETURNFAILST("find_u64_pattern<4> up to ") + std::to_string(llast);
+			}
+		}
+	}
+	{
+		// the multi-pattern search must make the same calls as checking every pattern at every candidate, with few (vectorized) and many patterns
+		std::vector<uint64_t> patterns;
+		for (uint64_t pp = 0; pp < 12; ++pp) patterns.push_back(0x0123456789ABCDEFull * (pp / 2 + 1) + ((pp & 1ull) << 40)); // pairs share their first 4 bytes
+		std::vector<uint8_t> buf(501 + 8, 0xEFu);
+		for (uint64_t pp = 0; pp < 40; ++pp) memcpy(buf.data() + (pp * pp * 13u + pp * 5u) % 501u, &patterns[pp % patterns.size()], sizeof(uint64_t));
+		for (size_t npat : { size_t(1), size_t(3), size_t(8), size_t(12) }) {
+			const multi_trigger_table table(std::vector<uint64_t>(patterns.begin(), patterns.begin() + npat));
+			for (uint64_t llast : { 0ull, 37ull, 250ull, 500ull }) {
+				for (uint32_t step : { 1u, 4u }) {
+					std::vector<std::pair<uint64_t, size_t>> calls, expected;
+					uint32_t ncalls = 0;
+					auto onmatch = [&](uint64_t ii, size_t pp) { calls.push_back({ ii, pp }); return (ncalls++ % 3u) == 2u; };
+					const uint64_t allmask = (1ull << npat) - 1ull;
+					const uint64_t left = (step == 1) ? table.find_each<1>(buf.data(), llast, allmask, onmatch) : table.find_each<4>(buf.data(), llast, allmask, onmatch);
+					uint64_t wantmask = allmask;
+					ncalls = 0;
+					for (uint64_t ii = 0; ii <= llast && wantmask != 0ull; ii += step) {
+						for (size_t pp = 0; pp < npat; ++pp) {
+							if ((wantmask & (1ull << pp)) == 0ull || memcmp(buf.data() + ii, &patterns[pp], sizeof(uint64_t)) != 0) continue;
+							expected.push_back({ ii, pp });
+							if ((ncalls++ % 3u) == 2u) wantmask &= ~(1ull << pp);
+						}
+					}
+					if (calls != expected || left != wantmask) RETURNFAILST("multi_trigger_table with patterns ") + std::to_string(npat) + std::string(" step ") + std::to_string(step) + std::string(" up to ") + std::to_string(llast);
+				}
+			}
+		}
+	}
+	{
+		// a minimal 64-bit PE file: .text refers to a global in .data with a RIP-relative mov, after a decoy that differs in its last byte
+		std::vector<uint8_t> pefile(0x800, 0u);
+		auto put16 = [&](size_t at, uint32_t val) { pefile[at] = val & 0xFFu; pefile[at + 1] = (val >> 8) & 0xFFu; };
+		auto put32 = [&](size_t at, uint32_t val) { put16(at, val & 0xFFFFu); put16(at + 2, val >> 16); };
+		pefile[0] = 'M'; pefile[1] = 'Z'; put32(0x3C, 0x80); memcpy(pefile.data() + 0x80, "PE\0\0", 4);
+		put16(0x84, 0x8664); put16(0x86, 2); put16(0x94, 240); // machine, sections, optional header size
+		put16(0x98, 0x20B); put32(0x98 + 56, 0x3000); put32(0x98 + 60, 0x400); // PE32+, size of image, size of headers
+		const size_t sh = 0x98 + 240;
+		memcpy(pefile.data() + sh, ".text", 5); put32(sh + 8, 0x200); put32(sh + 12, 0x1000); put32(sh + 16, 0x200); put32(sh + 20, 0x400);
+		memcpy(pefile.data() + sh + 40, ".data", 5); put32(sh + 48, 0x300); put32(sh + 52, 0x2000); put32(sh + 56, 0x100); put32(sh + 60, 0x600);
+		std::fill(pefile.begin() + 0x400, pefile.begin() + 0x600, 0xCCu);
+		const uint8_t movrax[] = { 0x48, 0x8B, 0x05, 0, 0, 0, 0, 0x0F, 0x28, 0x40, 0x10 };
+		memcpy(pefile.data() + 0x410, movrax, sizeof(movrax)); pefile[0x410 + 10] = 0x11;
+		memcpy(pefile.data() + 0x440, movrax, sizeof(movrax)); put32(0x440 + 3, 0x2030u - (0x1040u + 7u));
+		std::vector<uint8_t> image;
+		pe_headers headers;
+		std::string errstr;
+		if (!load_pe_file_as_image(pefile, image, headers, errstr)) RETURNFAILST("load_pe_file_as_image: ") + errstr;
+		if (!headers.is_64bit || image.size() != 0x3000 || headers.sections.size() != 2 || headers.find_section(".data") == nullptr
+			|| headers.find_section(".data")->rva != 0x2000 || image[0x1040] != 0x48) RETURNFAILST("parse_pe_headers");
+		module_signature sig;
+		sig.pattern = "48 8B 05 ?? ?? ?? ?? 0F 28 40 10";
+		sig.rip_disp_offset = 3; sig.rip_instr_end = 7; sig.result_adjust = 8;
+		if (find_module_signature_rva(image.data(), image.size(), headers, sig, errstr) != 0x2038) RETURNFAILST("find_module_signature_rva ") + errstr;
+		module_signature madesig;
+		if (!make_rip_reference_signature(image.data(), image.size(), headers, 0x2030, madesig, errstr)
+			|| find_module_signature_rva(image.data(), image.size(), headers, madesig, errstr) != 0x2030) RETURNFAILST("make_rip_reference_signature ") + errstr;
+		byte_signature badsig;
+		if (badsig.parse("48 8B 5", errstr) || badsig.parse("?? ??", errstr)) RETURNFAILST("byte_signature::parse accepted a bad signature");
+		// Boyer-Moore-Horspool must find the same first matches as checking every offset, wherever the wildcards are
+		uint32_t lcg = 12345u;
+		auto nextrand = [&]() { lcg = lcg * 1664525u + 1013904223u; return lcg >> 8; };
+		std::vector<uint8_t> buf(700);
+		for (uint8_t& bb : buf) bb = static_cast<uint8_t>(nextrand() % 6u); // few distinct bytes, so partial matches are everywhere
+		for (uint32_t tt = 0; tt < 300; ++tt) {
+			byte_signature bsig;
+			const size_t len = 1 + nextrand() % 9u, from = nextrand() % (buf.size() - len);
+			for (size_t ii = 0; ii < len; ++ii) {
+				bsig.bytes.push_back(buf[from + ii] ^ ((tt % 5u == 0u && ii + 1 == len) ? 1u : 0u));
+				bsig.known.push_back((nextrand() % 3u) != 0u);
+			}
+			const uint64_t start = nextrand() % 400u;
+			uint64_t expected = signature_notfound;
+			for (uint64_t pos = start; pos + len <= buf.size() && expected == signature_notfound; ++pos) {
+				size_t ii = 0;
+				while (ii < len && (!bsig.known[ii] || buf[pos + ii] == bsig.bytes[ii])) ++ii;
+				if (ii == len) expected = pos;
+			}
+			if (find_byte_signature(buf.data(), buf.size(), bsig, start) != expected) RETURNFAILST("find_byte_signature ") + bsig.to_string() + std::string(" from ") + std::to_string(start);
+		}
+	}
 	
 	{const Vec3 testcross = Vec3( 5, 3, 2).cross(Vec3( 11, 7, 13)); CHECKVECNEAR("Vec3::cross test1", testcross, 25.0,-43.0, 2.0)}
 	{const Vec3 testcross = Vec3(-5, 3,-2).cross(Vec3( 11,-7, 13)); CHECKVECNEAR("Vec3::cross test2", testcross, 25.0, 43.0, 2.0)}
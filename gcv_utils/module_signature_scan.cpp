@@ -0,0 +1,227 @@
+// Copyright (C) 2023 Jason Bunk
+#include "module_signature_scan.h"
+#include <algorithm>
+#include <cstring>
+
+static inline uint16_t read_u16le(const uint8_t* ptr) {
+	return static_cast<uint16_t>(ptr[0] | (ptr[1] << 8));
+}
+static inline uint32_t read_u32le(const uint8_t* ptr) {
+	return static_cast<uint32_t>(ptr[0]) | (static_cast<uint32_t>(ptr[1]) << 8) | (static_cast<uint32_t>(ptr[2]) << 16) | (static_cast<uint32_t>(ptr[3]) << 24);
+}
+
+const pe_section* pe_headers::find_section(const std::string& name) const {
+	for (const pe_section& section : sections) {
+		if (section.name == name) return &section;
+	}
+	return nullptr;
+}
+
+bool parse_pe_headers(const uint8_t* buf, uint64_t nbytes, pe_headers& headers, std::string& errstr) {
+	headers = pe_headers();
+	if (nbytes < 0x40ull || buf[0] != 'M' || buf[1] != 'Z') {
+		errstr += "no DOS header";
+		return false;
+	}
+	const uint64_t peoffset = read_u32le(buf + 0x3C);
+	if (peoffset + 24ull > nbytes || std::memcmp(buf + peoffset, "PE\0\0", 4) != 0) {
+		errstr += "no PE signature";
+		return false;
+	}
+	const uint8_t* coff = buf + peoffset + 4ull;
+	const uint32_t numsections = read_u16le(coff + 2);
+	const uint32_t optheadersize = read_u16le(coff + 16);
+	const uint64_t optoffset = peoffset + 24ull;
+	if (optheadersize < 64u || optoffset + optheadersize > nbytes) {
+		errstr += "truncated optional header";
+		return false;
+	}
+	const uint16_t optmagic = read_u16le(buf + optoffset);
+	if (optmagic != 0x10Bu && optmagic != 0x20Bu) {
+		errstr += std::string("unknown optional header magic ") + std::to_string(optmagic);
+		return false;
+	}
+	headers.is_64bit = (optmagic == 0x20Bu);
+	headers.size_of_image = read_u32le(buf + optoffset + 56ull); // same offsets in PE32 and PE32+
+	headers.size_of_headers = read_u32le(buf + optoffset + 60ull);
+	const uint64_t sectionsoffset = optoffset + optheadersize;
+	if (sectionsoffset + numsections * 40ull > nbytes) {
+		errstr += "truncated section headers";
+		return false;
+	}
+	for (uint32_t ss = 0; ss < numsections; ++ss) {
+		const uint8_t* sh = buf + sectionsoffset + ss * 40ull;
+		pe_section section;
+		section.name.assign(reinterpret_cast<const char*>(sh), strnlen(reinterpret_cast<const char*>(sh), 8));
+		section.virtual_size = read_u32le(sh + 8);
+		section.rva = read_u32le(sh + 12);
+		section.file_size = read_u32le(sh + 16);
+		section.file_offset = read_u32le(sh + 20);
+		section.characteristics = read_u32le(sh + 36);
+		headers.sections.push_back(section);
+	}
+	return true;
+}
+
+bool load_pe_file_as_image(const std::vector<uint8_t>& filebytes, std::vector<uint8_t>& image, pe_headers& headers, std::string& errstr) {
+	if (!parse_pe_headers(filebytes.data(), filebytes.size(), headers, errstr)) return false;
+	if (headers.size_of_image == 0u || headers.size_of_image > (1u << 30)) {
+		errstr += std::string("implausible image size ") + std::to_string(headers.size_of_image);
+		return false;
+	}
+	image.assign(headers.size_of_image, 0u);
+	std::memcpy(image.data(), filebytes.data(), std::min<uint64_t>({ headers.size_of_headers, filebytes.size(), image.size() }));
+	for (const pe_section& section : headers.sections) {
+		if (section.file_offset >= filebytes.size() || section.rva >= image.size()) continue;
+		uint64_t ncopy = std::min<uint64_t>(section.file_size, section.virtual_size > 0u ? section.virtual_size : section.file_size);
+		ncopy = std::min<uint64_t>({ ncopy, filebytes.size() - section.file_offset, image.size() - section.rva });
+		std::memcpy(image.data() + section.rva, filebytes.data() + section.file_offset, ncopy);
+	}
+	return true;
+}
+
+static inline int hex_digit_value(char cc) {
+	if (cc >= '0' && cc <= '9') return cc - '0';
+	if (cc >= 'a' && cc <= 'f') return cc - 'a' + 10;
+	if (cc >= 'A' && cc <= 'F') return cc - 'A' + 10;
+	return -1;
+}
+
+bool byte_signature::parse(const std::string& text, std::string& errstr) {
+	bytes.clear();
+	known.clear();
+	size_t ii = 0;
+	while (ii < text.size()) {
+		if (text[ii] == ' ') {
+			++ii;
+			continue;
+		}
+		size_t tokenend = text.find(' ', ii);
+		if (tokenend == std::string::npos) tokenend = text.size();
+		const std::string token = text.substr(ii, tokenend - ii);
+		if (token == "?" || token == "??") {
+			bytes.push_back(0u);
+			known.push_back(0u);
+		} else if (token.size() == 2 && hex_digit_value(token[0]) >= 0 && hex_digit_value(token[1]) >= 0) {
+			bytes.push_back(static_cast<uint8_t>(hex_digit_value(token[0]) * 16 + hex_digit_value(token[1])));
+			known.push_back(1u);
+		} else {
+			errstr += std::string("bad byte signature token \"") + token + std::string("\"");
+			return false;
+		}
+		ii = tokenend;
+	}
+	if (bytes.empty() || std::find(known.begin(), known.end(), 1u) == known.end()) {
+		errstr += "byte signature has no known bytes";
+		return false;
+	}
+	return true;
+}
+
+std::string byte_signature::to_string() const {
+	static const char hexdigits[] = "0123456789ABCDEF";
+	std::string text;
+	for (size_t ii = 0; ii < bytes.size(); ++ii) {
+		if (ii > 0) text += ' ';
+		if (known[ii]) {
+			text += hexdigits[bytes[ii] >> 4];
+			text += hexdigits[bytes[ii] & 15];
+		} else {
+			text += "??";
+		}
+	}
+	return text;
+}
+
+uint64_t find_byte_signature(const uint8_t* buf, uint64_t nbytes, const byte_signature& sig, uint64_t start) {
+	const uint64_t siglen = sig.size();
+	if (siglen == 0ull || nbytes < siglen || start > nbytes - siglen) return signature_notfound;
+	// a byte's shift is its distance from the last position; bytes not in the signature after its last wildcard (which matches anything) shift past that wildcard
+	uint64_t lastwildcard = 0ull; // 1 + index
+	for (uint64_t ii = 0; ii < siglen; ++ii) {
+		if (!sig.known[ii]) lastwildcard = ii + 1ull;
+	}
+	const uint64_t defaultshift = std::max<uint64_t>(1ull, siglen - lastwildcard);
+	uint64_t shifts[256];
+	std::fill(shifts, shifts + 256, defaultshift);
+	for (uint64_t ii = lastwildcard; ii + 1ull < siglen; ++ii) shifts[sig.bytes[ii]] = siglen - 1ull - ii;
+	const uint8_t* sigbytes = sig.bytes.data();
+	const uint8_t* sigknown = sig.known.data();
+	for (uint64_t pos = start; pos <= nbytes - siglen; ) {
+		const uint8_t lastbyte = buf[pos + siglen - 1ull];
+		if (!sigknown[siglen - 1ull] || lastbyte == sigbytes[siglen - 1ull]) {
+			uint64_t ii = 0;
+			while (ii < siglen - 1ull && (!sigknown[ii] || buf[pos + ii] == sigbytes[ii])) ++ii;
+			if (ii == siglen - 1ull) return pos;
+		}
+		pos += shifts[lastbyte];
+	}
+	return signature_notfound;
+}
+
+static const pe_section* find_section_in_image(uint64_t imagesize, const pe_headers& headers, const std::string& name, std::string& errstr) {
+	const pe_section* section = headers.find_section(name);
+	if (section == nullptr) {
+		errstr += std::string("no section ") + name;
+		return nullptr;
+	}
+	if (static_cast<uint64_t>(section->rva) + section->virtual_size > imagesize) {
+		errstr += std::string("section ") + name + std::string(" is outside the image");
+		return nullptr;
+	}
+	return section;
+}
+
+uint64_t find_module_signature_rva(const uint8_t* image, uint64_t imagesize, const pe_headers& headers, const module_signature& sig, std::string& errstr) {
+	byte_signature bytesig;
+	if (!bytesig.parse(sig.pattern, errstr)) return signature_notfound;
+	const pe_section* section = find_section_in_image(imagesize, headers, sig.section, errstr);
+	if (section == nullptr) return signature_notfound;
+	const uint64_t offset = find_byte_signature(image + section->rva, section->virtual_size, bytesig);
+	if (offset == signature_notfound) {
+		errstr += std::string("signature not found in ") + sig.section;
+		return signature_notfound;
+	}
+	const uint64_t matchrva = section->rva + offset;
+	if (sig.rip_disp_offset < 0) return matchrva + sig.result_adjust;
+	if (static_cast<uint64_t>(sig.rip_disp_offset) + 4ull > bytesig.size() || sig.rip_instr_end < sig.rip_disp_offset + 4) {
+		errstr += "RIP-relative displacement is outside the signature";
+		return signature_notfound;
+	}
+	const int32_t disp = static_cast<int32_t>(read_u32le(image + matchrva + sig.rip_disp_offset));
+	return static_cast<uint64_t>(static_cast<int64_t>(matchrva) + sig.rip_instr_end + disp + sig.result_adjust);
+}
+
+bool make_rip_reference_signature(const uint8_t* image, uint64_t imagesize, const pe_headers& headers, uint64_t target_rva, module_signature& sig, std::string& errstr) {
+	const pe_section* text = find_section_in_image(imagesize, headers, ".text", errstr);
+	if (text == nullptr) return false;
+	constexpr uint64_t opcodebytes = 3; // e.g. 48 8B 05 (mov rax,[rip+disp32]) or 0F 10 05 (movups xmm0,[rip+disp32])
+	constexpr uint64_t maxtrailing = 48;
+	const uint8_t* code = image + text->rva;
+	const uint64_t codesize = text->virtual_size;
+	for (uint64_t dd = opcodebytes; dd + 4ull <= codesize; ++dd) {
+		const int64_t disp = static_cast<int32_t>(read_u32le(code + dd));
+		if (static_cast<int64_t>(text->rva + dd + 4ull) + disp != static_cast<int64_t>(target_rva)) continue;
+		// the displacement is wildcarded (it changes whenever the layout does), then known bytes are added after it until the signature is unique
+		byte_signature bytesig;
+		for (uint64_t ii = dd - opcodebytes; ii < dd + 4ull && ii < codesize; ++ii) {
+			bytesig.bytes.push_back(code[ii]);
+			bytesig.known.push_back(ii < dd ? 1u : 0u);
+		}
+		for (uint64_t nn = 0; nn < maxtrailing && dd + 4ull + nn < codesize; ++nn) {
+			bytesig.bytes.push_back(code[dd + 4ull + nn]);
+			bytesig.known.push_back(1u);
+			if (nn < 3) continue;
+			const uint64_t first = find_byte_signature(code, codesize, bytesig);
+			if (find_byte_signature(code, codesize, bytesig, first + 1ull) == signature_notfound) {
+				sig = module_signature();
+				sig.pattern = bytesig.to_string();
+				sig.rip_disp_offset = static_cast<int32_t>(opcodebytes);
+				sig.rip_instr_end = static_cast<int32_t>(opcodebytes + 4ull);
+				return true;
+			}
+		}
+	}
+	errstr += std::string("no unique RIP-relative reference to ") + std::to_string(target_rva);
+	return false;
+}
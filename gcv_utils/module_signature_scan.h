@@ -0,0 +1,63 @@
+#pragma once
+// Copyright (C) 2023 Jason Bunk
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+* Finds code or data in a module (the game's exe or a dll) by a byte signature with wildcards, instead of by a hardcoded offset, which breaks on every game patch.
+* The module is given as its image, laid out as when loaded (each section at its RVA): either read from the game's memory, or a file laid out by load_pe_file_as_image().
+* Nothing here depends on Windows.
+*/
+constexpr uint64_t signature_notfound = ~0ull;
+
+struct pe_section {
+	std::string name;
+	uint32_t rva = 0u;
+	uint32_t virtual_size = 0u;
+	uint32_t file_offset = 0u;
+	uint32_t file_size = 0u;
+	uint32_t characteristics = 0u;
+};
+
+struct pe_headers {
+	bool is_64bit = false;
+	uint32_t size_of_image = 0u;
+	uint32_t size_of_headers = 0u;
+	std::vector<pe_section> sections;
+	const pe_section* find_section(const std::string& name) const;
+};
+
+// the DOS, COFF, optional and section headers at the start of an image (or file)
+bool parse_pe_headers(const uint8_t* buf, uint64_t nbytes, pe_headers& headers, std::string& errstr);
+// lays out a PE file as it would be loaded: headers, then each section's file data at its RVA (the rest is zeroed)
+bool load_pe_file_as_image(const std::vector<uint8_t>& filebytes, std::vector<uint8_t>& image, pe_headers& headers, std::string& errstr);
+
+// IDA style text: hex bytes separated by spaces, with "??" (or "?") for a wildcard, e.g. "48 8B 05 ?? ?? ?? ?? 0F 28 40 10"
+struct byte_signature {
+	std::vector<uint8_t> bytes;
+	std::vector<uint8_t> known; // 0 for wildcards
+	bool parse(const std::string& text, std::string& errstr);
+	std::string to_string() const;
+	size_t size() const { return bytes.size(); }
+};
+
+// the first offset, from start, where the signature matches, or signature_notfound;
+// Boyer-Moore-Horspool, whose shifts are limited by the last wildcard, so signatures should end in a few known bytes
+uint64_t find_byte_signature(const uint8_t* buf, uint64_t nbytes, const byte_signature& sig, uint64_t start = 0ull);
+
+// what to look for in a section of a module, and how to get from the match to the address of interest
+struct module_signature {
+	std::string pattern; // empty: none
+	std::string section = ".text";
+	int32_t rip_disp_offset = -1; // if >= 0: the match contains an instruction whose 32-bit RIP-relative displacement is at this offset in the match, and its target is the result
+	int32_t rip_instr_end = 0; // ... where that instruction ends (what the displacement is relative to), as an offset in the match
+	int64_t result_adjust = 0; // added to the result (e.g. the offset of a field in a global)
+};
+
+// the RVA found by the signature, or signature_notfound
+uint64_t find_module_signature_rva(const uint8_t* image, uint64_t imagesize, const pe_headers& headers, const module_signature& sig, std::string& errstr);
+
+// For writing signatures: looks in the code section for instructions referring to target_rva with a RIP-relative displacement ending them
+// (like most loads, stores and lea), and makes a signature of the first one that can be made unique in the section.
+bool make_rip_reference_signature(const uint8_t* image, uint64_t imagesize, const pe_headers& headers, uint64_t target_rva, module_signature& sig, std::string& errstr);
@@ -1,110 +1,269 @@
 // Copyright (C) 2022 Jason Bunk
 #include "scan_for_camera_matrix.h"
+#include "trigger_search_simd.h"
 #include <reshade.hpp>
-
-void AllMemScanner::reset_iterator_to_beginning() {
-	currmemloc = 0ull;
-	mbi.BaseAddress = 0ull;
-	mbi.RegionSize = 0ull;
-}
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <fstream>
+#include <filesystem>
+#include <nlohmann/json.hpp>
 
 static constexpr uint64_t sizeofscannablememory = 0x7FFFFFFFFFFFull;
 
-#define STRINGIZE_DETAIL(x) #x
-#define STRINGIZE(x) STRINGIZE_DETAIL(x)
-#define ASSERTLOGTORESHADERETURNFALSE(x) if(!(x)){reshade::log_message(reshade::log_level::error, "scan assertion error: " __FILE__ " line " STRINGIZE(__LINE__)); currmemloc = sizeofscannablememory; return false;}
-
+std::vector<AllMemScanner::mem_region> AllMemScanner::enumerate_regions() const {
+	std::vector<mem_region> regions;
+	if (hProcess == 0) return regions;
+	MEMORY_BASIC_INFORMATION mbi;
+	uint64_t currmemloc = 0ull;
+	while (currmemloc < sizeofscannablememory) {
+		// VirtualQueryEx fails when we reach (nearly) the end of the scannable memory space
+		if (!VirtualQueryEx(hProcess, (LPCVOID)(currmemloc), &mbi, sizeof(mbi))) break;
+		const uint64_t blockend = ((uint64_t)(mbi.BaseAddress)) + ((uint64_t)(mbi.RegionSize));
+		if (blockend <= currmemloc) break;
+		// skips large unused/unreadable areas of memory
+		if (mbi.State == MEM_COMMIT && (fastscan ? (mbi.Protect == PAGE_READWRITE) : (mbi.Protect != PAGE_NOACCESS))) {
+			regions.push_back({ currmemloc, blockend - currmemloc, static_cast<uint32_t>(mbi.Protect), static_cast<uint32_t>(mbi.Type) });
+		}
+		currmemloc = blockend;
+	}
+	return regions;
+}
 
 template<bool hastriggerbytes_t, bool fastscan_t>
-bool AllMemScanner::impl_iterate_next(uint64_t& foundmemloc, const uint8_t*& foundbuf, uint64_t& foundbuflen, const void* scanctx, bool (*checkpossiblebuf)(const void* ctx, const uint8_t* buf, uint64_t nbytes)) {
-	ASSERTLOGTORESHADERETURNFALSE(!databuf.empty() && bufminlen > 8 && scanbufsize >= 8);
-	SIZE_T queryregionsuccess = 0;
-	uint64_t bytestoread;
-	uint64_t bytescopiedoffset;
-	uint64_t localblockend = ((uint64_t)(mbi.BaseAddress)) + ((uint64_t)(mbi.RegionSize));
-	uint64_t ii;
-	const uint8_t* dptr;
-	uint64_t llast;
-	while (currmemloc < sizeofscannablememory) {
-		// check usability of memory region, every time we start at a block beginning (= the end of the last block)... skips large unused/unreadable areas of memory
-		if (currmemloc == localblockend) {
-			mbi.BaseAddress = 0ull;
-			mbi.RegionSize = 0ull;
-			queryregionsuccess = VirtualQueryEx(hProcess, (LPCVOID)(currmemloc), &mbi, sizeof(mbi));
-			if (!queryregionsuccess) {
-				// VirtualQueryEx fails when we reach (nearly) the end of the scannable memory space
-				currmemloc = sizeofscannablememory;
-				return false;
-			}
-			localblockend = ((uint64_t)(mbi.BaseAddress)) + ((uint64_t)(mbi.RegionSize));
-			if (!queryregionsuccess || mbi.State != MEM_COMMIT || (fastscan_t ? (mbi.Protect != PAGE_READWRITE) : (mbi.Protect == PAGE_NOACCESS))) {
-				ASSERTLOGTORESHADERETURNFALSE(currmemloc < localblockend);
-				currmemloc = localblockend;
-				continue;
-			}
+void AllMemScanner::impl_scan_regions(const std::vector<mem_region>& regions, const std::vector<scan_signature>& signatures, std::vector<signature_hit>& hits) {
+	const size_t nsigs = signatures.size();
+	uint64_t minlen = UINT64_MAX, maxlen = 0ull;
+	std::vector<uint64_t> patterns;
+	for (const scan_signature& sig : signatures) {
+		minlen = std::min(minlen, sig.minlen);
+		maxlen = std::max(maxlen, sig.minlen);
+		patterns.push_back(sig.triggerbytes);
+	}
+	// a chunk covers up to scanbufsize candidate start positions, and is read with the maxlen-1 bytes after them (buffers never straddle regions)
+	struct scan_chunk {
+		uint64_t start;
+		uint64_t ncandidates;
+		uint64_t readbytes;
+		size_t region;
+	};
+	std::vector<scan_chunk> chunks;
+	for (size_t ri = 0; ri < regions.size(); ++ri) {
+		const mem_region& region = regions[ri];
+		if (region.size < minlen) continue;
+		const uint64_t regionend = region.base + region.size;
+		const uint64_t candidatesend = regionend - minlen + 1ull;
+		for (uint64_t start = region.base; start < candidatesend; start += scanbufsize) {
+			const uint64_t ncand = std::min(scanbufsize, candidatesend - start);
+			chunks.push_back({ start, ncand, std::min<uint64_t>(ncand + maxlen - 1ull, regionend - start), ri });
 		}
-		ASSERTLOGTORESHADERETURNFALSE(currmemloc < localblockend);
-		if (mbi.RegionSize <= databuf.size()) {
-			bytestoread = localblockend - currmemloc;
-			ASSERTLOGTORESHADERETURNFALSE(bytestoread <= mbi.RegionSize);
-			if(bytestoread >= bufminlen) {
-				if (ReadProcessMemory(hProcess, (LPCVOID)(currmemloc), (LPVOID)(databuf.data()), bytestoread, nullptr)) {
-					llast = bytestoread - bufminlen;
-					dptr = databuf.data();
-					for (ii = 0; ii <= llast; ii += (fastscan_t?4:1)) {
-						if ((!hastriggerbytes_t || *reinterpret_cast<const uint64_t*>(dptr + ii) == triggerbytes) && checkpossiblebuf(scanctx, dptr + ii, bytestoread - ii)) {
-							foundmemloc = currmemloc + ii;
-							foundbuf = dptr + ii;
-							foundbuflen = llast - ii;
-							currmemloc = foundmemloc + 8ull;
-							return true;
-						}
-					}
-				}
+	}
+	if (progress != nullptr) {
+		uint64_t totalbytes = 0ull;
+		for (const scan_chunk& chunk : chunks) totalbytes += chunk.readbytes;
+		progress->bytes_total = totalbytes;
+		progress->bytes_scanned = 0ull;
+	}
+	const multi_trigger_table triggertable((hastriggerbytes_t && nsigs > 1) ? patterns : std::vector<uint64_t>());
+	std::atomic<size_t> nextchunk = { 0 };
+	// the first hit of each signature is ranked by its chunk's index, then its offset in the chunk (which is less than scanbufsize)
+	constexpr uint32_t offsetbits = 20;
+	static_assert(scanbufsize <= (1ull << offsetbits), "hit offsets must fit below the chunk index");
+	std::unique_ptr<std::atomic<uint64_t>[]> besthits(new std::atomic<uint64_t>[nsigs]);
+	for (size_t ss = 0; ss < nsigs; ++ss) besthits[ss] = UINT64_MAX;
+	auto scan_worker = [&]() {
+		std::vector<uint8_t> databuf(scanbufsize + maxlen);
+		for (size_t ci = nextchunk.fetch_add(1); ci < chunks.size(); ci = nextchunk.fetch_add(1)) {
+			const scan_chunk& chunk = chunks[ci];
+			const uint64_t chunkrank = static_cast<uint64_t>(ci) << offsetbits;
+			// chunks are claimed in order, so all the remaining ones are after the primary signature's hit too;
+			// the others are found on the way, and don't keep the scan going after it
+			if (besthits[0].load(std::memory_order_relaxed) < chunkrank) break;
+			uint64_t wantmask = 0ull;
+			for (size_t ss = 0; ss < nsigs; ++ss) {
+				if (besthits[ss].load(std::memory_order_relaxed) > chunkrank) wantmask |= (1ull << ss);
 			}
-			currmemloc = localblockend;
-		} else {
-			bytescopiedoffset = 0ull;
-			while (currmemloc < localblockend) {
-				ASSERTLOGTORESHADERETURNFALSE(bytescopiedoffset < databuf.size());
-				bytestoread = std::min(databuf.size() - bytescopiedoffset, localblockend - currmemloc);
-				if ((bytescopiedoffset + bytestoread) >= bufminlen) {
-					if(ReadProcessMemory(hProcess, (LPCVOID)(currmemloc), (LPVOID)(databuf.data() + bytescopiedoffset), bytestoread, nullptr)) {
-						llast = bytescopiedoffset + bytestoread - bufminlen;
-						dptr = databuf.data();
-						for (ii = 0; ii <= llast; ii += (fastscan_t?4:1)) {
-							if ((!hastriggerbytes_t || *reinterpret_cast<const uint64_t*>(dptr + ii) == triggerbytes) && checkpossiblebuf(scanctx, dptr + ii, bytescopiedoffset + bytestoread - ii)) {
-								foundmemloc = (currmemloc + ii) - bytescopiedoffset;
-								foundbuf = dptr + ii;
-								foundbuflen = llast - ii;
-								currmemloc = foundmemloc + 8ull;
-								return true;
-							}
-						}
-					}
-				}
-				currmemloc += bytestoread;
-				ASSERTLOGTORESHADERETURNFALSE(currmemloc <= localblockend);
-				if(currmemloc == localblockend) {
-					break;
-				}
-				if(bytestoread <= bufminlen) {
-					memmove(databuf.data(), databuf.data() + bytescopiedoffset, bytestoread);
-					bytescopiedoffset = bytestoread;
-				} else {
-					memmove(databuf.data(), databuf.data() + bytescopiedoffset + bytestoread - bufminlen, bufminlen);
-					bytescopiedoffset = bufminlen;
+			if (progress != nullptr) {
+				if (progress->cancel.load(std::memory_order_relaxed)) break;
+				progress->bytes_scanned.fetch_add(chunk.readbytes, std::memory_order_relaxed);
+			}
+			if (!ReadProcessMemory(hProcess, (LPCVOID)(chunk.start), (LPVOID)(databuf.data()), chunk.readbytes, nullptr)) continue;
+			const uint64_t llast = chunk.ncandidates - 1ull;
+			const uint8_t* dptr = databuf.data();
+			auto accept_at = [&](uint64_t ii, size_t ss) {
+				const scan_signature& sig = signatures[ss];
+				if (ii + sig.minlen > chunk.readbytes) return false; // a longer signature near the end of its region
+				if (sig.check != nullptr && !sig.check(sig.ctx, dptr + ii, chunk.readbytes - ii)) return false;
+				const uint64_t hit = chunkrank | ii;
+				uint64_t prevbest = besthits[ss].load(std::memory_order_relaxed);
+				while (hit < prevbest && !besthits[ss].compare_exchange_weak(prevbest, hit, std::memory_order_relaxed)) {}
+				return true;
+			};
+			if (!hastriggerbytes_t) {
+				for (uint64_t ii = 0; ii <= llast; ii += (fastscan_t ? 4 : 1)) {
+					if (accept_at(ii, 0)) break;
 				}
+			} else if (nsigs == 1) {
+				find_u64_pattern<(fastscan_t ? 4 : 1)>(dptr, llast, patterns[0], [&](uint64_t ii) { return accept_at(ii, 0); });
+			} else {
+				triggertable.find_each<(fastscan_t ? 4 : 1)>(dptr, llast, wantmask, accept_at);
 			}
 		}
+	};
+	const uint32_t hwthreads = std::max(1u, std::thread::hardware_concurrency());
+	const size_t nthreads = std::min<size_t>(num_threads > 0 ? num_threads : hwthreads, std::max<size_t>(1, chunks.size()));
+	std::vector<std::thread> threads;
+	for (size_t tt = 1; tt < nthreads; ++tt) threads.emplace_back(scan_worker);
+	scan_worker();
+	for (std::thread& thr : threads) thr.join();
+	hits.assign(nsigs, signature_hit());
+	const uint64_t primarychunk = besthits[0].load() >> offsetbits;
+	for (size_t ss = 0; ss < nsigs; ++ss) {
+		const uint64_t best = besthits[ss].load();
+		// chunks after the primary hit's may have been skipped, so a hit there might not be the first one
+		if (best == UINT64_MAX || (best >> offsetbits) > primarychunk) continue;
+		const scan_chunk& bestchunk = chunks[best >> offsetbits];
+		hits[ss].found = true;
+		hits[ss].address = bestchunk.start + (best & ((1ull << offsetbits) - 1ull));
+		hits[ss].region = regions[bestchunk.region];
+	}
+}
+
+size_t AllMemScanner::scan_regions_and_log(const std::vector<mem_region>& regions, const std::vector<scan_signature>& signatures, std::vector<signature_hit>& hits, bool hastriggerbytes) {
+	const auto t0 = std::chrono::steady_clock::now();
+	if (hastriggerbytes)
+		fastscan ? impl_scan_regions<true, true>(regions, signatures, hits)
+		         : impl_scan_regions<true,false>(regions, signatures, hits);
+	else
+		fastscan ? impl_scan_regions<false, true>(regions, signatures, hits)
+		         : impl_scan_regions<false,false>(regions, signatures, hits);
+	size_t nfound = 0;
+	for (const signature_hit& hit : hits) nfound += hit.found ? 1 : 0;
+	uint64_t totalbytes = 0ull;
+	for (const mem_region& region : regions) totalbytes += region.size;
+	const int64_t millis = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+	reshade::log_message(reshade::log_level::info, (std::string(fastscan ? "fast" : "slow") + std::string(" memory scan of ") + std::to_string(regions.size())
+		+ std::string(" regions (") + std::to_string(totalbytes >> 20) + std::string(" MB) took ") + std::to_string(millis) + std::string(" ms, ")
+		+ (signatures.size() == 1 ? (nfound > 0 ? std::string("found a match") : std::string("no match"))
+			: (std::string("found ") + std::to_string(nfound) + std::string(" of ") + std::to_string(signatures.size()) + std::string(" signatures")))).c_str());
+	return nfound;
+}
+
+bool AllMemScanner::find_first(const std::vector<mem_region>& regions, uint64_t& foundmemloc, const void* scanctx, bool (*checkpossiblebuf)(const void* ctx, const uint8_t* buf, uint64_t nbytes)) {
+	if (hProcess == 0 || bufminlen <= 8) {
+		reshade::log_message(reshade::log_level::error, "AllMemScanner: no process handle, or buffer length too short");
+		return false;
 	}
-	return false;
+	scan_signature sig;
+	sig.triggerbytes = triggerbytes;
+	sig.minlen = bufminlen;
+	sig.ctx = scanctx;
+	sig.check = checkpossiblebuf;
+	std::vector<signature_hit> hits;
+	if (scan_regions_and_log(regions, { sig }, hits, has_triggerbytes) == 0) return false;
+	foundmemloc = hits[0].address;
+	found_region = hits[0].region;
+	return true;
 }
 
-bool AllMemScanner::iterate_next(uint64_t& foundmemloc, const uint8_t*& foundbuf, uint64_t& foundbuflen, const void* scanctx, bool (*checkpossiblebuf)(const void* ctx, const uint8_t* buf, uint64_t nbytes)) {
-    if (has_triggerbytes)
-        return fastscan ? impl_iterate_next<true, true>(foundmemloc, foundbuf, foundbuflen, scanctx, checkpossiblebuf)
-                        : impl_iterate_next<true,false>(foundmemloc, foundbuf, foundbuflen, scanctx, checkpossiblebuf);
-    return fastscan ? impl_iterate_next<false, true>(foundmemloc, foundbuf, foundbuflen, scanctx, checkpossiblebuf)
-                    : impl_iterate_next<false,false>(foundmemloc, foundbuf, foundbuflen, scanctx, checkpossiblebuf);
+size_t AllMemScanner::find_first_each(const std::vector<mem_region>& regions, const std::vector<scan_signature>& signatures, std::vector<signature_hit>& hits) {
+	hits.assign(signatures.size(), signature_hit());
+	if (hProcess == 0 || signatures.empty() || signatures.size() > max_signatures) {
+		reshade::log_message(reshade::log_level::error, "AllMemScanner: no process handle, or no (or too many) signatures");
+		return 0;
+	}
+	for (const scan_signature& sig : signatures) {
+		if (sig.minlen < 8) {
+			reshade::log_message(reshade::log_level::error, "AllMemScanner: signature length too short");
+			return 0;
+		}
+	}
+	return scan_regions_and_log(regions, signatures, hits, true);
+}
+
+void AllMemScanHitProfile::record(uint64_t address, const AllMemScanner::mem_region& region) {
+	hits.push_back({ address, region });
+	if (hits.size() > max_hits) hits.erase(hits.begin());
+}
+
+static inline int memscan_size_class(uint64_t nbytes) {
+	int log2 = 0;
+	while (nbytes > 1ull) { nbytes >>= 1; ++log2; }
+	return log2;
+}
+static inline uint64_t memscan_distance(uint64_t aa, uint64_t bb) {
+	return aa > bb ? aa - bb : bb - aa;
+}
+
+void AllMemScanHitProfile::prioritize(std::vector<AllMemScanner::mem_region>& regions) const {
+	if (hits.empty()) return;
+	struct ranked {
+		int similarity;
+		uint64_t distance;
+		AllMemScanner::mem_region region;
+	};
+	std::vector<ranked> ranks;
+	ranks.reserve(regions.size());
+	for (const AllMemScanner::mem_region& region : regions) {
+		ranked rr = { 0, UINT64_MAX, region };
+		for (const hit& hh : hits) {
+			const int similarity = (region.protect == hh.region.protect ? 4 : 0) + (region.type == hh.region.type ? 2 : 0)
+				+ (std::abs(memscan_size_class(region.size) - memscan_size_class(hh.region.size)) <= 1 ? 1 : 0);
+			rr.similarity = std::max(rr.similarity, similarity);
+		}
+		// distance from the last hit: the region containing it is at distance 0
+		const uint64_t lastaddr = hits.back().address;
+		rr.distance = (lastaddr >= region.base && lastaddr < region.base + region.size) ? 0ull : memscan_distance(region.base, lastaddr);
+		ranks.push_back(rr);
+	}
+	std::stable_sort(ranks.begin(), ranks.end(), [](const ranked& aa, const ranked& bb) {
+		return aa.similarity != bb.similarity ? aa.similarity > bb.similarity : aa.distance < bb.distance;
+	});
+	for (size_t ii = 0; ii < regions.size(); ++ii) regions[ii] = ranks[ii].region;
+}
+
+bool AllMemScanHitProfile::load_json_file(const std::wstring& filepath, std::string& log) {
+	hits.clear();
+	if (!std::filesystem::exists(filepath)) {
+		log = std::string("no memory scan profile ") + std::filesystem::path(filepath).string();
+		return true;
+	}
+	try {
+		std::ifstream infile{ std::filesystem::path(filepath) };
+		const nlohmann::json jj = nlohmann::json::parse(infile);
+		for (const nlohmann::json& jh : jj.at("hits")) {
+			hit hh;
+			hh.address = jh.at("address").get<uint64_t>();
+			hh.region.base = jh.at("region_base").get<uint64_t>();
+			hh.region.size = jh.at("region_size").get<uint64_t>();
+			hh.region.protect = jh.at("protect").get<uint32_t>();
+			hh.region.type = jh.at("type").get<uint32_t>();
+			record(hh.address, hh.region);
+		}
+	} catch (const std::exception& ex) {
+		hits.clear();
+		log = std::string("failed to load memory scan profile ") + std::filesystem::path(filepath).string() + std::string(": ") + ex.what();
+		return false;
+	}
+	log = std::string("loaded memory scan profile with ") + std::to_string(hits.size()) + std::string(" hits");
+	return true;
+}
+
+bool AllMemScanHitProfile::save_json_file(const std::wstring& filepath, std::string& log) const {
+	nlohmann::json jj;
+	jj["hits"] = nlohmann::json::array();
+	for (const hit& hh : hits) {
+		jj["hits"].push_back({ {"address", hh.address}, {"region_base", hh.region.base}, {"region_size", hh.region.size},
+			{"protect", hh.region.protect}, {"type", hh.region.type} });
+	}
+	std::ofstream outfile{ std::filesystem::path(filepath) };
+	outfile << jj.dump(1, '\t');
+	if (!outfile) {
+		log = std::string("failed to save memory scan profile ") + std::filesystem::path(filepath).string();
+		return false;
+	}
+	return true;
 }
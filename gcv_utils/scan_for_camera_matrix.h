@@ -3,34 +3,102 @@
 #include <Windows.h>
 #include <string>
 #include <vector>
+#include <atomic>
 
+// for following (or cancelling) a scan running on another thread
+struct AllMemScanProgress {
+	std::atomic<uint64_t> bytes_total = { 0ull };
+	std::atomic<uint64_t> bytes_scanned = { 0ull };
+	std::atomic<bool> cancel = { false };
+	float fraction() const {
+		const uint64_t total = bytes_total.load(std::memory_order_relaxed);
+		return total > 0ull ? static_cast<float>(static_cast<double>(bytes_scanned.load(std::memory_order_relaxed)) / static_cast<double>(total)) : 0.0f;
+	}
+};
 
+/*
+* Scans the game's memory for a buffer accepted by a check function (optionally only where it starts with 8 trigger bytes),
+* or for several signatures (trigger bytes and check functions) at once, in a single pass.
+* First the committed regions are enumerated, then they are cut into chunks which a pool of threads reads and scans, each into its own buffer.
+* Chunks are claimed in the order of the regions, and the first hit in that order wins: once something is found, chunks after it are skipped,
+* so the result is the same as that of a single-threaded scan (from address 0, if the regions are in address order). With several signatures,
+* each has its own first hit, and chunks are only skipped once all of them were found.
+* The check function is called concurrently from the scanning threads.
+*/
 class AllMemScanner {
-	static constexpr uint64_t scanbufsize = 1000000ull;
-	MEMORY_BASIC_INFORMATION mbi;
-	uint64_t currmemloc;
+public:
+	static constexpr uint64_t scanbufsize = 1000000ull; // candidate start positions per chunk
+	struct mem_region {
+		uint64_t base = 0ull;
+		uint64_t size = 0ull;
+		uint32_t protect = 0u; // PAGE_*
+		uint32_t type = 0u; // MEM_PRIVATE, MEM_MAPPED or MEM_IMAGE
+	};
+	struct scan_signature {
+		uint64_t triggerbytes = 0ull; // the first 8 bytes of what is searched for
+		uint64_t minlen = 8ull; // bytes that must be readable from its start; at least 8
+		const void* ctx = nullptr;
+		bool (*check)(const void* ctx, const uint8_t* buf, uint64_t nbytes) = nullptr; // optional; called concurrently
+	};
+	struct signature_hit {
+		bool found = false;
+		uint64_t address = 0ull;
+		mem_region region;
+	};
+	static constexpr size_t max_signatures = 64;
+private:
 	uint64_t bufminlen;
 	uint64_t triggerbytes;
 	bool has_triggerbytes;
 	HANDLE hProcess;
-	HMODULE hCamDLL;
 	std::string& errstr;
-	std::vector<uint8_t> databuf;
 
 	template<bool hastriggerbytes_t, bool fastscan_t>
-	bool impl_iterate_next(uint64_t& foundmemloc, const uint8_t*& foundbuf, uint64_t& foundbuflen, const void* scanctx, bool (*checkpossiblebuf)(const void* ctx, const uint8_t* buf, uint64_t nbytes));
+	void impl_scan_regions(const std::vector<mem_region>& regions, const std::vector<scan_signature>& signatures, std::vector<signature_hit>& hits);
+	size_t scan_regions_and_log(const std::vector<mem_region>& regions, const std::vector<scan_signature>& signatures, std::vector<signature_hit>& hits, bool hastriggerbytes);
 public:
-	bool fastscan = true;
+	bool fastscan = true; // only scan read-write regions, at 4-byte aligned addresses
+	uint32_t num_threads = 0; // 0: one per hardware thread
+	AllMemScanProgress* progress = nullptr; // optional
+	mem_region found_region; // the region of the last hit
 	AllMemScanner() = delete;
 	AllMemScanner(HANDLE hProcHandle, uint64_t wantbufminlength, std::string& errorstr, uint64_t triggerpattern, bool has_triggerpattern)
-		: currmemloc(0ull), bufminlen(wantbufminlength), triggerbytes(triggerpattern), has_triggerbytes(has_triggerpattern), hProcess(hProcHandle), errstr(errorstr) {
+		: bufminlen(wantbufminlength), triggerbytes(triggerpattern), has_triggerbytes(has_triggerpattern), hProcess(hProcHandle), errstr(errorstr) {
 		if (hProcess == 0) {
 			errstr += "AllMemScanner: error: hProcess == 0";
-		} else {
-			databuf.resize(scanbufsize + wantbufminlength);
 		}
-		reset_iterator_to_beginning();
 	}
-	void reset_iterator_to_beginning();
-	bool iterate_next(uint64_t& foundmemloc, const uint8_t*& foundbuf, uint64_t& foundbuflen, const void* scanctx, bool (*checkpossiblebuf)(const void* ctx, const uint8_t* buf, uint64_t nbytes));
+	// committed regions that would be scanned (depends on fastscan), in address order
+	std::vector<mem_region> enumerate_regions() const;
+	// finds the first address (in the order of the regions, then of addresses within them) where checkpossiblebuf accepts the buffer
+	bool find_first(const std::vector<mem_region>& regions, uint64_t& foundmemloc, const void* scanctx, bool (*checkpossiblebuf)(const void* ctx, const uint8_t* buf, uint64_t nbytes));
+	bool find_first(uint64_t& foundmemloc, const void* scanctx, bool (*checkpossiblebuf)(const void* ctx, const uint8_t* buf, uint64_t nbytes)) {
+		return find_first(enumerate_regions(), foundmemloc, scanctx, checkpossiblebuf);
+	}
+	// one pass for up to max_signatures signatures (the trigger bytes given to the constructor are not used): the first hit of each, in the order of the regions;
+	// the pass ends after the first signature's hit, so the others are only found if they occur before it (or near it, in the same chunk); returns how many were found
+	size_t find_first_each(const std::vector<mem_region>& regions, const std::vector<scan_signature>& signatures, std::vector<signature_hit>& hits);
+};
+
+/*
+* Where previous scans found their buffer: the attributes of the hit's region (protection, type, size) and the address.
+* A buffer that moved (e.g. a script table that was garbage collected) usually reappears in a similar region, near where it was,
+* so regions are scanned most similar first, then nearest first. Persisted per game, so that the first scan of a session benefits too.
+*/
+class AllMemScanHitProfile {
+public:
+	struct hit {
+		uint64_t address = 0ull;
+		AllMemScanner::mem_region region;
+	};
+	static constexpr size_t max_hits = 16;
+private:
+	std::vector<hit> hits; // oldest first
+public:
+	bool empty() const { return hits.empty(); }
+	void record(uint64_t address, const AllMemScanner::mem_region& region);
+	// stable: regions equally similar to (and as far from) previous hits keep their order
+	void prioritize(std::vector<AllMemScanner::mem_region>& regions) const;
+	bool load_json_file(const std::wstring& filepath, std::string& log);
+	bool save_json_file(const std::wstring& filepath, std::string& log) const;
 };
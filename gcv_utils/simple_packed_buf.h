@@ -9,6 +9,7 @@ enum BufPixelFormat {
 	BUF_PIX_FMT_RGBA,
 	BUF_PIX_FMT_GRAYF32,
 	BUF_PIX_FMT_GRAYU32,
+	BUF_PIX_FMT_GRAYU16,
 };
 
 // row accessors assume data is row-major
@@ -0,0 +1,270 @@
+#pragma once
+// Copyright (C) 2023 Jason Bunk
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define GCV_TRIGGER_SEARCH_SSE2 1
+#endif
+#if (defined(_MSC_VER) && defined(_M_X64)) || defined(__AVX2__)
+#include <immintrin.h>
+#define GCV_TRIGGER_SEARCH_AVX2 1 // MSVC compiles AVX2 intrinsics without /arch:AVX2, so it is chosen at runtime
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/*
+* Finds where an 8-byte pattern (e.g. the scanner's magic trigger bytes) occurs in a buffer, checking candidate offsets 0, step, 2*step, ... up to llast.
+* Whole vectors are compared against the pattern's first 4 bytes (step 4: one per 32-bit lane; step 1: its first and 4th byte at every byte),
+* and only those candidates are compared in full and passed to onmatch(offset), in increasing order, until it returns true.
+* Returns the accepted offset, or trigger_search_notfound. The buffer must be readable up to llast + 8.
+*/
+constexpr uint64_t trigger_search_notfound = ~0ull;
+
+namespace trigger_search {
+inline uint32_t lowest_bit_index(uint32_t mask) {
+#if defined(_MSC_VER)
+	unsigned long idx;
+	_BitScanForward(&idx, mask);
+	return idx;
+#else
+	return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+}
+inline bool matches_u64(const uint8_t* buf, uint64_t pattern) {
+	uint64_t val;
+	memcpy(&val, buf, sizeof(val));
+	return val == pattern;
+}
+inline bool cpu_has_avx2() {
+#if defined(__AVX2__)
+	return true;
+#elif GCV_TRIGGER_SEARCH_AVX2
+	static const bool has_avx2 = []() {
+		int regs[4];
+		__cpuid(regs, 0);
+		if (regs[0] < 7) return false;
+		__cpuid(regs, 1);
+		const bool os_saves_avx = (regs[2] & (1 << 27)) != 0 && (regs[2] & (1 << 28)) != 0;
+		if (!os_saves_avx || (_xgetbv(0) & 6ull) != 6ull) return false;
+		__cpuidex(regs, 7, 0);
+		return (regs[1] & (1 << 5)) != 0;
+	}();
+	return has_avx2;
+#else
+	return false;
+#endif
+}
+
+// continues from offset ii, one candidate at a time
+template<uint32_t step_t, typename OnMatchT>
+uint64_t find_scalar(const uint8_t* buf, uint64_t ii, uint64_t llast, uint64_t pattern, const OnMatchT& onmatch) {
+	for (; ii <= llast; ii += step_t) {
+		if (matches_u64(buf + ii, pattern) && onmatch(ii)) return ii;
+	}
+	return trigger_search_notfound;
+}
+
+// candidates in a vector are flagged in mask (one bit per lane for step 4, per byte for step 1)
+template<uint32_t step_t, typename OnMatchT>
+bool check_candidates(const uint8_t* buf, uint64_t ii, uint32_t mask, uint64_t pattern, const OnMatchT& onmatch, uint64_t& found) {
+	while (mask != 0u) {
+		const uint64_t offset = ii + static_cast<uint64_t>(lowest_bit_index(mask)) * step_t;
+		mask &= mask - 1u;
+		if (matches_u64(buf + offset, pattern) && onmatch(offset)) {
+			found = offset;
+			return true;
+		}
+	}
+	return false;
+}
+
+#if GCV_TRIGGER_SEARCH_SSE2
+template<uint32_t step_t, typename OnMatchT>
+uint64_t find_sse2(const uint8_t* buf, uint64_t llast, uint64_t pattern, const OnMatchT& onmatch) {
+	uint64_t ii = 0, found;
+	if (step_t == 4) {
+		const __m128i first4 = _mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(pattern)));
+		for (; ii + 12 <= llast; ii += 16) {
+			const __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + ii)), first4);
+			const uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(eq)));
+			if (mask != 0u && check_candidates<step_t>(buf, ii, mask, pattern, onmatch, found)) return found;
+		}
+	} else {
+		const __m128i byte0 = _mm_set1_epi8(static_cast<char>(pattern & 0xFFull));
+		const __m128i byte3 = _mm_set1_epi8(static_cast<char>((pattern >> 24) & 0xFFull));
+		for (; ii + 15 <= llast; ii += 16) {
+			const __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + ii)), byte0),
+				_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + ii + 3)), byte3));
+			const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(eq));
+			if (mask != 0u && check_candidates<step_t>(buf, ii, mask, pattern, onmatch, found)) return found;
+		}
+	}
+	return find_scalar<step_t>(buf, ii, llast, pattern, onmatch);
+}
+#endif
+
+#if GCV_TRIGGER_SEARCH_AVX2
+template<uint32_t step_t, typename OnMatchT>
+uint64_t find_avx2(const uint8_t* buf, uint64_t llast, uint64_t pattern, const OnMatchT& onmatch) {
+	uint64_t ii = 0, found;
+	if (step_t == 4) {
+		const __m256i first4 = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(pattern)));
+		for (; ii + 28 <= llast; ii += 32) {
+			const __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + ii)), first4);
+			const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(eq)));
+			if (mask != 0u && check_candidates<step_t>(buf, ii, mask, pattern, onmatch, found)) return found;
+		}
+	} else {
+		const __m256i byte0 = _mm256_set1_epi8(static_cast<char>(pattern & 0xFFull));
+		const __m256i byte3 = _mm256_set1_epi8(static_cast<char>((pattern >> 24) & 0xFFull));
+		for (; ii + 31 <= llast; ii += 32) {
+			const __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + ii)), byte0),
+				_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + ii + 3)), byte3));
+			const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(eq));
+			if (mask != 0u && check_candidates<step_t>(buf, ii, mask, pattern, onmatch, found)) return found;
+		}
+	}
+	return find_scalar<step_t>(buf, ii, llast, pattern, onmatch);
+}
+#endif
+}
+
+template<uint32_t step_t, typename OnMatchT>
+uint64_t find_u64_pattern(const uint8_t* buf, uint64_t llast, uint64_t pattern, const OnMatchT& onmatch) {
+	static_assert(step_t == 1 || step_t == 4, "candidates are every byte, or every 4 bytes");
+#if GCV_TRIGGER_SEARCH_AVX2
+	if (trigger_search::cpu_has_avx2()) return trigger_search::find_avx2<step_t>(buf, llast, pattern, onmatch);
+#endif
+#if GCV_TRIGGER_SEARCH_SSE2
+	return trigger_search::find_sse2<step_t>(buf, llast, pattern, onmatch);
+#else
+	return trigger_search::find_scalar<step_t>(buf, 0, llast, pattern, onmatch);
+#endif
+}
+
+/*
+* Finds where any of up to 64 8-byte patterns occur (e.g. the trigger bytes of several signatures), in one pass whose cost barely depends on how many there are:
+* each candidate's first 4 bytes are hashed into a table of buckets, almost all of which are empty, and only the patterns in its bucket are compared in full.
+* With only a few patterns, whole vectors are first compared against each of them (as in find_u64_pattern), and only flagged candidates are hashed.
+*/
+class multi_trigger_table {
+	static constexpr uint32_t hashbits = 12; // with up to 64 patterns, at most 1/64 of the candidates reach a non-empty bucket
+	static constexpr size_t simd_prefilter_max = 8;
+	std::vector<uint64_t> patterns;
+	std::vector<uint16_t> bucket_begin; // bucket hh holds bucket_entries[bucket_begin[hh] .. bucket_begin[hh + 1])
+	std::vector<uint8_t> bucket_entries; // pattern indices
+	static uint32_t hash(uint32_t first4) { return (first4 * 2654435761u) >> (32u - hashbits); }
+
+	// the patterns at offset ii, in pattern order
+	template<typename OnMatchT>
+	uint64_t verify_at(const uint8_t* buf, uint64_t ii, uint64_t wantmask, const OnMatchT& onmatch) const {
+		uint32_t first4;
+		memcpy(&first4, buf + ii, sizeof(first4));
+		const uint32_t hh = hash(first4);
+		for (uint32_t ee = bucket_begin[hh]; ee < bucket_begin[hh + 1u]; ++ee) {
+			const uint32_t pp = bucket_entries[ee];
+			if ((wantmask & (1ull << pp)) != 0ull && trigger_search::matches_u64(buf + ii, patterns[pp]) && onmatch(ii, static_cast<size_t>(pp))) {
+				wantmask &= ~(1ull << pp);
+			}
+		}
+		return wantmask;
+	}
+	template<uint32_t step_t, typename OnMatchT>
+	uint64_t find_each_scalar(const uint8_t* buf, uint64_t ii, uint64_t llast, uint64_t wantmask, const OnMatchT& onmatch) const {
+		for (; ii <= llast && wantmask != 0ull; ii += step_t) wantmask = verify_at(buf, ii, wantmask, onmatch);
+		return wantmask;
+	}
+	template<uint32_t step_t, typename OnMatchT>
+	uint64_t verify_flagged(const uint8_t* buf, uint64_t ii, uint32_t mask, uint64_t wantmask, const OnMatchT& onmatch) const {
+		for (; mask != 0u && wantmask != 0ull; mask &= mask - 1u) {
+			wantmask = verify_at(buf, ii + static_cast<uint64_t>(trigger_search::lowest_bit_index(mask)) * step_t, wantmask, onmatch);
+		}
+		return wantmask;
+	}
+#if GCV_TRIGGER_SEARCH_SSE2
+	template<uint32_t step_t, typename OnMatchT>
+	uint64_t find_each_sse2(const uint8_t* buf, uint64_t llast, uint64_t wantmask, const OnMatchT& onmatch) const {
+		const size_t npat = patterns.size();
+		__m128i first[simd_prefilter_max], fourth[simd_prefilter_max];
+		for (size_t pp = 0; pp < npat; ++pp) {
+			first[pp] = (step_t == 4) ? _mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(patterns[pp]))) : _mm_set1_epi8(static_cast<char>(patterns[pp] & 0xFFull));
+			fourth[pp] = _mm_set1_epi8(static_cast<char>((patterns[pp] >> 24) & 0xFFull));
+		}
+		uint64_t ii = 0;
+		for (; ii + 15 <= llast && wantmask != 0ull; ii += 16) {
+			const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + ii));
+			uint32_t mask;
+			if (step_t == 4) {
+				__m128i eq = _mm_cmpeq_epi32(v0, first[0]);
+				for (size_t pp = 1; pp < npat; ++pp) eq = _mm_or_si128(eq, _mm_cmpeq_epi32(v0, first[pp]));
+				mask = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(eq)));
+			} else {
+				const __m128i v3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + ii + 3));
+				__m128i eq = _mm_setzero_si128();
+				for (size_t pp = 0; pp < npat; ++pp) eq = _mm_or_si128(eq, _mm_and_si128(_mm_cmpeq_epi8(v0, first[pp]), _mm_cmpeq_epi8(v3, fourth[pp])));
+				mask = static_cast<uint32_t>(_mm_movemask_epi8(eq));
+			}
+			if (mask != 0u) wantmask = verify_flagged<step_t>(buf, ii, mask, wantmask, onmatch);
+		}
+		return find_each_scalar<step_t>(buf, ii, llast, wantmask, onmatch);
+	}
+#endif
+#if GCV_TRIGGER_SEARCH_AVX2
+	template<uint32_t step_t, typename OnMatchT>
+	uint64_t find_each_avx2(const uint8_t* buf, uint64_t llast, uint64_t wantmask, const OnMatchT& onmatch) const {
+		const size_t npat = patterns.size();
+		__m256i first[simd_prefilter_max], fourth[simd_prefilter_max];
+		for (size_t pp = 0; pp < npat; ++pp) {
+			first[pp] = (step_t == 4) ? _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(patterns[pp]))) : _mm256_set1_epi8(static_cast<char>(patterns[pp] & 0xFFull));
+			fourth[pp] = _mm256_set1_epi8(static_cast<char>((patterns[pp] >> 24) & 0xFFull));
+		}
+		uint64_t ii = 0;
+		for (; ii + 31 <= llast && wantmask != 0ull; ii += 32) {
+			const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + ii));
+			uint32_t mask;
+			if (step_t == 4) {
+				__m256i eq = _mm256_cmpeq_epi32(v0, first[0]);
+				for (size_t pp = 1; pp < npat; ++pp) eq = _mm256_or_si256(eq, _mm256_cmpeq_epi32(v0, first[pp]));
+				mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(eq)));
+			} else {
+				const __m256i v3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + ii + 3));
+				__m256i eq = _mm256_setzero_si256();
+				for (size_t pp = 0; pp < npat; ++pp) eq = _mm256_or_si256(eq, _mm256_and_si256(_mm256_cmpeq_epi8(v0, first[pp]), _mm256_cmpeq_epi8(v3, fourth[pp])));
+				mask = static_cast<uint32_t>(_mm256_movemask_epi8(eq));
+			}
+			if (mask != 0u) wantmask = verify_flagged<step_t>(buf, ii, mask, wantmask, onmatch);
+		}
+		return find_each_scalar<step_t>(buf, ii, llast, wantmask, onmatch);
+	}
+#endif
+public:
+	static constexpr size_t max_patterns = 64;
+	explicit multi_trigger_table(const std::vector<uint64_t>& wantpatterns) : patterns(wantpatterns), bucket_begin((1u << hashbits) + 1u, 0u) {
+		if (patterns.size() > max_patterns) patterns.resize(max_patterns);
+		for (uint64_t pattern : patterns) bucket_begin[hash(static_cast<uint32_t>(pattern)) + 1u]++;
+		for (uint32_t hh = 0; hh < (1u << hashbits); ++hh) bucket_begin[hh + 1u] += bucket_begin[hh];
+		bucket_entries.resize(patterns.size());
+		std::vector<uint16_t> filled(bucket_begin.begin(), bucket_begin.end() - 1);
+		for (size_t pp = 0; pp < patterns.size(); ++pp) bucket_entries[filled[hash(static_cast<uint32_t>(patterns[pp]))]++] = static_cast<uint8_t>(pp);
+	}
+	size_t size() const { return patterns.size(); }
+
+	// Calls onmatch(offset, pattern index) where a pattern whose bit is set in wantmask occurs, at candidate offsets 0, step, 2*step, ... up to llast, in increasing order;
+	// a pattern is no longer looked for once onmatch accepts it (returns true). Returns the patterns that were not accepted. The buffer must be readable up to llast + 8.
+	template<uint32_t step_t, typename OnMatchT>
+	uint64_t find_each(const uint8_t* buf, uint64_t llast, uint64_t wantmask, const OnMatchT& onmatch) const {
+		static_assert(step_t == 1 || step_t == 4, "candidates are every byte, or every 4 bytes");
+		if (patterns.empty() || patterns.size() > simd_prefilter_max) return find_each_scalar<step_t>(buf, 0, llast, wantmask, onmatch);
+#if GCV_TRIGGER_SEARCH_AVX2
+		if (trigger_search::cpu_has_avx2()) return find_each_avx2<step_t>(buf, llast, wantmask, onmatch);
+#endif
+#if GCV_TRIGGER_SEARCH_SSE2
+		return find_each_sse2<step_t>(buf, llast, wantmask, onmatch);
+#else
+		return find_each_scalar<step_t>(buf, 0, llast, wantmask, onmatch);
+#endif
+	}
+};
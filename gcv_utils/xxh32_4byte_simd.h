@@ -0,0 +1,61 @@
+#pragma once
+// Copyright (C) 2023 Jason Bunk
+#include <stdint.h>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define GCV_XXH32_4BYTE_SSE2 1
+#endif
+
+// XXH32 of exactly 4 bytes, unrolled from the xxhash reference: bit-identical to XXH32(&input, 4, seed) on little-endian machines.
+namespace xxh32_4byte {
+constexpr uint32_t prime2 = 0x85EBCA77u;
+constexpr uint32_t prime3 = 0xC2B2AE3Du;
+constexpr uint32_t prime4 = 0x27D4EB2Fu;
+constexpr uint32_t prime5 = 0x165667B1u;
+}
+
+inline uint32_t xxh32_of_4_bytes(uint32_t input, uint32_t seed) {
+	using namespace xxh32_4byte;
+	uint32_t h32 = seed + prime5 + 4u;
+	h32 += input * prime3;
+	h32 = ((h32 << 17) | (h32 >> 15)) * prime4;
+	h32 ^= h32 >> 15;
+	h32 *= prime2;
+	h32 ^= h32 >> 13;
+	h32 *= prime3;
+	h32 ^= h32 >> 16;
+	return h32;
+}
+
+#if GCV_XXH32_4BYTE_SSE2
+// 32-bit multiply of each lane (SSE2 has no pmulld)
+inline __m128i xxh32_4byte_mullo_epi32(__m128i aa, __m128i bb) {
+	const __m128i even = _mm_mul_epu32(aa, bb);
+	const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(aa, 32), _mm_srli_epi64(bb, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// four independent xxh32_of_4_bytes, one per 32-bit lane
+inline __m128i xxh32_of_4_bytes_x4(__m128i input, uint32_t seed) {
+	using namespace xxh32_4byte;
+	const __m128i p2 = _mm_set1_epi32(static_cast<int>(prime2));
+	const __m128i p3 = _mm_set1_epi32(static_cast<int>(prime3));
+	const __m128i p4 = _mm_set1_epi32(static_cast<int>(prime4));
+	__m128i h32 = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(seed + prime5 + 4u)), xxh32_4byte_mullo_epi32(input, p3));
+	h32 = xxh32_4byte_mullo_epi32(_mm_or_si128(_mm_slli_epi32(h32, 17), _mm_srli_epi32(h32, 15)), p4);
+	h32 = _mm_xor_si128(h32, _mm_srli_epi32(h32, 15));
+	h32 = xxh32_4byte_mullo_epi32(h32, p2);
+	h32 = _mm_xor_si128(h32, _mm_srli_epi32(h32, 13));
+	h32 = xxh32_4byte_mullo_epi32(h32, p3);
+	return _mm_xor_si128(h32, _mm_srli_epi32(h32, 16));
+}
+#endif
+
+// hashes the 4 consecutive uint32 at in[0..3]
+inline void xxh32_of_4_bytes_x4(const uint32_t* in, uint32_t seed, uint32_t* out) {
+#if GCV_XXH32_4BYTE_SSE2
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out), xxh32_of_4_bytes_x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)), seed));
+#else
+	for (int ii = 0; ii < 4; ++ii) out[ii] = xxh32_of_4_bytes(in[ii], seed);
+#endif
+}
@@ -0,0 +1,163 @@
+// Copyright (C) 2023 Jason Bunk
+//
+// Benchmark of the instance grouping done at capture time (segmentation/instance_grouping.cpp), on synthetic segmentation maps:
+// a background plus many objects, each drawn as several overlapping parts from different draws that share a vertex shader,
+// at a constant depth per object. Checks the result against a simple single-threaded flood fill, then reports timings.
+//
+#include "segmentation/instance_grouping.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <string>
+using std::endl;
+
+struct synthetic_map {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint32_t> seg; // r32g32b32a32_uint rows, tightly packed
+	std::vector<float> depth;
+	std::vector<perdraw_metadata_type> draw_metadata;
+};
+
+static synthetic_map make_synthetic_map(uint32_t width, uint32_t height, uint32_t num_objects, uint32_t parts_per_object, uint32_t seed) {
+	synthetic_map map;
+	map.width = width;
+	map.height = height;
+	map.seg.assign(static_cast<size_t>(width) * height * 4u, 0u);
+	map.depth.assign(static_cast<size_t>(width) * height, 1000.0f);
+	map.draw_metadata.push_back({ 6ull, 1ull, 1ull }); // background
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> unif(0.0f, 1.0f);
+	const uint32_t num_vertex_shaders = std::max(1u, num_objects / 8u); // so that different objects also share shaders
+	for (uint32_t obj = 0; obj < num_objects; ++obj) {
+		const float cx = unif(rng) * width, cy = unif(rng) * height;
+		const float objsize = (0.01f + 0.05f * unif(rng)) * width;
+		const float objdepth = 5.0f + 500.0f * unif(rng);
+		const uint64_t vs = 100ull + (rng() % num_vertex_shaders);
+		const uint32_t instance = rng() % 4u;
+		for (uint32_t part = 0; part < parts_per_object; ++part) {
+			const uint32_t drawidx = static_cast<uint32_t>(map.draw_metadata.size());
+			map.draw_metadata.push_back({ 3ull * (1ull + rng() % 1000ull), vs, 1000ull + rng() % 50ull });
+			// parts are boxes around the object's center, so they touch each other
+			const float px = cx + (unif(rng) - 0.5f) * objsize, py = cy + (unif(rng) - 0.5f) * objsize;
+			const float hw = objsize * (0.2f + 0.4f * unif(rng)), hh = objsize * (0.2f + 0.4f * unif(rng));
+			const uint32_t x0 = static_cast<uint32_t>(std::clamp(px - hw, 0.0f, static_cast<float>(width)));
+			const uint32_t x1 = static_cast<uint32_t>(std::clamp(px + hw, 0.0f, static_cast<float>(width)));
+			const uint32_t y0 = static_cast<uint32_t>(std::clamp(py - hh, 0.0f, static_cast<float>(height)));
+			const uint32_t y1 = static_cast<uint32_t>(std::clamp(py + hh, 0.0f, static_cast<float>(height)));
+			for (uint32_t y = y0; y < y1; ++y) {
+				for (uint32_t x = x0; x < x1; ++x) {
+					const size_t ii = static_cast<size_t>(y) * width + x;
+					if (map.depth[ii] < objdepth) continue;
+					map.depth[ii] = objdepth;
+					map.seg[ii * 4u + 0u] = drawidx;
+					map.seg[ii * 4u + 1u] = instance;
+					map.seg[ii * 4u + 2u] = (x / 7u) + (y / 5u); // fake primitive ID
+				}
+			}
+		}
+	}
+	return map;
+}
+
+// flood fill with the same connectivity rules, numbering groups in raster order
+static uint32_t reference_grouping(const synthetic_map& map, const instance_grouping_rules& rules, std::vector<uint32_t>& out) {
+	const uint32_t width = map.width, height = map.height;
+	out.assign(static_cast<size_t>(width) * height, ~0u);
+	auto connected = [&](size_t ia, size_t ib) {
+		const uint32_t* pa = &map.seg[ia * 4u];
+		const uint32_t* pb = &map.seg[ib * 4u];
+		if (pa[0] == pb[0] && pa[1] == pb[1]) return true;
+		const perdraw_metadata_type& ma = map.draw_metadata[pa[0]];
+		const perdraw_metadata_type& mb = map.draw_metadata[pb[0]];
+		if (!rules.merges_different_parts()) return false;
+		if (rules.merge_parts_with_same_vertex_shader && ma[pdm_vertex_shader_hash] != mb[pdm_vertex_shader_hash]) return false;
+		if (rules.merge_parts_with_same_pixel_shader && ma[pdm_pixel_shader_hash] != mb[pdm_pixel_shader_hash]) return false;
+		if (rules.max_relative_depth_step <= 0.0f) return true;
+		const float za = std::abs(map.depth[ia]), zb = std::abs(map.depth[ib]);
+		return std::abs(za - zb) <= rules.max_relative_depth_step * std::max(std::min(za, zb), 1e-20f);
+	};
+	uint32_t num_groups = 0;
+	std::vector<size_t> stack;
+	for (size_t start = 0; start < out.size(); ++start) {
+		if (out[start] != ~0u) continue;
+		out[start] = num_groups;
+		stack.push_back(start);
+		while (!stack.empty()) {
+			const size_t ii = stack.back();
+			stack.pop_back();
+			const size_t x = ii % width, y = ii / width;
+			const size_t neighbors[4] = { x > 0 ? ii - 1 : ii, x + 1 < width ? ii + 1 : ii, y > 0 ? ii - width : ii, y + 1 < height ? ii + width : ii };
+			for (size_t nn : neighbors) {
+				if (nn != ii && out[nn] == ~0u && connected(ii, nn)) {
+					out[nn] = num_groups;
+					stack.push_back(nn);
+				}
+			}
+		}
+		num_groups++;
+	}
+	return num_groups;
+}
+
+int main(int argc, char** argv) {
+	uint32_t width = 2560, height = 1440, num_objects = 2000, parts_per_object = 4, iterations = 20;
+	for (int ii = 1; ii + 1 < argc; ii += 2) {
+		const std::string arg(argv[ii]);
+		const uint32_t val = static_cast<uint32_t>(std::max(1, std::atoi(argv[ii + 1])));
+		if (arg == "-w") width = val;
+		else if (arg == "-h") height = val;
+		else if (arg == "-n") num_objects = val;
+		else if (arg == "-p") parts_per_object = val;
+		else if (arg == "-i") iterations = val;
+		else {
+			std::cout << "usage: instance_grouping_benchmark [-w width] [-h height] [-n num_objects] [-p parts_per_object] [-i iterations]" << endl;
+			return 1;
+		}
+	}
+	const synthetic_map map = make_synthetic_map(width, height, num_objects, parts_per_object, 12345u);
+	std::cout << "synthetic map " << width << "x" << height << ", " << num_objects << " objects of " << parts_per_object << " parts ("
+		<< map.draw_metadata.size() << " draws)" << endl;
+
+	instance_grouping_input input;
+	input.seg_rows = reinterpret_cast<const uint8_t*>(map.seg.data());
+	input.seg_row_pitch = static_cast<size_t>(width) * 4u * sizeof(uint32_t);
+	input.width = width;
+	input.height = height;
+	input.draw_metadata = &map.draw_metadata;
+	input.depth = map.depth.data();
+
+	std::vector<instance_grouping_rules> rulesets(3);
+	rulesets[0].merge_parts_with_same_vertex_shader = false; // parts only
+	rulesets[2].max_relative_depth_step = 0.0f; // shader only, ignoring depth
+	const char* rulenames[] = { "parts only", "same VS + depth", "same VS, no depth" };
+
+	const uint32_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<uint32_t> workspace, result, reference;
+	result.resize(static_cast<size_t>(width) * height);
+	bool all_ok = true;
+	std::cout << std::fixed << std::setprecision(2);
+	for (size_t rr = 0; rr < rulesets.size(); ++rr) {
+		const uint32_t ref_groups = reference_grouping(map, rulesets[rr], reference);
+		for (uint32_t num_threads = 1; ; num_threads = std::min(num_threads * 2u, max_threads)) {
+			std::vector<double> ms;
+			uint32_t num_groups = 0;
+			for (uint32_t it = 0; it < iterations; ++it) {
+				const auto t0 = std::chrono::steady_clock::now();
+				num_groups = group_connected_instances(input, rulesets[rr], num_threads, workspace, result.data());
+				ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+			}
+			std::sort(ms.begin(), ms.end());
+			const bool ok = num_groups == ref_groups && result == reference;
+			all_ok = all_ok && ok;
+			std::cout << std::setw(18) << rulenames[rr] << ", " << std::setw(3) << num_threads << " threads: " << num_groups << " groups, median "
+				<< ms[ms.size() / 2] << " ms, min " << ms.front() << " ms" << (ok ? "" : "  MISMATCH vs reference") << endl;
+			if (num_threads >= max_threads) break;
+		}
+	}
+	return all_ok ? 0 : 1;
+}
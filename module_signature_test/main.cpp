@@ -0,0 +1,162 @@
+// Copyright (C) 2023 Jason Bunk
+//
+// Tests of the module signature scanner (gcv_utils/module_signature_scan.cpp), which has no Windows dependencies, so this also builds with g++ or clang:
+// checks the headers and signatures of sample_x64.dll (written by make_sample_pe.py, whose RVAs are the expected ones here),
+// then, for each further PE file given (e.g. any exe or dll), that signatures made for its RIP-relative references find them again,
+// and that the Boyer-Moore-Horspool search finds the same first matches as checking every offset.
+//
+#include "gcv_utils/module_signature_scan.h"
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <string>
+#include <cstring>
+using std::endl;
+
+static int num_failures = 0;
+static void check(bool ok, const std::string& what) {
+	if (ok) return;
+	std::cout << "FAILED: " << what << endl;
+	num_failures++;
+}
+
+static bool load_image(const std::string& filepath, std::vector<uint8_t>& image, pe_headers& headers) {
+	std::ifstream infile(filepath, std::ios::binary);
+	const std::vector<uint8_t> filebytes((std::istreambuf_iterator<char>(infile)), std::istreambuf_iterator<char>());
+	std::string errstr;
+	if (filebytes.empty() || !load_pe_file_as_image(filebytes, image, headers, errstr)) {
+		check(false, std::string("loading ") + filepath + std::string(": ") + errstr);
+		return false;
+	}
+	return true;
+}
+
+static uint64_t find_by_checking_every_offset(const uint8_t* buf, uint64_t nbytes, const byte_signature& sig, uint64_t start) {
+	for (uint64_t pos = start; pos + sig.size() <= nbytes; ++pos) {
+		size_t ii = 0;
+		while (ii < sig.size() && (!sig.known[ii] || buf[pos + ii] == sig.bytes[ii])) ++ii;
+		if (ii == sig.size()) return pos;
+	}
+	return signature_notfound;
+}
+
+static void test_sample(const std::string& filepath) {
+	std::vector<uint8_t> image;
+	pe_headers headers;
+	if (!load_image(filepath, image, headers)) return;
+	const pe_section* text = headers.find_section(".text");
+	check(headers.is_64bit && headers.size_of_image == 0x4000u && headers.size_of_headers == 0x400u && headers.sections.size() == 3, "sample headers");
+	check(text != nullptr && text->rva == 0x1000u && text->virtual_size == 0x41u && image[0x1000] == 0x48, "sample .text");
+	check(headers.find_section(".data") != nullptr && headers.find_section(".data")->virtual_size == 0x400u, "sample .data");
+	float scale = 0.0f;
+	std::memcpy(&scale, image.data() + 0x2020, sizeof(scale));
+	check(scale == 0.5f, "sample .rdata constant");
+
+	struct expected_signature {
+		module_signature sig;
+		uint64_t rva;
+	};
+	auto makesig = [](const char* pattern, const char* section, int32_t dispoffset, int32_t instrend, int64_t adjust) {
+		module_signature sig;
+		sig.pattern = pattern;
+		sig.section = section;
+		sig.rip_disp_offset = dispoffset;
+		sig.rip_instr_end = instrend;
+		sig.result_adjust = adjust;
+		return sig;
+	};
+	const expected_signature expected[] = {
+		{ makesig("48 8B 05 ?? ?? ?? ?? 0F 28 40 10", ".text", 3, 7, 0x30), 0x3130 }, // not the decoy ending in 11
+		{ makesig("48 8D 0D ?? ?? ?? ?? E8", ".text", 3, 7, 0), 0x3200 }, // past the end of .data's file data
+		{ makesig("F3 0F 10 05 ?? ?? ?? ?? F3 0F 59", ".text", 4, 8, 0), 0x2020 },
+		{ makesig("48 83 C4 28 C3", ".text", -1, 0, 0), 0x103C }, // not RIP-relative: the match itself
+		{ makesig("48 8B 05 ?? ?? ?? ?? 0F 28 40 12", ".text", 3, 7, 0), signature_notfound },
+		{ makesig("48 83 C4 28 C3", ".pdata", -1, 0, 0), signature_notfound },
+		{ makesig("48 8B 05 ?? ?? ??", ".text", 3, 7, 0), signature_notfound }, // displacement past the end of the signature
+	};
+	for (const expected_signature& exp : expected) {
+		std::string errstr;
+		const uint64_t rva = find_module_signature_rva(image.data(), image.size(), headers, exp.sig, errstr);
+		check(rva == exp.rva, std::string("find_module_signature_rva of \"") + exp.sig.pattern + std::string("\" in ") + exp.sig.section
+			+ std::string(" gave ") + std::to_string(rva) + (errstr.empty() ? std::string() : std::string(": ") + errstr));
+		check((rva == signature_notfound) != errstr.empty(), std::string("error message of \"") + exp.sig.pattern + std::string("\""));
+	}
+
+	// g_camera is referred to twice, the first time after a decoy that only differs after the displacement
+	for (uint64_t target : { 0x3010ull, 0x3100ull, 0x3200ull, 0x2020ull }) {
+		module_signature made;
+		std::string errstr;
+		const bool ok = make_rip_reference_signature(image.data(), image.size(), headers, target, made, errstr)
+			&& find_module_signature_rva(image.data(), image.size(), headers, made, errstr) == target;
+		check(ok, std::string("make_rip_reference_signature for ") + std::to_string(target) + std::string(": \"") + made.pattern + std::string("\" ") + errstr);
+	}
+	module_signature unreferenced;
+	std::string errstr;
+	check(!make_rip_reference_signature(image.data(), image.size(), headers, 0x3300, unreferenced, errstr), "make_rip_reference_signature of an unreferenced global");
+
+	byte_signature bytesig;
+	check(!bytesig.parse("48 8B 5", errstr) && !bytesig.parse("?? ??", errstr) && !bytesig.parse("48 8G", errstr), "byte_signature::parse accepted a bad signature");
+	check(bytesig.parse(" 48  8b ? 05 ", errstr) && bytesig.to_string() == "48 8B ?? 05", "byte_signature::parse of spaces, lowercase and a single ?");
+	std::cout << "sample " << filepath << " checked" << endl;
+}
+
+static void test_file(const std::string& filepath) {
+	std::vector<uint8_t> image;
+	pe_headers headers;
+	if (!load_image(filepath, image, headers)) return;
+	const pe_section* text = headers.find_section(".text");
+	if (text == nullptr || static_cast<uint64_t>(text->rva) + text->virtual_size > image.size() || text->virtual_size < 64u) {
+		check(false, filepath + std::string(" has no .text section"));
+		return;
+	}
+	const uint8_t* code = image.data() + text->rva;
+
+	// the targets of the first RIP-relative movs and leas of 64-bit registers (48 8B/8D, with a mod 00 r/m 101 ModRM byte)
+	uint32_t nmade = 0, nresolved = 0;
+	for (uint64_t ii = 0; ii + 7u <= text->virtual_size && nmade < 50u; ++ii) {
+		if (code[ii] != 0x48 || (code[ii + 1] != 0x8B && code[ii + 1] != 0x8D) || (code[ii + 2] & 0xC7) != 0x05) continue;
+		int32_t disp;
+		std::memcpy(&disp, code + ii + 3, sizeof(disp));
+		const int64_t target = static_cast<int64_t>(text->rva + ii + 7u) + disp;
+		if (target < 0 || static_cast<uint64_t>(target) >= image.size()) continue;
+		module_signature made;
+		std::string errstr;
+		if (!make_rip_reference_signature(image.data(), image.size(), headers, static_cast<uint64_t>(target), made, errstr)) continue;
+		nmade++;
+		const uint64_t rva = find_module_signature_rva(image.data(), image.size(), headers, made, errstr);
+		if (rva == static_cast<uint64_t>(target)) nresolved++;
+		else check(false, filepath + std::string(": made signature \"") + made.pattern + std::string("\" found ") + std::to_string(rva) + std::string(" instead of ") + std::to_string(target));
+	}
+
+	// random signatures cut from the code, some with a last byte that no longer matches, and random wildcards
+	uint32_t lcg = 12345u;
+	auto nextrand = [&]() { lcg = lcg * 1664525u + 1013904223u; return lcg >> 8; };
+	uint32_t nmismatches = 0;
+	for (uint32_t tt = 0; tt < 3000u; ++tt) {
+		const uint64_t offset = nextrand() % (text->virtual_size - 40u);
+		const size_t len = 2u + nextrand() % 20u;
+		byte_signature sig;
+		for (size_t ii = 0; ii < len; ++ii) {
+			sig.bytes.push_back(code[offset + ii]);
+			sig.known.push_back((nextrand() % 4u) != 0u ? 1u : 0u);
+		}
+		if (tt % 3u == 0u) sig.bytes.back() ^= 1u;
+		const uint64_t start = (nextrand() % 2u) ? 0ull : offset / 2u;
+		if (find_byte_signature(code, text->virtual_size, sig, start) != find_by_checking_every_offset(code, text->virtual_size, sig, start)) nmismatches++;
+	}
+	check(nmismatches == 0u, filepath + std::string(": Boyer-Moore-Horspool differs from checking every offset for ") + std::to_string(nmismatches) + std::string(" of 3000 signatures"));
+	std::cout << filepath << ": " << (headers.is_64bit ? "64" : "32") << "-bit, " << headers.sections.size() << " sections, "
+		<< nresolved << " of " << nmade << " made signatures found their reference" << endl;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::cout << "usage: module_signature_test sample_x64.dll [more PE files...]" << endl;
+		return 1;
+	}
+	test_sample(argv[1]);
+	for (int ii = 2; ii < argc; ++ii) test_file(argv[ii]);
+	std::cout << (num_failures == 0 ? std::string("all passed") : std::to_string(num_failures) + std::string(" FAILED")) << endl;
+	return num_failures == 0 ? 0 : 1;
+}
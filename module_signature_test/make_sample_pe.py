@@ -0,0 +1,52 @@
+# Copyright (C) 2023 Jason Bunk
+# Writes sample_x64.dll, the small x64 PE file that module_signature_test checks the signature scanner against:
+# code in .text referring to globals in .data (some past the end of its file data, as zero-initialized globals are)
+# and to a constant in .rdata, with RIP-relative loads, a lea and a movss, and a decoy that differs from a signature in its last byte.
+# The RVAs written here are the ones the test expects.
+import struct
+import os
+
+TEXT_RVA, RDATA_RVA, DATA_RVA = 0x1000, 0x2000, 0x3000
+G_OTHER, G_CAMERA, G_SETTINGS, K_SCALE = 0x3010, 0x3100, 0x3200, 0x2020
+
+code = bytearray()
+def rip(opcode, target, trailing=b''):
+    # opcode bytes, then a disp32 relative to the end of the instruction (which ends right after it)
+    instr_end = TEXT_RVA + len(code) + len(opcode) + 4
+    code.extend(opcode + struct.pack('<i', target - instr_end) + trailing)
+
+code.extend(bytes.fromhex('48 83 EC 28'))                       # sub rsp,28h
+rip(bytes.fromhex('48 8B 05'), G_OTHER, bytes.fromhex('0F 28 40 11'))   # mov rax,[g_other]; movaps xmm0,[rax+11h] (decoy)
+rip(bytes.fromhex('48 8B 05'), G_CAMERA, bytes.fromhex('0F 28 40 10'))  # mov rax,[g_camera]; movaps xmm0,[rax+10h]
+rip(bytes.fromhex('48 8D 0D'), G_SETTINGS, bytes.fromhex('E8 00 00 00 00'))  # lea rcx,[g_settings]; call
+rip(bytes.fromhex('F3 0F 10 05'), K_SCALE, bytes.fromhex('F3 0F 59 C1'))     # movss xmm0,[k_scale]; mulss xmm0,xmm1
+rip(bytes.fromhex('48 8B 0D'), G_CAMERA, bytes.fromhex('48 85 C9'))     # mov rcx,[g_camera]; test rcx,rcx
+code.extend(bytes.fromhex('48 83 C4 28 C3'))                     # add rsp,28h; ret
+text = bytes(code).ljust(0x200, b'\xCC')
+rdata = bytearray(0x200)
+struct.pack_into('<f', rdata, K_SCALE - RDATA_RVA, 0.5)
+data = bytes(0x200)
+
+# name, rva, virtual size, file offset, file size, characteristics
+sections = [
+    (b'.text', TEXT_RVA, len(code), 0x400, 0x200, 0x60000020),
+    (b'.rdata', RDATA_RVA, 0x40, 0x600, 0x200, 0x40000040),
+    (b'.data', DATA_RVA, 0x400, 0x800, 0x200, 0xC0000040),
+]
+headers = bytearray(0x400)
+headers[0:2] = b'MZ'
+struct.pack_into('<I', headers, 0x3C, 0x80)
+headers[0x80:0x84] = b'PE\0\0'
+struct.pack_into('<HHIIIHH', headers, 0x84, 0x8664, len(sections), 0, 0, 0, 240, 0x2022)  # x64 dll
+opt = 0x98
+struct.pack_into('<HBBIIIII', headers, opt, 0x20B, 14, 0, 0x200, 0x400, 0x200, TEXT_RVA, TEXT_RVA)
+struct.pack_into('<QII', headers, opt + 24, 0x180000000, 0x1000, 0x200)  # image base, section and file alignment
+struct.pack_into('<HH', headers, opt + 48, 6, 0)  # subsystem version
+struct.pack_into('<III', headers, opt + 56, 0x4000, 0x400, 0)  # size of image, size of headers, checksum
+struct.pack_into('<HH', headers, opt + 68, 2, 0x160)  # GUI subsystem, dll characteristics
+struct.pack_into('<I', headers, opt + 108, 16)  # number of data directories
+for ss, (name, rva, vsize, fileoff, filesize, chars) in enumerate(sections):
+    struct.pack_into('<8sIIII12xI', headers, opt + 240 + 40 * ss, name, vsize, rva, filesize, fileoff, chars)
+
+with open(os.path.join(os.path.dirname(os.path.abspath(__file__)), 'sample_x64.dll'), 'wb') as outfile:
+    outfile.write(bytes(headers) + text + bytes(rdata) + data)
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+# Copyright (C) 2023 Jason Bunk
+import os
+import argparse
+import json
+import numpy as np
+
+# Reads the "*_cocorle.json" masks saved alongside segmentation captures (if enabled in the addon's overlay).
+# Each segment is one color (key r + 256*g + 65536*b, as in load_colormaps.py) or one value (class or instance ID) of the image,
+# with "area", "bbox" [x,y,w,h], and "segmentation" as a compressed COCO RLE, which pycocotools.mask.decode() also reads.
+# Encoded by gcv_utils/coco_rle.hpp; this is the inverse of coco_rle_counts_to_string() there.
+
+
+def coco_rle_string_to_counts(rlestr:str):
+  counts = []
+  pos = 0
+  while pos < len(rlestr):
+    val = 0
+    shift = 0
+    more = True
+    while more:
+      ch = ord(rlestr[pos]) - 48
+      val |= (ch & 0x1f) << shift
+      more = bool(ch & 0x20)
+      pos += 1
+      shift += 5
+      if not more and (ch & 0x10):
+        val |= -1 << shift
+    if len(counts) > 2:
+      val += counts[-2]
+    counts.append(val)
+  return counts
+
+
+def decode_coco_rle_mask(segmentation:dict):
+  """ returns HxW bool mask """
+  height, width = segmentation['size']
+  counts = segmentation['counts']
+  if isinstance(counts, str):
+    counts = coco_rle_string_to_counts(counts)
+  flat = np.zeros(height * width, dtype=bool)
+  ends = np.cumsum(counts)
+  starts = ends - np.asarray(counts)
+  for ss, ee in zip(starts[1::2], ends[1::2]):
+    flat[ss:ee] = True
+  return flat.reshape((width, height)).T
+
+
+def load_coco_rle(filepath:str):
+  with open(filepath,'r') as infile:
+    return json.load(infile)
+
+
+def coco_rle_file_from_meta_json(metajsonfile:str):
+  with open(metajsonfile,'r') as infile:
+    metaj = json.load(infile)
+  assert 'semseg_coco_rle_file' in metaj, f"{metajsonfile} doesn't reference a COCO RLE file"
+  return os.path.join(os.path.dirname(metajsonfile), metaj['semseg_coco_rle_file'])
+
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser()
+  parser.add_argument('cocorle_or_meta_json', type=str)
+  args = parser.parse_args()
+  rlefile = args.cocorle_or_meta_json
+  if not rlefile.endswith('_cocorle.json'):
+    rlefile = coco_rle_file_from_meta_json(rlefile)
+  rles = load_coco_rle(rlefile)
+  print(f"{rlefile}: {rles['width']}x{rles['height']}, {len(rles['segments'])} segments keyed by {rles['key']}")
+  for seg in rles['segments']:
+    assert int(decode_coco_rle_mask(seg['segmentation']).sum()) == int(seg['area'])
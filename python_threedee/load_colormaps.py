@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+# Copyright (C) 2023 Jason Bunk
+import os
+import argparse
+import json
+import numpy as np
+
+# Reads the binary "*_colormaps.bin" saved alongside each segmentation capture,
+# which explains the colors in "*_semseg.png" and "*_trireg.png":
+#   "seg": color -> (num vertices, vertex shader hash, pixel shader hash)
+#   "tri": color -> (num vertices, vertex shader hash, pixel shader hash, draw instance ID, primitive ID)
+# Format is documented in segmentation/buffer_indexing_colorization.cpp
+
+COLORMAPS_MAGIC = b'GCVCMAP\x00'
+COLORMAPS_VERSION = 1
+
+
+def load_colormaps(filepath:str):
+  """ returns dict: table name -> (sorted uint32 color keys of shape [N], uint64 records of shape [N,K]) """
+  with open(filepath,'rb') as infile:
+    buf = infile.read()
+  assert buf[:8] == COLORMAPS_MAGIC, f"{filepath} is not a colormaps file"
+  version, num_tables = np.frombuffer(buf, dtype='<u4', count=2, offset=8)
+  assert int(version) == COLORMAPS_VERSION, f"unsupported colormaps version {version} in {filepath}"
+  tables = {}
+  pos = 16
+  for _ in range(int(num_tables)):
+    name = buf[pos:pos+8].rstrip(b'\x00').decode('ascii')
+    num_entries, num_u64 = [int(vv) for vv in np.frombuffer(buf, dtype='<u4', count=2, offset=pos+8)]
+    pos += 16
+    keys = np.frombuffer(buf, dtype='<u4', count=num_entries, offset=pos)
+    pos += ((4 * num_entries + 7) // 8) * 8
+    records = np.frombuffer(buf, dtype='<u8', count=num_entries*num_u64, offset=pos).reshape((num_entries, num_u64))
+    pos += 8 * num_entries * num_u64
+    tables[name] = (keys, records)
+  return tables
+
+
+def colormaps_file_from_meta_json(metajsonfile:str):
+  with open(metajsonfile,'r') as infile:
+    metaj = json.load(infile)
+  assert 'seg_tri_colormaps_file' in metaj, f"{metajsonfile} doesn't reference a colormaps file"
+  return os.path.join(os.path.dirname(metajsonfile), metaj['seg_tri_colormaps_file'])
+
+
+def rgb_image_to_color_keys(rgb:np.ndarray):
+  assert len(rgb.shape) == 3 and int(rgb.shape[2]) >= 3, str(rgb.shape)
+  rgb = rgb.astype(np.uint32)
+  return rgb[:,:,0] + 256 * rgb[:,:,1] + 65536 * rgb[:,:,2]
+
+
+def lookup_records_for_image(table, rgb:np.ndarray):
+  """ given one table from load_colormaps() and its png (HxWx3), returns per-pixel records (HxWxK); unknown colors get all zeros """
+  keys, records = table
+  colorkeys = rgb_image_to_color_keys(rgb)
+  idx = np.clip(np.searchsorted(keys, colorkeys), 0, max(0, len(keys) - 1))
+  found = (keys[idx] == colorkeys) if len(keys) > 0 else np.zeros(colorkeys.shape, dtype=bool)
+  out = np.zeros(colorkeys.shape + (records.shape[1],), dtype=np.uint64)
+  out[found] = records[idx[found]]
+  return out
+
+
+def colormap_table_as_hexcolor_dict(table):
+  """ same as the "seg_hexcolor2meta" / "tri_hexcolor2meta" dicts that used to be saved in the meta json """
+  keys, records = table
+  return {f"{int(kk)&255:02x}{(int(kk)>>8)&255:02x}{(int(kk)>>16)&255:02x}": [int(vv) for vv in rec] for kk, rec in zip(keys, records)}
+
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser()
+  parser.add_argument('colormaps_or_meta_json', type=str)
+  parser.add_argument('--to_json', type=str, default='', help='optionally convert to the old json dicts')
+  args = parser.parse_args()
+  cmapfile = args.colormaps_or_meta_json
+  if cmapfile.endswith('.json'):
+    cmapfile = colormaps_file_from_meta_json(cmapfile)
+  tables = load_colormaps(cmapfile)
+  for name, (keys, records) in tables.items():
+    print(f"{name}: {len(keys)} colors, records of {records.shape[1]} uint64")
+  if args.to_json:
+    with open(args.to_json,'w') as outfile:
+      json.dump({f"{name}_hexcolor2meta": colormap_table_as_hexcolor_dict(tab) for name, tab in tables.items()}, outfile)
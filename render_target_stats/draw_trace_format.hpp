@@ -0,0 +1,51 @@
+#pragma once
+// Copyright (C) 2023 Jason Bunk
+#include <cstdint>
+
+/*
+* File format of draw call traces: a header, then fixed-size records.
+* Records are appended in the order they are drained from the per-thread buffers,
+* so they are only ordered in time within each thread; readers should sort by timestamp.
+* Has no dependencies, so that the offline reader (draw_trace_reader) can be built anywhere.
+*/
+enum DrawTraceRecordType : uint8_t {
+	DrawTrace_Draw = 0,
+	DrawTrace_DrawIndexed,
+	DrawTrace_DrawIndirect, // vertices is 0 (unknown), instances is the draw count
+	DrawTrace_Present, // end of a frame; only frameidx, timestamp and thread_id are set
+	DrawTrace_number_of_types,
+};
+constexpr const char* DrawTraceRecordTypeNames[] = {
+	"draw",
+	"draw_indexed",
+	"draw_indirect",
+	"present",
+};
+
+struct draw_trace_record {
+	uint64_t timestamp_ns = 0; // steady clock
+	uint64_t cmdlist = 0;
+	uint64_t rtv0 = 0; // render target view bound to slot 0
+	uint64_t rt0_resource = 0; // its resource, as listed in the overlay
+	uint64_t dsv = 0;
+	uint64_t pipeline_vs = 0; // pipelines bound for the vertex and pixel stages (0 if not bound since tracing started)
+	uint64_t pipeline_ps = 0;
+	uint32_t frameidx = 0;
+	uint32_t thread_id = 0;
+	uint32_t vertices = 0; // per instance (indices, for indexed draws)
+	uint32_t instances = 0;
+	uint8_t type = DrawTrace_Draw;
+	uint8_t num_rtvs = 0;
+	uint8_t reserved[6] = {};
+};
+static_assert(sizeof(draw_trace_record) == 80, "trace records are written to disk as is");
+
+struct draw_trace_file_header {
+	char magic[8] = { 'G', 'C', 'V', 'D', 'T', 'R', 'C', '1' };
+	uint32_t version = 1;
+	uint32_t record_size = sizeof(draw_trace_record);
+	uint64_t num_records = 0; // kept up to date while recording, so a trace is readable even if the game exited without stopping it
+	uint64_t num_dropped = 0; // records lost because a thread's buffer was full
+	uint8_t reserved[32] = {};
+};
+static_assert(sizeof(draw_trace_file_header) == 64, "the trace file header is written to disk as is");
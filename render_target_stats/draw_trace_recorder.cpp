@@ -0,0 +1,181 @@
+// Copyright (C) 2023 Jason Bunk
+#include "draw_trace_recorder.hpp"
+#include "gcv_utils/miscutils.h"
+#include <Windows.h>
+#include <cstring>
+#include <chrono>
+
+draw_trace_recorder& draw_trace_recorder::get() {
+	static draw_trace_recorder recorder;
+	return recorder;
+}
+
+draw_trace_recorder::~draw_trace_recorder() {
+	stop();
+}
+
+draw_trace_recorder::thread_ring* draw_trace_recorder::register_this_thread() {
+	std::unique_ptr<thread_ring> ring = std::make_unique<thread_ring>();
+	ring->thread_id = static_cast<uint32_t>(GetCurrentThreadId());
+	ring->records = std::make_unique<draw_trace_record[]>(ring_capacity);
+	std::lock_guard<std::mutex> lock(rings_mut);
+	rings.push_back(std::move(ring));
+	return rings.back().get();
+}
+
+bool draw_trace_recorder::map_file(uint64_t capacity) {
+	if (mapped != nullptr) {
+		FlushViewOfFile(mapped, 0);
+		UnmapViewOfFile(mapped);
+		mapped = nullptr;
+	}
+	if (mapping_handle != nullptr) {
+		CloseHandle(mapping_handle);
+		mapping_handle = nullptr;
+	}
+	mapped_capacity = 0;
+	// mapping more than the file's size extends the file (with zeros)
+	mapping_handle = CreateFileMappingW(file_handle, nullptr, PAGE_READWRITE,
+		static_cast<DWORD>(capacity >> 32), static_cast<DWORD>(capacity & 0xFFFFFFFFull), nullptr);
+	if (mapping_handle == nullptr) return false;
+	mapped = static_cast<uint8_t*>(MapViewOfFile(mapping_handle, FILE_MAP_WRITE, 0, 0, static_cast<SIZE_T>(capacity)));
+	if (mapped == nullptr) {
+		CloseHandle(mapping_handle);
+		mapping_handle = nullptr;
+		return false;
+	}
+	mapped_capacity = capacity;
+	return true;
+}
+
+void draw_trace_recorder::close_file(uint64_t final_size) {
+	if (mapped != nullptr) {
+		FlushViewOfFile(mapped, 0);
+		UnmapViewOfFile(mapped);
+		mapped = nullptr;
+	}
+	if (mapping_handle != nullptr) {
+		CloseHandle(mapping_handle);
+		mapping_handle = nullptr;
+	}
+	mapped_capacity = 0;
+	if (file_handle != nullptr) {
+		// cut off the unused end of the last mapping
+		LARGE_INTEGER endpos;
+		endpos.QuadPart = static_cast<LONGLONG>(final_size);
+		if (SetFilePointerEx(file_handle, endpos, nullptr, FILE_BEGIN)) SetEndOfFile(file_handle);
+		CloseHandle(file_handle);
+		file_handle = nullptr;
+	}
+}
+
+bool draw_trace_recorder::start(const std::string& filepath_, std::string& errstr) {
+	if (is_recording()) {
+		errstr = "already recording a draw trace";
+		return false;
+	}
+	if (drain_thread.joinable()) drain_thread.join(); // it may have stopped by itself after an error
+	close_file(0);
+	const std::wstring wpath = wstring_from_string(filepath_);
+	HANDLE hfile = CreateFileW(wpath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hfile == INVALID_HANDLE_VALUE) {
+		errstr = std::string("failed to create draw trace file ") + filepath_;
+		return false;
+	}
+	file_handle = hfile;
+	if (!map_file(initial_file_capacity)) {
+		close_file(0);
+		errstr = std::string("failed to map draw trace file ") + filepath_;
+		return false;
+	}
+	const draw_trace_file_header header;
+	std::memcpy(mapped, &header, sizeof(header));
+	{
+		// drop anything recorded by stragglers after the previous trace stopped
+		std::lock_guard<std::mutex> lock(rings_mut);
+		for (std::unique_ptr<thread_ring>& ring : rings) ring->tail.store(ring->head.load(std::memory_order_acquire), std::memory_order_release);
+	}
+	{
+		std::lock_guard<std::mutex> lock(status_mut);
+		filepath = filepath_;
+		error.clear();
+	}
+	num_dropped = 0ull;
+	num_written = 0ull;
+	frameidx = 0u;
+	recording = true;
+	drain_thread = std::thread(&draw_trace_recorder::drain_loop, this);
+	return true;
+}
+
+void draw_trace_recorder::stop() {
+	recording = false;
+	if (drain_thread.joinable()) drain_thread.join();
+}
+
+draw_trace_recorder::status draw_trace_recorder::get_status() {
+	status st;
+	st.recording = is_recording();
+	st.num_records = num_written.load(std::memory_order_relaxed);
+	st.num_dropped = num_dropped.load(std::memory_order_relaxed);
+	st.file_bytes = sizeof(draw_trace_file_header) + st.num_records * sizeof(draw_trace_record);
+	std::lock_guard<std::mutex> lock(status_mut);
+	st.filepath = filepath;
+	st.error = error;
+	return st;
+}
+
+size_t draw_trace_recorder::drain_once() {
+	size_t drained = 0;
+	uint64_t written = num_written.load(std::memory_order_relaxed);
+	{
+		// rings are never removed, so they can be drained after the lock is released,
+		// without holding up threads registering their first draw while the file is remapped
+		std::lock_guard<std::mutex> lock(rings_mut);
+		rings_to_drain.clear();
+		for (std::unique_ptr<thread_ring>& ring : rings) rings_to_drain.push_back(ring.get());
+	}
+	for (thread_ring* ring : rings_to_drain) {
+		const uint32_t head = ring->head.load(std::memory_order_acquire);
+		const uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+		const uint32_t count = head - tail;
+		if (count == 0) continue;
+		const uint64_t needed = sizeof(draw_trace_file_header) + (written + count) * sizeof(draw_trace_record);
+		if (needed > mapped_capacity) {
+			uint64_t newcapacity = mapped_capacity;
+			while (newcapacity < needed) newcapacity *= 2ull;
+			if (!map_file(newcapacity)) {
+				std::lock_guard<std::mutex> slock(status_mut);
+				error = std::string("failed to grow the draw trace file to ") + std::to_string(newcapacity >> 20) + std::string(" MB");
+				recording = false;
+				return drained;
+			}
+		}
+		// the ring's records may wrap around its end
+		uint8_t* dst = mapped + sizeof(draw_trace_file_header) + written * sizeof(draw_trace_record);
+		const uint32_t first = tail & (ring_capacity - 1u);
+		const uint32_t firstcount = (count < ring_capacity - first) ? count : (ring_capacity - first);
+		std::memcpy(dst, &ring->records[first], firstcount * sizeof(draw_trace_record));
+		if (firstcount < count) std::memcpy(dst + firstcount * sizeof(draw_trace_record), &ring->records[0], (count - firstcount) * sizeof(draw_trace_record));
+		ring->tail.store(head, std::memory_order_release);
+		written += count;
+		drained += count;
+		// counted as soon as they are copied, so that if a later ring's remap fails, these are still kept (map_file flushes the old view first)
+		draw_trace_file_header* header = reinterpret_cast<draw_trace_file_header*>(mapped);
+		header->num_records = written;
+		header->num_dropped = num_dropped.load(std::memory_order_relaxed);
+		num_written.store(written, std::memory_order_relaxed);
+	}
+	return drained;
+}
+
+void draw_trace_recorder::drain_loop() {
+	while (recording.load(std::memory_order_relaxed)) {
+		if (drain_once() == 0) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	if (mapped != nullptr) {
+		drain_once(); // whatever was recorded before stopping
+		reinterpret_cast<draw_trace_file_header*>(mapped)->num_dropped = num_dropped.load(std::memory_order_relaxed);
+	}
+	close_file(sizeof(draw_trace_file_header) + num_written.load(std::memory_order_relaxed) * sizeof(draw_trace_record));
+}
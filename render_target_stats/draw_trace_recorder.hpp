@@ -0,0 +1,93 @@
+#pragma once
+// Copyright (C) 2023 Jason Bunk
+#include "draw_trace_format.hpp"
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <string>
+
+/*
+* Optional trace of every draw, for finding out offline which passes are drawn (and intercepted) without a GPU debugger.
+* Draw hooks append records to a lock-free ring buffer owned by their thread (it is the only producer, the drain thread the only consumer).
+* A background thread drains the rings into a memory-mapped file, which is grown as needed.
+* When a ring is full, records are dropped (and counted) rather than making the render thread wait.
+* Rings are registered on a thread's first record and live as long as the recorder, so they are reused across traces.
+*/
+class draw_trace_recorder {
+public:
+	static constexpr uint32_t ring_capacity = 1u << 14; // records per thread, power of 2
+	static constexpr uint64_t initial_file_capacity = 64ull << 20;
+
+	struct status {
+		bool recording = false;
+		uint64_t num_records = 0;
+		uint64_t num_dropped = 0;
+		uint64_t file_bytes = 0;
+		std::string filepath;
+		std::string error; // why the last trace stopped early, if it did
+	};
+
+	static draw_trace_recorder& get();
+	~draw_trace_recorder();
+
+	bool start(const std::string& filepath, std::string& errstr);
+	void stop();
+	inline bool is_recording() const { return recording.load(std::memory_order_relaxed); }
+	status get_status();
+
+	inline uint32_t frame() const { return frameidx.load(std::memory_order_relaxed); }
+	inline void next_frame() { frameidx.fetch_add(1u, std::memory_order_relaxed); }
+
+	// called from draw hooks on any thread
+	inline void record(const draw_trace_record& rec) {
+		thread_ring* const ring = this_thread_ring();
+		const uint32_t head = ring->head.load(std::memory_order_relaxed);
+		if (head - ring->tail.load(std::memory_order_acquire) >= ring_capacity) {
+			num_dropped.fetch_add(1ull, std::memory_order_relaxed);
+			return;
+		}
+		draw_trace_record& dst = ring->records[head & (ring_capacity - 1u)];
+		dst = rec;
+		dst.thread_id = ring->thread_id;
+		ring->head.store(head + 1u, std::memory_order_release);
+	}
+
+private:
+	struct thread_ring {
+		alignas(64) std::atomic<uint32_t> head = { 0u }; // written by the producer
+		alignas(64) std::atomic<uint32_t> tail = { 0u }; // written by the drain thread
+		uint32_t thread_id = 0;
+		std::unique_ptr<draw_trace_record[]> records;
+	};
+	std::mutex rings_mut; // held to register a ring, and to list the rings for draining (not while draining, which may remap the file)
+	std::vector<std::unique_ptr<thread_ring>> rings;
+	std::vector<thread_ring*> rings_to_drain; // used only by the drain thread
+
+	std::atomic<bool> recording = { false };
+	std::atomic<uint32_t> frameidx = { 0u };
+	std::atomic<uint64_t> num_dropped = { 0ull };
+	std::atomic<uint64_t> num_written = { 0ull };
+	std::thread drain_thread;
+
+	// the trace file, written only by the drain thread while recording
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+	uint8_t* mapped = nullptr;
+	uint64_t mapped_capacity = 0;
+	std::mutex status_mut;
+	std::string filepath;
+	std::string error;
+
+	inline thread_ring* this_thread_ring() {
+		static thread_local thread_ring* ring = nullptr;
+		if (ring == nullptr) ring = register_this_thread();
+		return ring;
+	}
+	thread_ring* register_this_thread();
+	bool map_file(uint64_t capacity);
+	void close_file(uint64_t final_size);
+	size_t drain_once();
+	void drain_loop();
+};
@@ -0,0 +1,122 @@
+#pragma once
+// Copyright (C) 2023 Jason Bunk
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+/*
+* Open-addressing (linear probing) hash map keyed by non-null resource handles, stored in one flat array.
+* Erasing shifts later entries of the probe chain back, so there are no tombstones,
+* and clear() keeps the capacity, so a map that is cleared and refilled every frame doesn't allocate.
+*/
+template<typename ValueT>
+class flat_handle_map {
+	static constexpr uint64_t empty_key = 0ull; // handles are never null
+	static constexpr size_t min_capacity = 16;
+
+	struct slot {
+		uint64_t key = empty_key;
+		ValueT value = {};
+	};
+	std::vector<slot> slots;
+	size_t num_live = 0;
+
+	static inline size_t mix_handle(uint64_t h) {
+		// splitmix64 finalizer: handles are pointers, so the low bits are mostly alignment
+		h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ull;
+		h ^= h >> 27; h *= 0x94d049bb133111ebull;
+		h ^= h >> 31;
+		return static_cast<size_t>(h);
+	}
+	void rehash(size_t newcapacity) {
+		std::vector<slot> old(newcapacity);
+		old.swap(slots);
+		const size_t mask = newcapacity - 1;
+		for (slot& os : old) {
+			if (os.key == empty_key) continue;
+			size_t ii = mix_handle(os.key) & mask;
+			while (slots[ii].key != empty_key) ii = (ii + 1) & mask;
+			slots[ii].key = os.key;
+			slots[ii].value = std::move(os.value);
+		}
+	}
+	// index of the slot holding key, or slots.size() if not present
+	size_t find_slot(uint64_t key) const {
+		if (slots.empty()) return 0;
+		const size_t mask = slots.size() - 1;
+		for (size_t ii = mix_handle(key) & mask; ; ii = (ii + 1) & mask) {
+			if (slots[ii].key == key) return ii;
+			if (slots[ii].key == empty_key) return slots.size();
+		}
+	}
+public:
+	inline size_t size() const { return num_live; }
+	inline bool empty() const { return num_live == 0; }
+
+	// inserts a value-initialized entry if not present
+	ValueT& operator[](uint64_t key) {
+		if ((num_live + 1) * 4 > slots.size() * 3) rehash(slots.empty() ? min_capacity : slots.size() * 2);
+		const size_t mask = slots.size() - 1;
+		size_t ii = mix_handle(key) & mask;
+		while (slots[ii].key != key) {
+			if (slots[ii].key == empty_key) {
+				slots[ii].key = key;
+				slots[ii].value = ValueT{};
+				num_live++;
+				break;
+			}
+			ii = (ii + 1) & mask;
+		}
+		return slots[ii].value;
+	}
+	const ValueT* find(uint64_t key) const {
+		const size_t ii = find_slot(key);
+		return ii < slots.size() ? &slots[ii].value : nullptr;
+	}
+	inline bool contains(uint64_t key) const { return find_slot(key) < slots.size(); }
+
+	bool erase(uint64_t key) {
+		size_t hole = find_slot(key);
+		if (hole >= slots.size()) return false;
+		const size_t mask = slots.size() - 1;
+		// move back any later entry of the chain that may not sit between its home slot and the hole
+		for (size_t ii = (hole + 1) & mask; slots[ii].key != empty_key; ii = (ii + 1) & mask) {
+			const size_t home = mix_handle(slots[ii].key) & mask;
+			if (((ii - home) & mask) >= ((ii - hole) & mask)) {
+				slots[hole].key = slots[ii].key;
+				slots[hole].value = std::move(slots[ii].value);
+				hole = ii;
+			}
+		}
+		slots[hole].key = empty_key;
+		num_live--;
+		return true;
+	}
+	void clear() {
+		if (num_live == 0) return;
+		for (slot& ss : slots) ss.key = empty_key;
+		num_live = 0;
+	}
+	void swap(flat_handle_map& other) {
+		slots.swap(other.slots);
+		std::swap(num_live, other.num_live);
+	}
+
+	// fn(uint64_t key, ValueT& value), in no particular order
+	template<typename FnT>
+	void for_each(const FnT& fn) {
+		for (slot& ss : slots) if (ss.key != empty_key) fn(ss.key, ss.value);
+	}
+	template<typename FnT>
+	void for_each(const FnT& fn) const {
+		for (const slot& ss : slots) if (ss.key != empty_key) fn(ss.key, ss.value);
+	}
+	// removes the entries for which pred(key, value) is true
+	template<typename PredT>
+	void erase_if(const PredT& pred) {
+		std::vector<uint64_t> doomed;
+		for_each([&](uint64_t key, const ValueT& value) { if (pred(key, value)) doomed.push_back(key); });
+		for (uint64_t key : doomed) erase(key);
+	}
+};
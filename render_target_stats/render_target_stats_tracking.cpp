@@ -5,6 +5,10 @@
 #include "reshade_tex_format_info.hpp"
 #include "render_target_stats_tracking.hpp"
 #include "clicked_rgb_rendertargets.hpp"
+#include "draw_trace_recorder.hpp"
+#include "gcv_utils/hook_activity.hpp"
+#include <algorithm>
+#include <chrono>
 using namespace reshade::api;
 
 static void on_device_init(device* device) {
@@ -34,6 +38,12 @@ static void on_destroy_command_queue(command_queue* cmd_queue) {
 	if(std::find(device_data.queues.begin(), device_data.queues.end(), cmd_queue) != device_data.queues.end())
 		device_data.queues.erase(std::remove(device_data.queues.begin(), device_data.queues.end(), cmd_queue), device_data.queues.end());
 }
+static void on_init_resource(device* device, const resource_desc& desc, const subresource_data*, resource_usage, resource rsc) {
+	device->get_private_data<device_draw_stats>().desc_cache.on_init_resource(desc, rsc);
+}
+static void on_destroy_resource(device* device, resource rsc) {
+	device->get_private_data<device_draw_stats>().desc_cache.on_destroy_resource(rsc);
+}
 static void on_reset_cmdlist(command_list *cmd_list) {
 	auto &state = cmd_list->get_private_data<cmdlist_draw_stats>();
 	state.reset_stats();
@@ -43,6 +53,7 @@ static void on_execute_primary(command_queue *queue, command_list *cmd_list) {
 	if(queue != nullptr && cmd_list != nullptr) {
 		auto& target_state = queue->get_private_data<queue_draw_stats>();
 		auto& source_state = cmd_list->get_private_data<cmdlist_draw_stats>();
+		source_state.fold_pending_stats();
 		target_state.merge(source_state);
 	}
 }
@@ -50,62 +61,113 @@ static void on_execute_secondary(command_list *cmd_list, command_list *secondary
 	if (cmd_list != nullptr && secondary_cmd_list != nullptr) {
 		auto& target_state = cmd_list->get_private_data<cmdlist_draw_stats>();
 		auto& source_state = secondary_cmd_list->get_private_data<cmdlist_draw_stats>();
+		target_state.fold_pending_stats();
+		source_state.fold_pending_stats();
 		target_state.merge(source_state);
 	}
 }
 
 static void on_bind_render_targets_and_depth_stencil(command_list* cmd_list, uint32_t count, const resource_view* rtvs, resource_view dsv) {
-	auto &state = cmd_list->get_private_data<cmdlist_draw_stats>();
-	state.render_targets.assign(rtvs, rtvs + count);
-	state.depth_stencil = dsv;
+	cmd_list->get_private_data<cmdlist_draw_stats>().bind_render_targets(count, rtvs, dsv);
+}
+static void on_bind_pipeline(command_list* cmd_list, pipeline_stage stages, pipeline pipeline) {
+	if (!hook_activity_enabled(HookFeature_DrawTrace)) return;
+	auto& cmd_stat = cmd_list->get_private_data<cmdlist_draw_stats>();
+	if ((static_cast<uint32_t>(stages) & static_cast<uint32_t>(pipeline_stage::vertex_shader)) != 0) cmd_stat.bound_pipeline_vs = pipeline.handle;
+	if ((static_cast<uint32_t>(stages) & static_cast<uint32_t>(pipeline_stage::pixel_shader)) != 0) cmd_stat.bound_pipeline_ps = pipeline.handle;
 }
 
 template<bool is_direct>
 bool rstats_on_draw_plain_or_indexed(command_list* cmd_list, uint32_t vertices_per_instance, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance) {
-	device* const device = cmd_list->get_device();
-	const auto& mapp = device->get_private_data<device_draw_stats>();
-	if (mapp.render_height > 0 && mapp.render_width > 0) {
-		auto& cmd_stat = cmd_list->get_private_data<cmdlist_draw_stats>();
-		if (!cmd_stat.render_targets.empty() && cmd_stat.render_targets[0].handle != 0ull) {
-			const resource rhndl = device->get_resource_from_view(cmd_stat.render_targets[0]);
-			if (rhndl.handle != 0ull) {
-				const resource_desc rdesc = device->get_resource_desc(rhndl);
-				if (rdesc.texture.width == mapp.render_width && rdesc.texture.height == mapp.render_height) {
-					std::lock_guard<std::mutex> guard(cmd_stat.statsmut);
-					rsc_stats& rst = cmd_stat.resource2stats[rhndl.handle];
-					if (rst.num_command_lists_which_touched == 0) {
-						rst.num_command_lists_which_touched = 1;
-					}
-					rst.total_vertices += vertices_per_instance * instance_count;
-					rst.max_num_rtvsbound = std::max<uint64_t>(rst.max_num_rtvsbound, cmd_stat.render_targets.size());
-					if (is_direct) {
-						rst.total_draws++;
-					} else {
-						rst.total_draws += instance_count;
-						rst.num_indirect_draws += instance_count;
-					}
-				}
-			}
+	if (!hook_activity_enabled(HookFeature_RenderTargetStats)) return false;
+	auto& cmd_stat = cmd_list->get_private_data<cmdlist_draw_stats>();
+	if (!cmd_stat.rt0_resolved) cmd_stat.resolve_rt0(cmd_list->get_device());
+	if (cmd_stat.rt0_resource == 0ull || cmd_stat.device_stats->render_width == 0 || cmd_stat.device_stats->render_height == 0) return false;
+	if (cmd_stat.rt0_width == cmd_stat.device_stats->render_width && cmd_stat.rt0_height == cmd_stat.device_stats->render_height) {
+		rsc_stats& rst = cmd_stat.pending_stats_of_rt0();
+		rst.total_vertices += vertices_per_instance * instance_count;
+		rst.max_num_rtvsbound = std::max<uint64_t>(rst.max_num_rtvsbound, cmd_stat.render_targets.size());
+		if (is_direct) {
+			rst.total_draws++;
+		} else {
+			rst.total_draws += instance_count;
+			rst.num_indirect_draws += instance_count;
 		}
 	}
 	return false;
 }
 static bool on_draw(command_list* cmd_list, uint32_t vertices, uint32_t instances, uint32_t first_vertex, uint32_t first_instance) {
+	const hook_cost_sample costsample(HookFeature_RenderTargetStats);
 	return rstats_on_draw_plain_or_indexed<true>(cmd_list, vertices, instances, first_vertex, 0, first_instance);
 }
 static bool on_draw_indexed(command_list* cmd_list, uint32_t vertices_per_instance, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance) {
+	const hook_cost_sample costsample(HookFeature_RenderTargetStats);
 	return rstats_on_draw_plain_or_indexed<true>(cmd_list, vertices_per_instance, instance_count, first_index, vertex_offset, first_instance);
 }
 static bool on_draw_or_dispatch_indirect(command_list* cmd_list, indirect_command type, resource buffer, uint64_t offset, uint32_t draw_count, uint32_t stride) {
 	if (type == indirect_command::dispatch) return false;
+	const hook_cost_sample costsample(HookFeature_RenderTargetStats);
 	return rstats_on_draw_plain_or_indexed<false>(cmd_list, 3, draw_count, 0, 0, 0);
 }
 
+static inline uint64_t draw_trace_timestamp_ns() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+// registered separately from the stats hooks (ReShade calls both), so that their costs are measured separately
+template<DrawTraceRecordType drawtype>
+bool trace_on_draw(command_list* cmd_list, uint32_t vertices_per_instance, uint32_t instance_count) {
+	if (!hook_activity_enabled(HookFeature_DrawTrace)) return false;
+	auto& cmd_stat = cmd_list->get_private_data<cmdlist_draw_stats>();
+	if (!cmd_stat.rt0_resolved) cmd_stat.resolve_rt0(cmd_list->get_device());
+	draw_trace_record rec;
+	rec.timestamp_ns = draw_trace_timestamp_ns();
+	rec.cmdlist = reinterpret_cast<uint64_t>(cmd_list);
+	rec.rtv0 = cmd_stat.render_targets.empty() ? 0ull : cmd_stat.render_targets[0].handle;
+	rec.rt0_resource = cmd_stat.rt0_resource;
+	rec.dsv = cmd_stat.depth_stencil.handle;
+	rec.pipeline_vs = cmd_stat.bound_pipeline_vs;
+	rec.pipeline_ps = cmd_stat.bound_pipeline_ps;
+	draw_trace_recorder& recorder = draw_trace_recorder::get();
+	rec.frameidx = recorder.frame();
+	rec.vertices = vertices_per_instance;
+	rec.instances = instance_count;
+	rec.type = drawtype;
+	rec.num_rtvs = static_cast<uint8_t>(std::min<size_t>(cmd_stat.render_targets.size(), 255));
+	recorder.record(rec);
+	return false;
+}
+static bool trace_on_draw_plain(command_list* cmd_list, uint32_t vertices, uint32_t instances, uint32_t, uint32_t) {
+	const hook_cost_sample costsample(HookFeature_DrawTrace);
+	return trace_on_draw<DrawTrace_Draw>(cmd_list, vertices, instances);
+}
+static bool trace_on_draw_indexed(command_list* cmd_list, uint32_t vertices_per_instance, uint32_t instance_count, uint32_t, int32_t, uint32_t) {
+	const hook_cost_sample costsample(HookFeature_DrawTrace);
+	return trace_on_draw<DrawTrace_DrawIndexed>(cmd_list, vertices_per_instance, instance_count);
+}
+static bool trace_on_draw_or_dispatch_indirect(command_list* cmd_list, indirect_command type, resource, uint64_t, uint32_t draw_count, uint32_t) {
+	if (type == indirect_command::dispatch) return false;
+	const hook_cost_sample costsample(HookFeature_DrawTrace);
+	return trace_on_draw<DrawTrace_DrawIndirect>(cmd_list, 0, draw_count);
+}
+
 static void on_present(command_queue*, swapchain* swapchain, const rect*, const rect*, uint32_t, const rect*) {
+	if (hook_activity_enabled(HookFeature_DrawTrace)) {
+		draw_trace_recorder& recorder = draw_trace_recorder::get();
+		if (recorder.is_recording()) {
+			draw_trace_record rec;
+			rec.timestamp_ns = draw_trace_timestamp_ns();
+			rec.frameidx = recorder.frame();
+			rec.type = DrawTrace_Present;
+			recorder.record(rec);
+			recorder.next_frame();
+		} else {
+			hook_activity_publish(0u, hook_activity_bit(HookFeature_DrawTrace)); // the trace stopped by itself (e.g. disk full)
+		}
+	}
 	device* const device = swapchain->get_device();
 	auto& mapp = device->get_private_data<device_draw_stats>();
-	mapp.zero_stats();
-	// Merge state from all graphics queues
+	mapp.reset_stats();
+	// Merge state from all graphics queues (the first one is just swapped in)
 	for (command_queue *const queue : mapp.queues) {
 		auto &state = queue->get_private_data<queue_draw_stats>();
 		mapp.merge(state);
@@ -117,33 +179,23 @@ static void on_reshade_finish_effects(effect_runtime* runtime, command_list* cmd
 	auto& mapp = device->get_private_data<device_draw_stats>();
 	runtime->get_screenshot_width_and_height(&mapp.render_width, &mapp.render_height);
 	mapp.frameidx++;
+	// Forget destroyed resources before their handles can be reused by new ones
+	mapp.desc_cache.take_destroyed(mapp.destroyed_resources);
+	for (const uint64_t rhndl : mapp.destroyed_resources) mapp.tracked_resources.erase(rhndl);
+	// while idle nothing was counted, so keep the last suggestion; entries not drawn to since then are removed once active again
+	if (!hook_activity_enabled(HookFeature_RenderTargetStats)) return;
 	std::lock_guard<std::mutex> guard(mapp.statsmut);
-	// Update tracking of clickable resources
-	for (const auto& [rhndl, rstats] : mapp.resource2stats) {
-		if (rstats.total_draws > 0) {
-			mapp.resource2lastseenframeidx[rhndl] = mapp.frameidx;
-			if (rhndl != 0ull) {
-				resource_desc rdesc = device->get_resource_desc({ rhndl });
-				mapp.resource2lastseendrawformat[rhndl] = rdesc.texture.format;
-			}
-		}
-	}
-	// Remove stale buffers that haven't been drawn to in a while
-	for (auto mit = mapp.resource2lastseenframeidx.cbegin(); mit != mapp.resource2lastseenframeidx.cend(); ) {
-		if (mapp.frameidx - mit->second > 9) {
-			mapp.resource2stats.erase(mit->first);
-			mit = mapp.resource2lastseenframeidx.erase(mit);
-		} else {
-			mit++;
-		}
-	}
-	// Suggest a valid buffer (that wouldnt have been grayed out) with most draws
+	// Update tracking of clickable resources, and suggest a valid buffer (that wouldnt have been grayed out) with most draws
 	uint64_t bestscore = 0;
 	uint64_t bestresource = 0;
-	for (const auto& [rhndl, rstats] : mapp.resource2stats) {
-		if (rstats.total_draws > 0 && rstats.total_vertices > 0) {
-			const resource_desc rdesc = device->get_resource_desc({ rhndl });
-			if (fmtchannelsdisplaycolorlike.at(rdesc.texture.format)) {
+	mapp.resource2stats.for_each([&](uint64_t rhndl, const rsc_stats& rstats) {
+		if (rstats.total_draws > 0) {
+			device_draw_stats::tracked_rsc& tracked = mapp.tracked_resources[rhndl];
+			if (tracked.last_seen_frameidx == 0) {
+				tracked.last_seen_draw_format = mapp.desc_cache.get(device, { rhndl }).texture.format; // newly tracked
+			}
+			tracked.last_seen_frameidx = mapp.frameidx;
+			if (rstats.total_vertices > 0 && fmtchannelsdisplaycolorlike.at(tracked.last_seen_draw_format)) {
 				const uint64_t thisscore = rstats.total_draws * rstats.total_vertices;
 				if (thisscore > bestscore) {
 					bestresource = rhndl;
@@ -151,8 +203,25 @@ static void on_reshade_finish_effects(effect_runtime* runtime, command_list* cmd
 				}
 			}
 		}
-	}
+	});
+	// Remove stale buffers that haven't been drawn to in a while
+	mapp.tracked_resources.erase_if([&](uint64_t, const device_draw_stats::tracked_rsc& tracked) {
+		return mapp.frameidx - tracked.last_seen_frameidx > 9;
+	});
 	mapp.suggested_resource_to_click = (bestscore > 0) ? bestresource : 0ull;
+	// Publish what the overlay shows
+	rsc_stats_snapshot& snap = mapp.snapshot_back_buffer();
+	snap.rows.clear();
+	mapp.tracked_resources.for_each([&](uint64_t rhndl, const device_draw_stats::tracked_rsc& tracked) {
+		rsc_stats_row& row = snap.rows.emplace_back();
+		row.handle = rhndl;
+		const rsc_stats* rstats = mapp.resource2stats.find(rhndl);
+		row.stats = (rstats != nullptr) ? *rstats : rsc_stats{};
+		row.last_seen_draw_format = tracked.last_seen_draw_format;
+	});
+	std::sort(snap.rows.begin(), snap.rows.end(), [](const rsc_stats_row& a, const rsc_stats_row& b) { return a.handle < b.handle; });
+	snap.suggested_resource_to_click = mapp.suggested_resource_to_click;
+	mapp.publish_snapshot();
 	// Assign the best resource if the user hasn't clicked on anything
 	if (mapp.actually_clicked_resources.empty()) {
 		auto& mclicks = device->get_private_data<clicked_rgb_rendertargets>();
@@ -169,25 +238,19 @@ void imgui_draw_rgb_render_target_stats_in_reshade_overlay(effect_runtime* runti
 {
 	device* const device = runtime->get_device();
 	auto& mapp = device->get_private_data<device_draw_stats>();
-	std::lock_guard<std::mutex> guard(mapp.statsmut);
+	const rsc_stats_snapshot& snap = mapp.snapshot();
 	bool clicked_something = false;
-	for (const auto& [rhndl, rstats] : mapp.resource2stats) {
-		bool greyedout;
-		std::string texfmtname;
-		if (rstats.total_draws > 0 && rstats.total_vertices > 0) {
-			resource_desc rdesc = device->get_resource_desc({ rhndl });
-			texfmtname = fmtnames.at(rdesc.texture.format);
-			greyedout = !mapp.actually_clicked_resources.count(rhndl) && !fmtchannelsdisplaycolorlike.at(rdesc.texture.format);
-		} else {
-			texfmtname = mapp.resource2lastseendrawformat.count(rhndl) ? fmtnames.at(mapp.resource2lastseendrawformat.at(rhndl)) : "?"; // todo cache last known name of resource in a map
-			greyedout = !mapp.actually_clicked_resources.count(rhndl);
-		}
+	for (const rsc_stats_row& row : snap.rows) {
+		const uint64_t rhndl = row.handle;
+		const rsc_stats& rstats = row.stats;
+		const bool drawn = rstats.total_draws > 0 && rstats.total_vertices > 0;
+		const bool greyedout = !mapp.actually_clicked_resources.count(rhndl) && (!drawn || !fmtchannelsdisplaycolorlike.at(row.last_seen_draw_format));
 		if (greyedout) {
 			ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyle().Colors[ImGuiCol_TextDisabled]);
 		}
-		ImGui::Text(rhndl == mapp.suggested_resource_to_click ? ">" : " ");
+		ImGui::Text(rhndl == snap.suggested_resource_to_click ? ">" : " ");
 		ImGui::SameLine();
-		sprintf_s(imguiprintbuf, "0x%016llx | %-22s |", rhndl, texfmtname.c_str());
+		sprintf_s(imguiprintbuf, "0x%016llx | %-22s |", rhndl, fmtnames.at(row.last_seen_draw_format));
 		const bool wasclicked = mapp.actually_clicked_resources.count(rhndl);
 		bool isnowclicked = wasclicked;
 		if (ImGui::Checkbox(imguiprintbuf, &isnowclicked)) {
@@ -224,14 +287,20 @@ void register_rgb_render_target_stats_tracking() {
 	reshade::register_event<reshade::addon_event::destroy_command_list>(on_destroy_command_list);
 	reshade::register_event<reshade::addon_event::init_command_queue>(on_init_command_queue);
 	reshade::register_event<reshade::addon_event::destroy_command_queue>(on_destroy_command_queue);
+	reshade::register_event<reshade::addon_event::init_resource>(on_init_resource);
+	reshade::register_event<reshade::addon_event::destroy_resource>(on_destroy_resource);
 	reshade::register_event<reshade::addon_event::reset_command_list>(on_reset_cmdlist);
 	reshade::register_event<reshade::addon_event::execute_command_list>(on_execute_primary);
 	reshade::register_event<reshade::addon_event::execute_secondary_command_list>(on_execute_secondary);
 
 	reshade::register_event<reshade::addon_event::bind_render_targets_and_depth_stencil>(on_bind_render_targets_and_depth_stencil);
+	reshade::register_event<reshade::addon_event::bind_pipeline>(on_bind_pipeline);
 	reshade::register_event<reshade::addon_event::draw>(on_draw);
 	reshade::register_event<reshade::addon_event::draw_indexed>(on_draw_indexed);
 	reshade::register_event<reshade::addon_event::draw_or_dispatch_indirect>(on_draw_or_dispatch_indirect);
+	reshade::register_event<reshade::addon_event::draw>(trace_on_draw_plain);
+	reshade::register_event<reshade::addon_event::draw_indexed>(trace_on_draw_indexed);
+	reshade::register_event<reshade::addon_event::draw_or_dispatch_indirect>(trace_on_draw_or_dispatch_indirect);
 	reshade::register_event<reshade::addon_event::reshade_finish_effects>(on_reshade_finish_effects);
 	reshade::register_event<reshade::addon_event::present>(on_present);
 
@@ -245,14 +314,20 @@ void unregister_rgb_render_target_stats_tracking() {
 	reshade::unregister_event<reshade::addon_event::destroy_command_list>(on_destroy_command_list);
 	reshade::unregister_event<reshade::addon_event::init_command_queue>(on_init_command_queue);
 	reshade::unregister_event<reshade::addon_event::destroy_command_queue>(on_destroy_command_queue);
+	reshade::unregister_event<reshade::addon_event::init_resource>(on_init_resource);
+	reshade::unregister_event<reshade::addon_event::destroy_resource>(on_destroy_resource);
 	reshade::unregister_event<reshade::addon_event::reset_command_list>(on_reset_cmdlist);
 	reshade::unregister_event<reshade::addon_event::execute_command_list>(on_execute_primary);
 	reshade::unregister_event<reshade::addon_event::execute_secondary_command_list>(on_execute_secondary);
 
 	reshade::unregister_event<reshade::addon_event::bind_render_targets_and_depth_stencil>(on_bind_render_targets_and_depth_stencil);
+	reshade::unregister_event<reshade::addon_event::bind_pipeline>(on_bind_pipeline);
 	reshade::unregister_event<reshade::addon_event::draw>(on_draw);
 	reshade::unregister_event<reshade::addon_event::draw_indexed>(on_draw_indexed);
 	reshade::unregister_event<reshade::addon_event::draw_or_dispatch_indirect>(on_draw_or_dispatch_indirect);
+	reshade::unregister_event<reshade::addon_event::draw>(trace_on_draw_plain);
+	reshade::unregister_event<reshade::addon_event::draw_indexed>(trace_on_draw_indexed);
+	reshade::unregister_event<reshade::addon_event::draw_or_dispatch_indirect>(trace_on_draw_or_dispatch_indirect);
 	reshade::unregister_event<reshade::addon_event::reshade_finish_effects>(on_reshade_finish_effects);
 	reshade::unregister_event<reshade::addon_event::present>(on_present);
 }
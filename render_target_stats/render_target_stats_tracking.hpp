@@ -1,9 +1,12 @@
 #pragma once
 // Copyright (C) 2023 Jason Bunk
 #include <reshade.hpp>
-#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include <mutex>
+#include <atomic>
+#include "flat_handle_map.hpp"
+#include "resource_desc_cache.hpp"
 
 struct rsc_stats {
 	uint64_t total_draws = 0;
@@ -12,43 +15,51 @@ struct rsc_stats {
 	uint64_t max_num_rtvsbound = 0;
 	uint64_t num_command_lists_which_touched = 0;
 
-	void zero() {
-		total_draws = 0;
-		num_indirect_draws = 0;
-		total_vertices = 0;
-		max_num_rtvsbound = 0;
-		num_command_lists_which_touched = 0;
+	void accumulate(const rsc_stats& src) {
+		total_draws += src.total_draws;
+		num_indirect_draws += src.num_indirect_draws;
+		total_vertices += src.total_vertices;
+		max_num_rtvsbound = std::max(max_num_rtvsbound, src.max_num_rtvsbound);
+		num_command_lists_which_touched += src.num_command_lists_which_touched;
 	}
 };
 
+/*
+* Stats are accumulated per command list, merged into their queue when executed, and merged from the queues into the device at present.
+* Merging into an empty accumulator (the common case: a queue's first command list of the frame, the device's first queue)
+* is a swap of the tables, which hands the source an empty table that keeps its capacity.
+*/
 struct __declspec(uuid("fba6fdd8-0096-406f-be07-97e1726ad30c")) stats_accum {
-	std::map<uint64_t, rsc_stats> resource2stats;
+	flat_handle_map<rsc_stats> resource2stats;
 	std::mutex statsmut;
 	void merge(stats_accum& source) {
-		if (std::addressof(resource2stats) != std::addressof(source.resource2stats)) {
-			std::lock_guard<std::mutex> guard_this(statsmut);
-			std::lock_guard<std::mutex> guard_other(source.statsmut);
-			for (const auto& [src_handle, src_stats] : source.resource2stats) {
-				rsc_stats& sthandle = resource2stats[src_handle];
-				sthandle.total_draws += src_stats.total_draws;
-				sthandle.num_indirect_draws += src_stats.num_indirect_draws;
-				sthandle.total_vertices += src_stats.total_vertices;
-				sthandle.max_num_rtvsbound = std::max(sthandle.max_num_rtvsbound, src_stats.max_num_rtvsbound);
-				sthandle.num_command_lists_which_touched += src_stats.num_command_lists_which_touched;
+		if (this != std::addressof(source)) {
+			std::scoped_lock guard(statsmut, source.statsmut);
+			if (resource2stats.empty()) {
+				resource2stats.swap(source.resource2stats);
+			} else {
+				source.resource2stats.for_each([this](uint64_t src_handle, const rsc_stats& src_stats) {
+					resource2stats[src_handle].accumulate(src_stats);
+				});
+				source.resource2stats.clear();
 			}
-			source.resource2stats.clear();
 		}
 	}
 	void reset_stats() {
 		std::lock_guard<std::mutex> guard(statsmut);
 		resource2stats.clear();
 	}
-	void zero_stats() {
-		std::lock_guard<std::mutex> guard(statsmut);
-		for (auto& [handle, stats] : resource2stats) {
-			stats.zero();
-		}
-	}
+};
+
+// one row of the overlay's table of render targets
+struct rsc_stats_row {
+	uint64_t handle = 0;
+	rsc_stats stats; // of the last frame, zero if not drawn to
+	reshade::api::format last_seen_draw_format = reshade::api::format::unknown;
+};
+struct rsc_stats_snapshot {
+	std::vector<rsc_stats_row> rows; // sorted by handle, so that rows don't jump around
+	uint64_t suggested_resource_to_click = 0;
 };
 
 struct __declspec(uuid("c58e40fa-bf45-4e8e-9c39-6d091c5ae03f")) device_draw_stats : public stats_accum {
@@ -56,22 +67,102 @@ struct __declspec(uuid("c58e40fa-bf45-4e8e-9c39-6d091c5ae03f")) device_draw_stat
 	uint32_t render_height = 0;
 	// List of queues created for this device
 	std::vector<reshade::api::command_queue*> queues;
-	// Keep track of when each resource was last drawn to
+	// Keep track of when each resource was last drawn to (resource2stats only holds the last frame)
+	struct tracked_rsc {
+		uint64_t last_seen_frameidx = 0;
+		reshade::api::format last_seen_draw_format = reshade::api::format::unknown;
+	};
 	uint64_t frameidx = 0;
-	std::unordered_map<uint64_t, uint64_t> resource2lastseenframeidx;
-	std::unordered_map<uint64_t, reshade::api::format> resource2lastseendrawformat;
+	flat_handle_map<tracked_rsc> tracked_resources; // the format is only looked up when a resource starts being tracked
+	resource_desc_cache desc_cache;
+	std::vector<uint64_t> destroyed_resources; // scratch
 	// Keep track of what the user has actually clicked on
 	uint64_t suggested_resource_to_click = 0;
 	std::unordered_set<uint64_t> actually_clicked_resources;
+
+	// Double-buffered: the back buffer is rebuilt at the end of effects and then published,
+	// so the overlay reads the published one without taking statsmut while render threads are recording.
+	rsc_stats_snapshot snapshots[2];
+	std::atomic<uint32_t> published_snapshot = { 0 };
+
+	inline const rsc_stats_snapshot& snapshot() const { return snapshots[published_snapshot.load(std::memory_order_acquire)]; }
+	inline rsc_stats_snapshot& snapshot_back_buffer() { return snapshots[1u - published_snapshot.load(std::memory_order_relaxed)]; }
+	inline void publish_snapshot() { published_snapshot.store(1u - published_snapshot.load(std::memory_order_relaxed), std::memory_order_release); }
 };
 
+/*
+* Draws are counted without locks or map lookups: a command list is only recorded by one thread at a time,
+* render target 0's resource and size are resolved once per bind (not once per draw),
+* and counts go into a small flat array that is folded into resource2stats when the command list is executed.
+*/
 struct __declspec(uuid("a0e48321-b043-4368-934f-387a93169e6c")) cmdlist_draw_stats : public stats_accum {
 	std::vector<reshade::api::resource_view> render_targets;
 	reshade::api::resource_view depth_stencil = { 0 };
 
+	// cached on the first draw after render targets are bound
+	bool rt0_resolved = false;
+	uint64_t rt0_resource = 0ull; // 0 if nothing is bound
+	uint32_t rt0_width = 0;
+	uint32_t rt0_height = 0;
+	const device_draw_stats* device_stats = nullptr; // for the current render size
+	int32_t rt0_pending_slot = -1; // index of rt0_resource in pending_stats, once drawn to
+
+	std::vector<std::pair<uint64_t, rsc_stats>> pending_stats; // not yet folded into resource2stats
+
+	// pipelines bound for the vertex and pixel stages, only kept while a draw trace is recording
+	uint64_t bound_pipeline_vs = 0ull;
+	uint64_t bound_pipeline_ps = 0ull;
+
+	void bind_render_targets(uint32_t count, const reshade::api::resource_view* rtvs, reshade::api::resource_view dsv) {
+		// always invalidated: a view handle can be reused for a different resource after the old view is destroyed
+		rt0_resolved = false;
+		rt0_pending_slot = -1;
+		render_targets.assign(rtvs, rtvs + count);
+		depth_stencil = dsv;
+	}
+	void resolve_rt0(reshade::api::device* device) {
+		rt0_resolved = true;
+		rt0_pending_slot = -1;
+		rt0_resource = 0ull;
+		if (device_stats == nullptr) device_stats = &device->get_private_data<device_draw_stats>();
+		if (render_targets.empty() || render_targets[0].handle == 0ull) return;
+		const reshade::api::resource rhndl = device->get_resource_from_view(render_targets[0]);
+		if (rhndl.handle == 0ull) return;
+		const reshade::api::resource_desc rdesc = device->get_resource_desc(rhndl);
+		rt0_resource = rhndl.handle;
+		rt0_width = rdesc.texture.width;
+		rt0_height = rdesc.texture.height;
+	}
+	rsc_stats& pending_stats_of_rt0() {
+		if (rt0_pending_slot < 0) {
+			rt0_pending_slot = 0;
+			while (rt0_pending_slot < static_cast<int32_t>(pending_stats.size()) && pending_stats[rt0_pending_slot].first != rt0_resource) rt0_pending_slot++;
+			if (rt0_pending_slot == static_cast<int32_t>(pending_stats.size())) {
+				pending_stats.emplace_back(rt0_resource, rsc_stats{});
+				pending_stats.back().second.num_command_lists_which_touched = 1;
+			}
+		}
+		return pending_stats[rt0_pending_slot].second;
+	}
+	void fold_pending_stats() {
+		if (pending_stats.empty()) return;
+		{
+			std::lock_guard<std::mutex> guard(statsmut);
+			for (const auto& [handle, stats] : pending_stats) {
+				resource2stats[handle].accumulate(stats);
+			}
+		}
+		pending_stats.clear();
+		rt0_pending_slot = -1;
+	}
 	void reset_cmdlist() {
 		render_targets.clear();
 		depth_stencil = { 0 };
+		rt0_resolved = false;
+		rt0_pending_slot = -1;
+		pending_stats.clear();
+		bound_pipeline_vs = 0ull;
+		bound_pipeline_ps = 0ull;
 	}
 };
 
@@ -1,8 +1,8 @@
 #pragma once
 // Copyright (C) 2023 Jason Bunk
 #include <reshade.hpp>
-#include <map>
-#include <string>
+#include <array>
+#include <cstdint>
 
 namespace reshade::api
 {
@@ -123,27 +123,73 @@ namespace reshade::api
 		X(g8r8_g8b8_unorm,3, 69) \
 		X(intz, 1, 0x5A544E49)
 
-#define X(evv,ech,eii) { format::evv, #eii ":" #evv },
-	static const std::map<format,std::string> fmtnames = {
+#define X(evv,ech,eii) + 1
+	inline constexpr size_t num_formats = 0 RESHADE_API_FORMATS_XMACRO;
+#undef X
+
+#define X(evv,ech,eii) format::evv,
+	inline constexpr format all_formats[num_formats] = {
 RESHADE_API_FORMATS_XMACRO
 	};
 #undef X
 
-#define X(evv,ech,eii) { format::evv, ech },
-	static const std::map<format,int> fmtchannels = {
-RESHADE_API_FORMATS_XMACRO
+	// Most format values are DXGI values below 128, so they are looked up in a dense table; the rest (FOURCC-like) are searched for.
+	inline constexpr uint32_t format_dense_limit = 128;
+	static_assert(num_formats < 255, "dense format table stores indices in bytes");
+	inline constexpr auto format_dense_indices = []() {
+		std::array<uint8_t, format_dense_limit> idx = {};
+		for (uint8_t& ii : idx) ii = static_cast<uint8_t>(num_formats);
+		for (size_t ii = 0; ii < num_formats; ++ii) {
+			const uint32_t val = static_cast<uint32_t>(all_formats[ii]);
+			if (val < format_dense_limit) idx[val] = static_cast<uint8_t>(ii);
+		}
+		return idx;
+	}();
+	// index into the tables below, or num_formats if the format isn't listed
+	constexpr size_t format_index(format fmt) {
+		const uint32_t val = static_cast<uint32_t>(fmt);
+		if (val < format_dense_limit) return format_dense_indices[val];
+		for (size_t ii = 0; ii < num_formats; ++ii) {
+			if (all_formats[ii] == fmt) return ii;
+		}
+		return num_formats;
+	}
+
+	// one value per format, in the order of RESHADE_API_FORMATS_XMACRO
+	template<typename T>
+	struct format_property_table {
+		T values[num_formats];
+		T missing;
+		constexpr T at(format fmt) const {
+			const size_t ii = format_index(fmt);
+			return ii < num_formats ? values[ii] : missing;
+		}
 	};
+
+#define X(evv,ech,eii) #eii ":" #evv,
+	inline constexpr format_property_table<const char*> fmtnames = { {
+RESHADE_API_FORMATS_XMACRO
+	}, "?" };
 #undef X
 
-#define X(evv,ech,eii) { format::evv, (ech==3 || ech==4) },
-	static const std::map<format, bool> fmtchannelsdisplaycolorlike = {
+#define X(evv,ech,eii) ech,
+	inline constexpr format_property_table<int> fmtchannels = { {
 RESHADE_API_FORMATS_XMACRO
-	};
+	}, 0 };
 #undef X
 
-#define X(evv,ech,eii) { format::evv, (ech==1 || ech==2) },
-	static const std::map<format, bool> fmtchannelsdepthlike = {
+#define X(evv,ech,eii) (ech==3 || ech==4),
+	inline constexpr format_property_table<bool> fmtchannelsdisplaycolorlike = { {
 RESHADE_API_FORMATS_XMACRO
-	};
+	}, false };
+#undef X
+
+#define X(evv,ech,eii) (ech==1 || ech==2),
+	inline constexpr format_property_table<bool> fmtchannelsdepthlike = { {
+RESHADE_API_FORMATS_XMACRO
+	}, false };
 #undef X
-}
\ No newline at end of file
+
+	static_assert(fmtchannels.at(format::r8g8b8a8_unorm) == 4 && fmtchannels.at(format::intz) == 1 && fmtchannels.at(format::d24_unorm_x8_uint) == 2);
+	static_assert(fmtchannelsdisplaycolorlike.at(format::b8g8r8a8_unorm_srgb) && !fmtchannelsdisplaycolorlike.at(format::r32_float));
+}
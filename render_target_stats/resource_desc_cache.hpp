@@ -0,0 +1,48 @@
+#pragma once
+// Copyright (C) 2023 Jason Bunk
+#include <reshade.hpp>
+#include <shared_mutex>
+#include <mutex>
+#include <vector>
+#include "flat_handle_map.hpp"
+
+/*
+* Descriptions of the device's render target textures, kept up to date from the init_resource and destroy_resource events
+* (which can come from any thread), so that the render target suggestion doesn't call get_resource_desc every frame.
+* Resources created before the addon was loaded are added on their first lookup.
+* Destroyed handles are collected, so that anything remembered about them can be forgotten before the handle is reused.
+*/
+class resource_desc_cache {
+	mutable std::shared_mutex mut;
+	flat_handle_map<reshade::api::resource_desc> descs;
+	std::vector<uint64_t> destroyed;
+public:
+	void on_init_resource(const reshade::api::resource_desc& desc, reshade::api::resource rsc) {
+		if (rsc.handle == 0ull || (desc.usage & reshade::api::resource_usage::render_target) == 0) return;
+		std::unique_lock<std::shared_mutex> lock(mut);
+		descs[rsc.handle] = desc;
+	}
+	void on_destroy_resource(reshade::api::resource rsc) {
+		if (rsc.handle == 0ull) return;
+		std::unique_lock<std::shared_mutex> lock(mut);
+		if (descs.erase(rsc.handle)) destroyed.push_back(rsc.handle);
+	}
+	reshade::api::resource_desc get(reshade::api::device* device, reshade::api::resource rsc) {
+		if (rsc.handle == 0ull) return device->get_resource_desc(rsc);
+		{
+			std::shared_lock<std::shared_mutex> lock(mut);
+			const reshade::api::resource_desc* found = descs.find(rsc.handle);
+			if (found != nullptr) return *found;
+		}
+		const reshade::api::resource_desc desc = device->get_resource_desc(rsc);
+		std::unique_lock<std::shared_mutex> lock(mut);
+		descs[rsc.handle] = desc;
+		return desc;
+	}
+	// swaps out the handles destroyed since the last call
+	void take_destroyed(std::vector<uint64_t>& out) {
+		out.clear();
+		std::unique_lock<std::shared_mutex> lock(mut);
+		out.swap(destroyed);
+	}
+};
@@ -3,7 +3,6 @@
 #include "buffer_indexing_colorization.hpp"
 #include "segmentation_app_data.hpp"
 #include "xxhash.h"
-#include "concurrentqueue.h"
 #include "colormap_util.hpp"
 using namespace reshade::api;
 
@@ -17,8 +16,10 @@ inline uint32_t colorhashfun(const void* buf, size_t buflen, uint32_t seed) {
 typedef std::array<uint32_t, 2> DrawInstIDbuf; // pair (Draw#, InstanceID) uniquely identifies each object within one frame
 
 
-void multithreaded_row_colorization_worker(moodycamel::ConcurrentQueue<uint32_t>* row_queue,
-	const uint8_t* datastartptr, uint32_t row_stride_bytes, uint32_t row_width_pix,
+// recolorizes one band of rows, if its indices changed since it was last colorized (or recolorize_all);
+// each band is only touched by the thread that runs it, so no locking is needed for the per-band state
+static void colorize_band(uint32_t bandidx, bool recolorize_all,
+	const uint8_t* datastartptr, uint32_t row_stride_bytes, uint32_t row_width_pix, uint32_t num_rows,
 	std::vector<perdraw_metadata_type> const* const draw_metadata,
 	segmentation_app_buffer_indexing_colorization* mapp)
 {
@@ -26,18 +27,26 @@ void multithreaded_row_colorization_worker(moodycamel::ConcurrentQueue<uint32_t>
 	uint8_t primbuf[sizeof(perdraw_metadata_type) + sizeof(uint32_t)];
 	DrawInstIDbuf objbuf;
 	uint32_t seg_idx_color = 0u;
-	uint32_t rowidx = 0;
-	while (row_queue->try_dequeue(rowidx)) {
+	const uint32_t band_row_begin = bandidx * segmentation_app_buffer_indexing_colorization::colorization_band_rows;
+	const uint32_t band_row_end = std::min(band_row_begin + segmentation_app_buffer_indexing_colorization::colorization_band_rows, num_rows);
+	uint64_t bandhash = 0ull;
+	for (uint32_t rowidx = band_row_begin; rowidx < band_row_end; ++rowidx)
+		bandhash = XXH64(datastartptr + rowidx * row_stride_bytes, row_width_pix * 4ull * sizeof(uint32_t), bandhash);
+	if (!recolorize_all && bandhash == mapp->colorized_band_hashes[bandidx]) return;
+	mapp->colorized_band_hashes[bandidx] = bandhash;
+	mapp->colorized_band_dirty[bandidx] = 1u;
+	for (uint32_t rowidx = band_row_begin; rowidx < band_row_end; ++rowidx) {
 		const uint32_t* inrowptr = reinterpret_cast<const uint32_t*>(datastartptr + rowidx * row_stride_bytes);
-		perdraw_metadata_type* outmetarowptr = mapp->draw_metadata_seg_image.rowptr(rowidx);
+		uint32_t* outdrawidxrowptr = mapp->draw_index_seg_image.rowptr(rowidx);
 		for (size_t x = 0; x < row_width_pix; ++x) {
-			outmetarowptr[x] = (*draw_metadata)[std::min<size_t>(one_minus_draw_meta_size, inrowptr[x * 4u])];
+			outdrawidxrowptr[x] = static_cast<uint32_t>(std::min<size_t>(one_minus_draw_meta_size, inrowptr[x * 4u]));
+			const perdraw_metadata_type& drawmeta = (*draw_metadata)[outdrawidxrowptr[x]];
 			switch (mapp->viz_seg_colorization_mode) {
 			case CVM_FullMetaHash:
-				seg_idx_color = colorhashfun(outmetarowptr[x].data(), sizeof(perdraw_metadata_type), mapp->viz_seg_colorization_seed);
+				seg_idx_color = colorhashfun(drawmeta.data(), sizeof(perdraw_metadata_type), mapp->viz_seg_colorization_seed);
 				break;
 			case CVM_ShaderIDs:
-				perdraw_metadata_type copyofmeta = outmetarowptr[x];
+				perdraw_metadata_type copyofmeta = drawmeta;
 				copyofmeta[0] = 0;
 				seg_idx_color = colorhashfun(copyofmeta.data(), sizeof(perdraw_metadata_type), mapp->viz_seg_colorization_seed);
 				break;
@@ -47,7 +56,7 @@ void multithreaded_row_colorization_worker(moodycamel::ConcurrentQueue<uint32_t>
 				seg_idx_color = colorhashfun(objbuf.data(), sizeof(objbuf), mapp->viz_seg_colorization_seed);
 				break;
 			case CVM_PrimitiveHash:
-				memcpy(primbuf, outmetarowptr[x].data(), sizeof(perdraw_metadata_type));
+				memcpy(primbuf, drawmeta.data(), sizeof(perdraw_metadata_type));
 				*reinterpret_cast<uint32_t*>(primbuf+sizeof(perdraw_metadata_type)) = inrowptr[x*4u+2u];
 				seg_idx_color = colorhashfun(primbuf, sizeof(perdraw_metadata_type) + 4u, mapp->viz_seg_colorization_seed);
 				break;
@@ -63,7 +72,7 @@ void multithreaded_row_colorization_worker(moodycamel::ConcurrentQueue<uint32_t>
 
 static constexpr char technique_file[] = "segmentation_visualization.fx";
 
-static effect_texture_variable check_for_effect_tex(effect_runtime* runtime, device* device)
+static effect_texture_variable check_for_effect_tex(effect_runtime* runtime, device* device, resource* out_texrsc = nullptr)
 {
 	{
 		effect_technique efftech = runtime->find_technique(technique_file, "SemSegView");
@@ -78,10 +87,16 @@ static effect_texture_variable check_for_effect_tex(effect_runtime* runtime, dev
 		if (texrsv.handle == 0ull) return { 0ull }; // this can happen if the shader is disabled or hasn't been enabled yet
 		resource texrsc = device->get_resource_from_view(texrsv);
 		if (texrsc.handle == 0ull) return { 0ull }; // this happens every frame that the shader is disabled (it's not a problem)
+		if (out_texrsc != nullptr) *out_texrsc = texrsc;
 	}
 	return efftexvar;
 }
 
+bool live_segmentation_view_is_enabled(effect_runtime* runtime)
+{
+	return check_for_effect_tex(runtime, runtime->get_device()).handle != 0ull;
+}
+
 
 void imgui_draw_custom_shader_debug_viz_in_reshade_overlay(effect_runtime* runtime)
 {
@@ -92,6 +107,24 @@ void imgui_draw_custom_shader_debug_viz_in_reshade_overlay(effect_runtime* runti
 	return;
 #endif
 
+	{
+		const draws_counting_data_buffer_stats cstats = device->get_private_data<segmentation_app_data>().r_counter_buf.get_stats();
+		ImGui::Text("Draw counter: %u / %u views, last frame %u draws (peak %u), wrapped in %llu frames%s",
+			cstats.num_views, cstats.max_num_views, cstats.last_frame_num_draws, cstats.peak_frame_num_draws,
+			cstats.num_frames_wrapped, cstats.last_frame_wrapped ? " (WRAPPED last frame)" : "");
+		const customized_shader_store_stats sstats = device->get_private_data<segmentation_app_data>().customized_shaders.get_stats();
+		ImGui::Text("Customized shaders: %u (%u from disk cache), %u failed; arena %.2f / %.2f MB",
+			sstats.num_customized, sstats.num_from_disk_cache, sstats.num_failed,
+			static_cast<double>(sstats.arena_bytes_used) / 1048576.0, static_cast<double>(sstats.arena_bytes_reserved) / 1048576.0);
+		auto& gmapp = device->get_private_data<segmentation_app_data>();
+		ImGui::Checkbox("Captures: also save parts grouped into instances", &gmapp.save_grouped_instances);
+		if (gmapp.save_grouped_instances) {
+			ImGui::Checkbox("Grouping: merge adjacent parts with same vertex shader", &gmapp.instance_grouping.merge_parts_with_same_vertex_shader);
+			ImGui::Checkbox("Grouping: merge adjacent parts with same pixel shader", &gmapp.instance_grouping.merge_parts_with_same_pixel_shader);
+			ImGui::SliderFloat("Grouping: max relative depth step (0 = ignore depth)", &gmapp.instance_grouping.max_relative_depth_step, 0.0f, 0.2f);
+		}
+	}
+
 	// don't show any of this imgui stuff if the debug shader isn't enabled
 	if (check_for_effect_tex(runtime, device).handle == 0ull) {
 		ImGui::Text(std::string(std::string("Live semantic segmentation visualization can be enabled by ") + std::string(technique_file)).c_str());
@@ -106,11 +139,12 @@ void imgui_draw_custom_shader_debug_viz_in_reshade_overlay(effect_runtime* runti
 			mapp.viz_seg_colorization_mode = static_cast<ColorizationVizMode>(vm);
 		}
 	}
-	if (mapp.draw_metadata_seg_image.width > 0 && mapp.draw_metadata_seg_image.height > 0) {
+	if (mapp.draw_index_seg_image.width > 0 && mapp.draw_index_seg_image.height > 0 && !mapp.draw_metadata_of_seg_image.empty()) {
 		const ImVec2 mousep = ImGui::GetMousePos();
-		const size_t mouse_x = std::min(static_cast<size_t>(std::max(std::llround(mousep.x), 0ll)), std::max(1ull, mapp.draw_metadata_seg_image.width) - 1ull);
-		const size_t mouse_y = std::min(static_cast<size_t>(std::max(std::llround(mousep.y), 0ll)), std::max(1ull, mapp.draw_metadata_seg_image.height) - 1ull);
-		const perdraw_metadata_type& meta = mapp.draw_metadata_seg_image.centryptr(mouse_y, mouse_x)[0];
+		const size_t mouse_x = std::min(static_cast<size_t>(std::max(std::llround(mousep.x), 0ll)), std::max(1ull, mapp.draw_index_seg_image.width) - 1ull);
+		const size_t mouse_y = std::min(static_cast<size_t>(std::max(std::llround(mousep.y), 0ll)), std::max(1ull, mapp.draw_index_seg_image.height) - 1ull);
+		const uint32_t drawidx = mapp.draw_index_seg_image.centryptr(mouse_y, mouse_x)[0];
+		const perdraw_metadata_type& meta = mapp.draw_metadata_of_seg_image[std::min<size_t>(drawidx, mapp.draw_metadata_of_seg_image.size() - 1ull)];
 		ImGui::Text("drawmeta(%4llu, %4llu) == (%6llu, 0x%016llx, 0x%016llx)", mouse_x, mouse_y, meta[0], meta[1], meta[2]);
 	}
 }
@@ -130,9 +164,11 @@ static resource_desc create_or_resize_intermediate_resource_copydest(device* dev
 			format::r32g32b32a32_uint, 1, memory_heap::gpu_to_cpu, resource_usage::copy_dest),
 			nullptr, resource_usage::copy_dest, &mapp.viz_intmdt_resource_copydest)) {
 			mapp.viz_seg_colorized_for_display.init_full(tdesc.texture.width, tdesc.texture.height, BUF_PIX_FMT_RGBA);
-			mapp.draw_metadata_seg_image.init(tdesc.texture.width, tdesc.texture.height);
-			mapp.row_colorization_thread_const_rowidxs_bulk.resize(tdesc.texture.height);
-			for (uint32_t y = 0; y < tdesc.texture.height; ++y) mapp.row_colorization_thread_const_rowidxs_bulk[y] = y;
+			mapp.draw_index_seg_image.init(tdesc.texture.width, tdesc.texture.height);
+			const uint32_t num_bands = (tdesc.texture.height + mapp.colorization_band_rows - 1u) / mapp.colorization_band_rows;
+			mapp.colorized_band_hashes.assign(num_bands, 0ull);
+			mapp.colorized_band_dirty.assign(num_bands, 0u);
+			mapp.colorization_needs_full_refresh = true;
 		}
 		else {
 			reshade::log_message(reshade::log_level::warning, "failed to create viz_intmdt_resource_copydest");
@@ -151,8 +187,17 @@ void custom_shader_buffer_visualization_on_reshade_begin_effects(effect_runtime*
 	if (mapp.viz_intmdt_resource_copydest.handle == 0ull || !mapp.do_intercept_draw || !mapp.r_accum_bonus.is_valid() || mapp.r_accum_bonus.rsc.handle == 0ull) return;
 
 	// check for reshade shader tex handle
-	effect_texture_variable efftexvar = check_for_effect_tex(runtime, device);
+	resource efftexrsc = { 0ull };
+	effect_texture_variable efftexvar = check_for_effect_tex(runtime, device, &efftexrsc);
 	if (efftexvar.handle == 0ull) return;
+	if (efftexrsc.handle != mapp.colorized_texture_handle) {
+		mapp.colorized_texture_handle = efftexrsc.handle;
+		mapp.colorization_needs_full_refresh = true;
+	}
+
+	// The buffer is only cleared before a frame's first segmented draw, so if nothing drew into it this frame,
+	// it still holds what was last read back and colorized: skip the readback and hashing.
+	if (mapp.r_counter_buf.num_draws_this_frame() == 0u && !mapp.colorization_needs_full_refresh) return;
 
 	// ready to copy to intermediate
 	command_queue* const cmdqueue = runtime->get_command_queue();
@@ -168,21 +213,56 @@ void custom_shader_buffer_visualization_on_reshade_begin_effects(effect_runtime*
 	// map intermediate to cpu and start processing (indexing colors)
 	subresource_data viz_intmdt_mapped_data;
 	if (device->map_texture_region(mapp.viz_intmdt_resource_copydest, 0, nullptr, map_access::read_only, &viz_intmdt_mapped_data)) {
-		const auto draw_metadata = mapp.r_counter_buf.get_copy_of_frame_perdraw_metadata<perdraw_metadata_type>();
+		auto draw_metadata = mapp.r_counter_buf.get_copy_of_frame_perdraw_metadata<perdraw_metadata_type>();
 		if (draw_metadata.empty()) {
 			memset(mapp.viz_seg_colorized_for_display.bytes.data(), 0, mapp.viz_seg_colorized_for_display.num_total_bytes());
+			mapp.draw_metadata_of_seg_image.clear();
+			mapp.colorization_needs_full_refresh = true;
 		} else {
+			// Colors depend on the draw metadata and on the imgui settings, not just on the indices in each band.
+			// If any of those changed, every band is recolorized; otherwise only bands whose indices changed.
+			const uint64_t frame_key = XXH64(draw_metadata.data(), draw_metadata.size() * sizeof(perdraw_metadata_type),
+				(static_cast<uint64_t>(mapp.viz_seg_colorization_mode) << 32) | static_cast<uint32_t>(mapp.viz_seg_colorization_seed));
+			const bool recolorize_all = mapp.colorization_needs_full_refresh || frame_key != mapp.colorized_frame_key;
+			mapp.colorized_frame_key = frame_key;
+			mapp.colorization_needs_full_refresh = false;
+			std::fill(mapp.colorized_band_dirty.begin(), mapp.colorized_band_dirty.end(), 0u);
+
 			// multithreaded processing
-			moodycamel::ConcurrentQueue<uint32_t> rowqueue;
-			rowqueue.enqueue_bulk(mapp.row_colorization_thread_const_rowidxs_bulk.data(), mapp.row_colorization_thread_const_rowidxs_bulk.size());
-			for (uint32_t y = 0; y < mapp.row_colorization_threads.size(); ++y) {
-				mapp.row_colorization_threads[y] = std::thread(multithreaded_row_colorization_worker, &rowqueue,
-					static_cast<const uint8_t*>(viz_intmdt_mapped_data.data), viz_intmdt_mapped_data.row_pitch, tdesc.texture.width,
-					&draw_metadata, &mapp);
+			const uint8_t* const mapped = static_cast<const uint8_t*>(viz_intmdt_mapped_data.data);
+			const uint32_t row_pitch = viz_intmdt_mapped_data.row_pitch;
+			mapp.row_colorization_pool.run(static_cast<uint32_t>(mapp.colorized_band_hashes.size()), [&](uint32_t bandidx) {
+				colorize_band(bandidx, recolorize_all, mapped, row_pitch, tdesc.texture.width, tdesc.texture.height, &draw_metadata, &mapp);
+			});
+
+			const resource_desc efftexdesc = device->get_resource_desc(efftexrsc);
+			if (recolorize_all || efftexdesc.texture.width != tdesc.texture.width || efftexdesc.texture.height != tdesc.texture.height) {
+				runtime->update_texture(efftexvar, tdesc.texture.width, tdesc.texture.height, mapp.viz_seg_colorized_for_display.bytes.data());
+			} else {
+				// upload each run of consecutive dirty bands as one region; on a static scene nothing is uploaded
+				const uint32_t num_bands = static_cast<uint32_t>(mapp.colorized_band_dirty.size());
+				for (uint32_t b0 = 0; b0 < num_bands; ++b0) {
+					if (!mapp.colorized_band_dirty[b0]) continue;
+					uint32_t b1 = b0 + 1u;
+					while (b1 < num_bands && mapp.colorized_band_dirty[b1]) ++b1;
+					const uint32_t row_begin = b0 * mapp.colorization_band_rows;
+					const uint32_t row_end = std::min(b1 * mapp.colorization_band_rows, tdesc.texture.height);
+					subresource_data region_data;
+					region_data.data = mapp.viz_seg_colorized_for_display.rowptr<uint32_t>(row_begin);
+					region_data.row_pitch = tdesc.texture.width * sizeof(uint32_t);
+					region_data.slice_pitch = region_data.row_pitch * (row_end - row_begin);
+					subresource_box region_box;
+					region_box.left = 0;
+					region_box.top = row_begin;
+					region_box.front = 0;
+					region_box.right = tdesc.texture.width;
+					region_box.bottom = row_end;
+					region_box.back = 1;
+					device->update_texture_region(region_data, efftexrsc, 0, &region_box);
+					b0 = b1;
+				}
 			}
-			for (uint32_t y = 0; y < mapp.row_colorization_threads.size(); ++y)
-				mapp.row_colorization_threads[y].join();
-			runtime->update_texture(efftexvar, tdesc.texture.width, tdesc.texture.height, mapp.viz_seg_colorized_for_display.bytes.data());
+			mapp.draw_metadata_of_seg_image = std::move(draw_metadata); // hovered pixels in the overlay are resolved with this
 		}
 		device->unmap_texture_region(mapp.viz_intmdt_resource_copydest, 0);
 	}
@@ -191,8 +271,43 @@ void custom_shader_buffer_visualization_on_reshade_begin_effects(effect_runtime*
 
 typedef std::array<uint64_t, std::tuple_size<perdraw_metadata_type>::value + 2u> TriBuf; // like "perdraw_metadata_type" but with 2 more values: DrawInstID, PrimitiveID
 
-bool segmentation_app_data::copy_and_index_seg_tex_needing_resource_barrier_into_packedbuf_and_metajson(
-	reshade::api::command_queue* cmdqueue, simple_packed_buf& segBuf, simple_packed_buf& triBuf, nlohmann::json& dstMetaJson)
+/*
+* Binary colormap tables, replacing the per-color json entries (which got to tens of MB with many triangles).
+* Read with python_threedee/load_colormaps.py. Layout (little endian):
+*   file header: char magic[8] "GCVCMAP", uint32 version, uint32 num_tables
+*   each table: char name[8], uint32 num_entries, uint32 num_u64_per_record,
+*               then uint32 color keys[num_entries] sorted ascending, zero padded to a multiple of 8 bytes,
+*               then uint64 records[num_entries][num_u64_per_record]
+* A color key is (r + 256*g + 65536*b) of the pixel in the corresponding png.
+*/
+static constexpr uint32_t colormap_tables_version = 1;
+
+template<typename T>
+static inline void append_pod(std::vector<uint8_t>& dst, const T& val) {
+	const uint8_t* src = reinterpret_cast<const uint8_t*>(&val);
+	dst.insert(dst.end(), src, src + sizeof(T));
+}
+
+template<typename RecT>
+static void append_colormap_table(std::vector<uint8_t>& dst, const char* name, const std::vector<std::pair<uint32_t, RecT>>& color2rec) {
+	std::vector<std::pair<uint32_t, const RecT*>> sorted;
+	sorted.reserve(color2rec.size());
+	for (auto it = color2rec.cbegin(); it != color2rec.cend(); ++it) sorted.emplace_back(it->first, &it->second);
+	std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+	char namebuf[8] = { 0 };
+	strncpy_s(namebuf, name, sizeof(namebuf) - 1);
+	dst.insert(dst.end(), namebuf, namebuf + sizeof(namebuf));
+	append_pod<uint32_t>(dst, static_cast<uint32_t>(sorted.size()));
+	append_pod<uint32_t>(dst, static_cast<uint32_t>(std::tuple_size<RecT>::value));
+	dst.reserve(dst.size() + sorted.size() * (sizeof(uint32_t) + sizeof(RecT)) + 8);
+	for (const auto& kv : sorted) append_pod<uint32_t>(dst, kv.first);
+	dst.resize((dst.size() + 7) & ~static_cast<size_t>(7), 0);
+	for (const auto& kv : sorted) append_pod<RecT>(dst, *kv.second);
+}
+
+bool segmentation_app_data::copy_and_index_seg_tex_needing_resource_barrier_into_packedbufs(
+	reshade::api::command_queue* cmdqueue, simple_packed_buf& segBuf, simple_packed_buf& triBuf, simple_packed_buf* classBuf, simple_packed_buf& colormapsBuf,
+	simple_packed_buf* instanceBuf, const simple_packed_buf* depthBuf)
 {
 	if (cmdqueue == nullptr) return false;
 	command_list* const icmdlst = cmdqueue->get_immediate_command_list();
@@ -218,11 +333,17 @@ bool segmentation_app_data::copy_and_index_seg_tex_needing_resource_barrier_into
 	// The color index (mapping from RGB to actual metadata) will be saved as a json.
 	segBuf.init_full(tdesc.texture.width, tdesc.texture.height, BUF_PIX_FMT_RGB24);
 	triBuf.init_full(tdesc.texture.width, tdesc.texture.height, BUF_PIX_FMT_RGB24);
+	// The class ID image needs no json: each pixel is directly the label of its draw.
+	if (semantic_labels.empty()) classBuf = nullptr;
+	if (classBuf != nullptr) classBuf->init_full(tdesc.texture.width, tdesc.texture.height, BUF_PIX_FMT_GRAYU16);
+	if (instanceBuf != nullptr) instanceBuf->init_full(tdesc.texture.width, tdesc.texture.height, BUF_PIX_FMT_GRAYU32);
 	std::map<perdraw_metadata_type, uint32_t> seg2color;
 	std::map<TriBuf, uint32_t> tri2color;
 	std::map<DrawInstIDbuf, uint32_t> inst2objid;
-	std::unordered_map<uint32_t, perdraw_metadata_type> color2seg;
-	std::unordered_map<uint32_t, TriBuf> color2tri;
+	// colormaps in order of first appearance, and which 24-bit colors they have taken
+	std::vector<std::pair<uint32_t, perdraw_metadata_type>> color2seg;
+	std::vector<std::pair<uint32_t, TriBuf>> color2tri;
+	color24_bitset seg_colors_taken, tri_colors_taken;
 	uint32_t idx_color = 0u;
 	uint8_t* const idx_color_bytes_view = reinterpret_cast<uint8_t*>(&idx_color);
 
@@ -230,24 +351,35 @@ bool segmentation_app_data::copy_and_index_seg_tex_needing_resource_barrier_into
 	if (draw_metadata.empty()) {
 		memset(segBuf.bytes.data(), 0, segBuf.num_total_bytes());
 		memset(triBuf.bytes.data(), 0, triBuf.num_total_bytes());
+		if (classBuf != nullptr) std::fill_n(classBuf->data<uint16_t>(), classBuf->width * classBuf->height, semantic_labels.get_default_label());
+		if (instanceBuf != nullptr) memset(instanceBuf->bytes.data(), 0, instanceBuf->num_total_bytes());
 	} else {
 		const size_t one_minus_draw_meta_size = draw_metadata.size() - 1ull;
+		std::vector<uint16_t> draw_labels;
+		if (classBuf != nullptr) {
+			draw_labels.resize(draw_metadata.size());
+			for (size_t dd = 0; dd < draw_metadata.size(); ++dd)
+				draw_labels[dd] = semantic_labels.lookup(draw_metadata[dd]);
+		}
 		DrawInstIDbuf ibuf;
 		TriBuf tbuf;
 		for (uint32_t y = 0; y < tdesc.texture.height; ++y) {
 			const uint32_t* rowptr = reinterpret_cast<const uint32_t*>(reinterpret_cast<const uint8_t*>(intmdt_mapped_data.data) + y * intmdt_mapped_data.row_pitch);
+			uint16_t* const classrow = classBuf != nullptr ? classBuf->rowptr<uint16_t>(y) : nullptr;
 			for (uint32_t x = 0; x < tdesc.texture.width; ++x) {
-				const auto& drawmeta = draw_metadata[std::min<size_t>(one_minus_draw_meta_size, rowptr[x * 4u])];
+				const size_t drawidx = std::min<size_t>(one_minus_draw_meta_size, rowptr[x * 4u]);
+				const auto& drawmeta = draw_metadata[drawidx];
+				if (classrow != nullptr) classrow[x] = draw_labels[drawidx];
 				// colorize seg
 				if (auto mci = seg2color.find(drawmeta); mci != seg2color.end()) {
 					idx_color = mci->second;
 				} else {
 					// Generate a new color as a 24-bit hash. We can't accept a hash collision, so repeatedly try with different seeds until we get a new unique color.
 					uint32_t xseed = 0u;
-					while (color2seg.count(idx_color = colorhashfun(drawmeta.data(), sizeof(perdraw_metadata_type), xseed)))
+					while (seg_colors_taken.test_and_set(idx_color = (colorhashfun(drawmeta.data(), sizeof(perdraw_metadata_type), xseed) & 0xFFFFFFu)))
 						xseed++;
 					seg2color.emplace(drawmeta, idx_color);
-					color2seg.emplace(idx_color, drawmeta);
+					color2seg.emplace_back(idx_color, drawmeta);
 				}
 				uint8_t* optr = segBuf.entryptr<uint8_t>(y, x);
 				optr[0] = idx_color_bytes_view[0];
@@ -268,14 +400,12 @@ bool segmentation_app_data::copy_and_index_seg_tex_needing_resource_barrier_into
 				if (auto mci = tri2color.find(tbuf); mci != tri2color.end()) {
 					idx_color = mci->second;
 				} else {
-					idx_color = 0u;
-					const auto newcolor = morton_halton_curve_rgb_3d(color2tri.size());
-					idx_color_bytes_view[0] = newcolor[0];
-					idx_color_bytes_view[1] = newcolor[1];
-					idx_color_bytes_view[2] = newcolor[2];
-					if (color2tri.count(idx_color)) reshade::log_message(reshade::log_level::error, "error: repeated color in colormap"); // TODO assert
+					// unique until there are more than 2^24 triangles
+					idx_color = morton_halton_curve_rgb_3d_packed(static_cast<uint32_t>(color2tri.size()));
+					const bool repeated = tri_colors_taken.test_and_set(idx_color);
+					if (repeated) reshade::log_message(reshade::log_level::error, "error: repeated color in colormap"); // TODO assert
 					tri2color.emplace(tbuf, idx_color);
-					color2tri.emplace(idx_color, tbuf);
+					if (!repeated) color2tri.emplace_back(idx_color, tbuf);
 				}
 				optr = triBuf.entryptr<uint8_t>(y, x);
 				optr[0] = idx_color_bytes_view[0];
@@ -283,19 +413,27 @@ bool segmentation_app_data::copy_and_index_seg_tex_needing_resource_barrier_into
 				optr[2] = idx_color_bytes_view[2];
 			}
 		}
+		if (instanceBuf != nullptr) {
+			instance_grouping_input ginput;
+			ginput.seg_rows = static_cast<const uint8_t*>(intmdt_mapped_data.data);
+			ginput.seg_row_pitch = intmdt_mapped_data.row_pitch;
+			ginput.width = tdesc.texture.width;
+			ginput.height = tdesc.texture.height;
+			ginput.draw_metadata = &draw_metadata;
+			if (depthBuf != nullptr && depthBuf->pixfmt == BUF_PIX_FMT_GRAYF32 && depthBuf->width == tdesc.texture.width && depthBuf->height == tdesc.texture.height)
+				ginput.depth = depthBuf->cdata<float>();
+			group_connected_instances(ginput, instance_grouping, std::max(1u, std::thread::hardware_concurrency()),
+				instance_grouping_workspace, instanceBuf->data<uint32_t>());
+		}
 	}
 	device->unmap_texture_region(viz_intmdt_resource_copydest, 0);
-	//dstMetaJson["seg_color2seg"] = color2seg;
-	char sprbuf[16];
-	for(auto cmi = color2seg.cbegin(); cmi != color2seg.cend(); ++cmi) {
-		idx_color = cmi->first;
-		sprintf_s(sprbuf, "%02x%02x%02x", idx_color_bytes_view[0], idx_color_bytes_view[1], idx_color_bytes_view[2]);
-		dstMetaJson["seg_hexcolor2meta"][sprbuf] = cmi->second;
-	}
-	for(auto cmi = color2tri.cbegin(); cmi != color2tri.cend(); ++cmi) {
-		idx_color = cmi->first;
-		sprintf_s(sprbuf, "%02x%02x%02x", idx_color_bytes_view[0], idx_color_bytes_view[1], idx_color_bytes_view[2]);
-		dstMetaJson["tri_hexcolor2meta"][sprbuf] = cmi->second;
-	}
+	colormapsBuf.pixfmt = BUF_PIX_FMT_NONE;
+	colormapsBuf.bytes.clear();
+	static constexpr char magic[8] = { 'G','C','V','C','M','A','P','\0' };
+	colormapsBuf.bytes.insert(colormapsBuf.bytes.end(), magic, magic + sizeof(magic));
+	append_pod<uint32_t>(colormapsBuf.bytes, colormap_tables_version);
+	append_pod<uint32_t>(colormapsBuf.bytes, 2u);
+	append_colormap_table(colormapsBuf.bytes, "seg", color2seg);
+	append_colormap_table(colormapsBuf.bytes, "tri", color2tri);
 	return true;
 }
@@ -2,10 +2,10 @@
 #pragma once
 #include "gcv_utils/simple_packed_buf.h"
 #include "gcv_utils/typed_2d_array.hpp"
+#include "gcv_utils/band_worker_pool.hpp"
 #include "shader_types.hpp"
 #include <reshade.hpp>
 #include <unordered_map>
-#include <thread>
 
 enum ColorizationVizMode : uint32_t {
 	CVM_BufChannel0 = 0,
@@ -33,9 +33,18 @@ struct segmentation_app_buffer_indexing_colorization
 	simple_packed_buf viz_seg_colorized_for_display;
 	ColorizationVizMode viz_seg_colorization_mode = CVM_FullMetaHash;
 	int viz_seg_colorization_seed = 0;
-	typed_2d_array<perdraw_metadata_type> draw_metadata_seg_image;
-	std::array<std::thread, 4> row_colorization_threads;
-	std::vector<uint32_t> row_colorization_thread_const_rowidxs_bulk;
+	typed_2d_array<uint32_t> draw_index_seg_image; // for the overlay: index into draw_metadata_of_seg_image of each displayed pixel
+	std::vector<perdraw_metadata_type> draw_metadata_of_seg_image; // metadata of the frame shown in draw_index_seg_image
+	band_worker_pool row_colorization_pool{ 3u }; // with the present thread, 4 threads colorize the bands
+
+	// Live colorization is incremental: the frame is split into bands of rows, and a band is only recolorized
+	// (and uploaded) if its segmentation indices changed since it was last colorized.
+	static constexpr uint32_t colorization_band_rows = 16;
+	std::vector<uint64_t> colorized_band_hashes; // hash of the mapped index data of each band, as of its last colorization
+	std::vector<uint8_t> colorized_band_dirty; // set by the worker threads for bands recolorized this frame
+	uint64_t colorized_frame_key = 0ull; // hash of everything else that the colors depend on (draw metadata, mode, seed)
+	uint64_t colorized_texture_handle = 0ull; // effect texture that was last uploaded to; it is recreated when effects are reloaded
+	bool colorization_needs_full_refresh = true;
 
 	inline void delete_resources(reshade::api::device* device) {
 		if (device == nullptr) return;
@@ -50,3 +59,6 @@ void custom_shader_buffer_visualization_on_reshade_begin_effects(reshade::api::e
 	reshade::api::command_list* cmd_list, reshade::api::resource_view rtv, reshade::api::resource_view);
 
 void imgui_draw_custom_shader_debug_viz_in_reshade_overlay(reshade::api::effect_runtime* runtime);
+
+// true if the live visualization effect is enabled and its texture is bound
+bool live_segmentation_view_is_enabled(reshade::api::effect_runtime* runtime);
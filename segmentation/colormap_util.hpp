@@ -1,8 +1,10 @@
 // Copyright (C) 2023 Jason Bunk
 #pragma once
 #include <array>
+#include <vector>
+#include <cstdint>
 
-inline uint32_t halton_sequence_u32_powerof2_i(uint32_t exponent, uint32_t i) {
+constexpr uint32_t halton_sequence_u32_powerof2_i(uint32_t exponent, uint32_t i) {
   if (exponent >= 32) return 0; // TODO assert instead of silently fail
   exponent = (1 << exponent);
   uint32_t r = 0;
@@ -15,9 +17,9 @@ inline uint32_t halton_sequence_u32_powerof2_i(uint32_t exponent, uint32_t i) {
 }
 
 template<typename rtype, uint32_t dim, uint32_t bitsperdim>
-std::array<rtype,dim> morton_halton_curve(uint32_t i) {
+constexpr std::array<rtype,dim> morton_halton_curve(uint32_t i) {
   const uint32_t halton_value = halton_sequence_u32_powerof2_i(dim*bitsperdim, i);
-  std::array<rtype,dim> r;
+  std::array<rtype,dim> r{};
   for(uint32_t d=0; d<dim; ++d) {
     r[d] = rtype(0);
     for(uint32_t b=0; b<bitsperdim; ++b) {
@@ -31,4 +33,43 @@ std::array<rtype,dim> morton_halton_curve(uint32_t i) {
 // This quickly generates a sequence of colors that are reasonably spread out
 inline std::array<uint8_t,3> morton_halton_curve_rgb_3d(uint32_t i) {
   return morton_halton_curve<uint8_t,3,8>(i);
-}
\ No newline at end of file
+}
+
+// The halton sequence above just reverses the low 24 bits of i, and the morton curve moves bits around,
+// so each bit of i sets one bit of the color: the color is the OR of the colors of each byte of i.
+// These are tabulated at compile time, so a color costs 3 lookups instead of two bit-by-bit loops.
+struct morton_halton_rgb_byte_tables {
+  uint32_t colors[3][256] = {}; // packed as r + 256*g + 65536*b
+  constexpr morton_halton_rgb_byte_tables() {
+    for(uint32_t k=0; k<3; ++k) {
+      for(uint32_t v=0; v<256; ++v) {
+        const std::array<uint8_t,3> rgb = morton_halton_curve<uint8_t,3,8>(v << (8*k));
+        colors[k][v] = static_cast<uint32_t>(rgb[0]) | (static_cast<uint32_t>(rgb[1]) << 8) | (static_cast<uint32_t>(rgb[2]) << 16);
+      }
+    }
+  }
+};
+inline constexpr morton_halton_rgb_byte_tables morton_halton_rgb_tables{};
+
+// same color as morton_halton_curve_rgb_3d(i), packed as r + 256*g + 65536*b
+inline uint32_t morton_halton_curve_rgb_3d_packed(uint32_t i) {
+  return morton_halton_rgb_tables.colors[0][i & 255u]
+       | morton_halton_rgb_tables.colors[1][(i >> 8) & 255u]
+       | morton_halton_rgb_tables.colors[2][(i >> 16) & 255u];
+}
+
+// one bit per 24-bit color (2 MB), for tracking which colors of a colormap are taken
+class color24_bitset {
+  std::vector<uint64_t> words;
+public:
+  color24_bitset() : words((1u << 24) / 64u, 0ull) {}
+  // returns whether the color was already set
+  inline bool test_and_set(uint32_t color) {
+    color &= 0xFFFFFFu;
+    uint64_t& word = words[color >> 6];
+    const uint64_t bit = 1ull << (color & 63u);
+    const bool was_set = (word & bit) != 0ull;
+    word |= bit;
+    return was_set;
+  }
+};
@@ -1,14 +1,40 @@
 // Copyright (C) 2023 Jason Bunk
 #pragma once
 #include <reshade.hpp>
+#include "shader_types.hpp"
+#include "segmentation_shadering/custom_shader_layout_registers.hpp"
+#include <array>
 #include <vector>
 
+// shader stages whose bound pipeline we track; indexes into segmentation_app_cmdlist_state::bound_shaders
+enum segapp_tracked_stage : uint32_t {
+	segapp_stage_vertex = 0,
+	segapp_stage_pixel,
+	segapp_num_tracked_stages,
+};
+constexpr reshade::api::pipeline_stage segapp_tracked_stage_flags[segapp_num_tracked_stages] = {
+	reshade::api::pipeline_stage::vertex_shader,
+	reshade::api::pipeline_stage::pixel_shader,
+};
+
+// Looked up once when a pipeline is bound, so that each draw only needs to read this
+struct bound_shader_draw_info {
+	reshade::api::pipeline pipeline = { 0 };
+	shader_hash_t shader_hash = 0ull;
+	bool has_custom_registers = false; // only for pixel shaders which we successfully customized
+	custom_shader_layout_registers registers;
+};
+
 class __declspec(uuid("78aad126-d069-424c-aa0a-77ee31f8c1c1")) segmentation_app_cmdlist_state {
 	bool my_bonus_rtv_is_bound = false;
 public:
 	std::vector<reshade::api::resource_view> rtvs;
 	reshade::api::resource_view dsv;
-	std::unordered_map<reshade::api::pipeline_stage, reshade::api::pipeline> pipelines; // track bound shaders
+	std::array<bound_shader_draw_info, segapp_num_tracked_stages> bound_shaders; // track bound shaders
+
+	inline perdraw_metadata_type get_draw_metadata(uint32_t draw_num_vertices) const {
+		return { draw_num_vertices, bound_shaders[segapp_stage_vertex].shader_hash, bound_shaders[segapp_stage_pixel].shader_hash };
+	}
 
 	// returns true upon state change
 	inline bool bind_bonus_rtv_if_not_bound(reshade::api::command_list* cmd_list, reshade::api::resource_view& extra_rtv) {
@@ -36,6 +62,6 @@ public:
 		my_bonus_rtv_is_bound = false;
 		rtvs.clear();
 		dsv = { 0 };
-		pipelines.clear();
+		bound_shaders.fill(bound_shader_draw_info());
 	}
 };
@@ -0,0 +1,154 @@
+// Copyright (C) 2023 Jason Bunk
+#include "customized_shader_disk_cache.hpp"
+#include "customized_shader_disk_cache_format.hpp"
+#include <Windows.h>
+#include <cstring>
+
+customized_shader_disk_cache::~customized_shader_disk_cache() {
+	close();
+}
+
+bool customized_shader_disk_cache::map_file(uint64_t nbytes) {
+	if (nbytes == 0) return true;
+	mapping_handle = CreateFileMappingW(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_handle == nullptr) return false;
+	mapped = static_cast<const uint8_t*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, static_cast<SIZE_T>(nbytes)));
+	if (mapped == nullptr) {
+		CloseHandle(mapping_handle);
+		mapping_handle = nullptr;
+		return false;
+	}
+	mapped_size = nbytes;
+	return true;
+}
+
+void customized_shader_disk_cache::unmap_file() {
+	index.clear();
+	if (mapped != nullptr) UnmapViewOfFile(mapped);
+	if (mapping_handle != nullptr) CloseHandle(mapping_handle);
+	mapped = nullptr;
+	mapping_handle = nullptr;
+	mapped_size = 0;
+}
+
+bool customized_shader_disk_cache::write_at_end(const void* data, uint32_t nbytes) {
+	LARGE_INTEGER zero;
+	zero.QuadPart = 0;
+	if (!SetFilePointerEx(file_handle, zero, nullptr, FILE_END)) return false;
+	DWORD written = 0;
+	return WriteFile(file_handle, data, nbytes, &written, nullptr) && written == nbytes;
+}
+
+bool customized_shader_disk_cache::open(const std::wstring& filepath, uint32_t customizer_version, std::string& log) {
+	close();
+	// no write sharing: if two processes of the same game are running, the second runs without a cache
+	HANDLE fh = CreateFileW(filepath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fh == INVALID_HANDLE_VALUE) {
+		log = std::string("failed to open shader cache file, error ") + std::to_string(GetLastError());
+		return false;
+	}
+	file_handle = fh;
+	LARGE_INTEGER fsize;
+	if (!GetFileSizeEx(fh, &fsize)) {
+		log = std::string("failed to get size of shader cache file");
+		close();
+		return false;
+	}
+
+	customized_shader_cache_file_header fhdr;
+	fhdr.init(customizer_version);
+
+	bool header_ok = false;
+	if (static_cast<uint64_t>(fsize.QuadPart) >= sizeof(customized_shader_cache_file_header)) {
+		customized_shader_cache_file_header ondisk;
+		DWORD nread = 0;
+		if (ReadFile(fh, &ondisk, sizeof(ondisk), &nread, nullptr) && nread == sizeof(ondisk)) {
+			header_ok = std::memcmp(&ondisk, &fhdr, sizeof(fhdr)) == 0;
+		}
+	}
+	if (!header_ok) {
+		// new file, or one written by a different version of the customizer: start over
+		if (fsize.QuadPart > 0) log += std::string("shader cache was written by a different version, discarding it; ");
+		LARGE_INTEGER zero;
+		zero.QuadPart = 0;
+		if (!SetFilePointerEx(fh, zero, nullptr, FILE_BEGIN) || !SetEndOfFile(fh) || !write_at_end(&fhdr, sizeof(fhdr))) {
+			log += std::string("failed to initialize shader cache file");
+			close();
+			return false;
+		}
+		fsize.QuadPart = sizeof(customized_shader_cache_file_header);
+	}
+
+	if (!map_file(static_cast<uint64_t>(fsize.QuadPart))) {
+		log += std::string("failed to memory-map shader cache file, error ") + std::to_string(GetLastError());
+		close();
+		return false;
+	}
+
+	uint64_t pos = sizeof(customized_shader_cache_file_header);
+	while (pos + sizeof(customized_shader_cache_record_header) <= mapped_size) {
+		customized_shader_cache_record_header rh;
+		std::memcpy(&rh, mapped + pos, sizeof(rh));
+		const uint64_t recsize = sizeof(rh) + customized_shader_cache_record_header::padded_code_size(rh.code_size);
+		if (pos + recsize > mapped_size) break;
+		const uint8_t* code = mapped + pos + sizeof(rh);
+		if (rh.compute_checksum(code) != rh.checksum) break;
+		customized_shader_cache_entry entry;
+		entry.succeeded = (rh.flags & customized_shader_cache_record_flag_succeeded) != 0;
+		entry.registers.perdrawbuf_tex_regL = rh.perdrawbuf_tex_regL;
+		entry.registers.perdrawbuf_tex_regH = rh.perdrawbuf_tex_regH;
+		entry.registers.rendertarget_index = rh.rendertarget_index;
+		entry.code = code;
+		entry.code_size = rh.code_size;
+		shader_hash128_t key;
+		key.lo = rh.key_lo;
+		key.hi = rh.key_hi;
+		index[key] = entry;
+		pos += recsize;
+	}
+
+	if (pos < mapped_size) {
+		// partially written record at the end: cut it off, so that new records are appended after valid ones
+		log += std::string("truncating damaged shader cache from ") + std::to_string(mapped_size) + std::string(" to ") + std::to_string(pos) + std::string(" bytes; ");
+		unmap_file();
+		LARGE_INTEGER newend;
+		newend.QuadPart = static_cast<LONGLONG>(pos);
+		if (!SetFilePointerEx(fh, newend, nullptr, FILE_BEGIN) || !SetEndOfFile(fh)) {
+			log += std::string("failed to truncate shader cache file");
+			close();
+			return false;
+		}
+		return open(filepath, customizer_version, log);
+	}
+
+	log += std::string("loaded ") + std::to_string(index.size()) + std::string(" cached shaders (") + std::to_string(mapped_size) + std::string(" bytes)");
+	return true;
+}
+
+void customized_shader_disk_cache::close() {
+	unmap_file();
+	if (file_handle != nullptr) CloseHandle(file_handle);
+	file_handle = nullptr;
+	append_failed = false;
+}
+
+bool customized_shader_disk_cache::find(const shader_hash128_t& key, customized_shader_cache_entry& entry) const {
+	auto it = index.find(key);
+	if (it == index.end()) return false;
+	entry = it->second;
+	return true;
+}
+
+void customized_shader_disk_cache::append(const shader_hash128_t& key, bool succeeded, const custom_shader_layout_registers& registers, const uint8_t* code, uint32_t code_size) {
+	customized_shader_cache_record_header rh;
+	rh.init(key, succeeded, registers, code, code_size);
+	static constexpr uint8_t zeros[4] = { 0, 0, 0, 0 };
+	const uint32_t npad = static_cast<uint32_t>(customized_shader_cache_record_header::padded_code_size(rh.code_size) - rh.code_size);
+
+	std::lock_guard<std::mutex> lock(append_mutex);
+	if (file_handle == nullptr || append_failed) return;
+	// if any write fails, stop appending: the checksum will cut off the partial record on the next launch
+	append_failed = !write_at_end(&rh, sizeof(rh))
+		|| (rh.code_size > 0 && !write_at_end(code, rh.code_size))
+		|| (npad > 0 && !write_at_end(zeros, npad));
+}
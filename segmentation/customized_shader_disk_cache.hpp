@@ -0,0 +1,51 @@
+// Copyright (C) 2023 Jason Bunk
+#pragma once
+#include "customized_shader_disk_cache_format.hpp"
+#include <unordered_map>
+#include <mutex>
+#include <string>
+
+struct customized_shader_cache_entry {
+	bool succeeded = false; // failures are cached too, so we don't try again to customize shaders we can't
+	custom_shader_layout_registers registers;
+	const uint8_t* code = nullptr; // points into the memory-mapped file
+	uint32_t code_size = 0;
+};
+
+/*
+* Customizing shaders (parse, edit, re-encode) is slow, and games can have tens of thousands of them,
+* which causes long loading hitches every time the game is launched.
+* This caches the results on disk, in one append-only file, keyed by a 128-bit hash of the original bytecode.
+* The file is memory-mapped when opened: entries found in it are read straight from the mapping.
+* New entries are appended to the file (but not added to the lookup index until the next launch).
+* The whole file is thrown away if it was written by a different version of the shader customizer.
+*/
+class customized_shader_disk_cache {
+public:
+	~customized_shader_disk_cache();
+
+	bool open(const std::wstring& filepath, uint32_t customizer_version, std::string& log);
+	void close();
+	inline bool is_open() const { return file_handle != nullptr; }
+
+	// lock-free: the index is built once in open() and never modified afterwards
+	bool find(const shader_hash128_t& key, customized_shader_cache_entry& entry) const;
+
+	void append(const shader_hash128_t& key, bool succeeded, const custom_shader_layout_registers& registers, const uint8_t* code, uint32_t code_size);
+
+	inline size_t num_loaded_entries() const { return index.size(); }
+	inline uint64_t num_bytes_mapped() const { return mapped_size; }
+
+private:
+	bool map_file(uint64_t nbytes);
+	void unmap_file();
+	bool write_at_end(const void* data, uint32_t nbytes);
+
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+	const uint8_t* mapped = nullptr;
+	uint64_t mapped_size = 0;
+	std::unordered_map<shader_hash128_t, customized_shader_cache_entry, shader_hash128_hasher> index;
+	std::mutex append_mutex;
+	bool append_failed = false;
+};
@@ -0,0 +1,83 @@
+// Copyright (C) 2023 Jason Bunk
+#pragma once
+#include "segmentation_shadering/custom_shader_layout_registers.hpp"
+#include "segmentation_shadering/graphics_api_enum.hpp"
+#include "xxhash.h"
+#include <cstddef>
+#include <cstring>
+
+/*
+* On-disk format of the customized shader cache, shared by the addon and the offline batch customizer, so no platform headers here.
+* File layout (little endian):
+*   file header: magic[8], uint32 file_format_version, uint32 customizer_version, uint64 reserved
+*   then records, each: record header (below), followed by code_size bytes of bytecode, padded to a multiple of 4 bytes
+* A record whose checksum doesn't match (e.g. the game crashed while appending it) ends the file: it is truncated there.
+*/
+static constexpr uint32_t customized_shader_cache_file_format_version = 1;
+static constexpr char customized_shader_cache_file_magic[8] = { 'G','C','V','S','H','D','R','C' };
+static constexpr uint32_t customized_shader_cache_record_flag_succeeded = 1u;
+
+struct shader_hash128_t {
+	uint64_t lo = 0ull;
+	uint64_t hi = 0ull;
+	inline bool operator==(const shader_hash128_t& other) const { return lo == other.lo && hi == other.hi; }
+};
+struct shader_hash128_hasher {
+	inline size_t operator()(const shader_hash128_t& h) const { return static_cast<size_t>(h.lo ^ (h.hi * 0x9e3779b97f4a7c15ull)); }
+};
+
+// hash of the original (game's) bytecode; the shader type and graphics api are mixed in since they change how it is customized
+inline shader_hash128_t hash_original_shader_bytecode(const void* code, size_t code_size, bool b_truepixel_falsevertex, my_graphics_api::api_enum graphics_api) {
+	const uint64_t seed = (static_cast<uint64_t>(graphics_api) << 1) | (b_truepixel_falsevertex ? 1ull : 0ull);
+	const XXH128_hash_t h = XXH3_128bits_withSeed(code, code_size, seed);
+	shader_hash128_t ret;
+	ret.lo = h.low64;
+	ret.hi = h.high64;
+	return ret;
+}
+
+#pragma pack(push, 1)
+struct customized_shader_cache_file_header {
+	char magic[8];
+	uint32_t file_format_version;
+	uint32_t customizer_version;
+	uint64_t reserved;
+
+	inline void init(uint32_t customizer_version_) {
+		std::memcpy(magic, customized_shader_cache_file_magic, sizeof(magic));
+		file_format_version = customized_shader_cache_file_format_version;
+		customizer_version = customizer_version_;
+		reserved = 0;
+	}
+};
+struct customized_shader_cache_record_header {
+	uint64_t key_lo;
+	uint64_t key_hi;
+	uint32_t flags;
+	int32_t perdrawbuf_tex_regL;
+	int32_t perdrawbuf_tex_regH;
+	int32_t rendertarget_index;
+	uint32_t code_size;
+	uint32_t checksum; // of the above fields and the bytecode
+
+	static inline uint64_t padded_code_size(uint32_t code_size) { return (static_cast<uint64_t>(code_size) + 3ull) & ~3ull; }
+
+	inline uint32_t compute_checksum(const uint8_t* code) const {
+		return XXH32(code, code_size, XXH32(this, offsetof(customized_shader_cache_record_header, checksum), 0));
+	}
+
+	// failed shaders are stored without code
+	inline void init(const shader_hash128_t& key, bool succeeded, const custom_shader_layout_registers& registers, const uint8_t* code, uint32_t code_size_) {
+		key_lo = key.lo;
+		key_hi = key.hi;
+		flags = succeeded ? customized_shader_cache_record_flag_succeeded : 0u;
+		perdrawbuf_tex_regL = registers.perdrawbuf_tex_regL;
+		perdrawbuf_tex_regH = registers.perdrawbuf_tex_regH;
+		rendertarget_index = registers.rendertarget_index;
+		code_size = succeeded ? code_size_ : 0u;
+		checksum = compute_checksum(code);
+	}
+};
+#pragma pack(pop)
+static_assert(sizeof(customized_shader_cache_file_header) == 24, "customized_shader_cache_file_header");
+static_assert(sizeof(customized_shader_cache_record_header) == 40, "customized_shader_cache_record_header");
@@ -0,0 +1,117 @@
+// Copyright (C) 2023 Jason Bunk
+#pragma once
+#include "shader_types.hpp"
+#include "segmentation_shadering/custom_shader_layout_registers.hpp"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstring>
+
+struct customized_shader {
+	const uint8_t* code = nullptr;
+	uint32_t code_size = 0;
+	custom_shader_layout_registers registers;
+};
+
+struct customized_shader_store_stats {
+	uint32_t num_customized = 0;
+	uint32_t num_from_disk_cache = 0; // these point into the disk cache's mapped file, and take no arena space
+	uint32_t num_failed = 0;
+	uint64_t arena_bytes_used = 0;
+	uint64_t arena_bytes_reserved = 0;
+};
+
+/*
+* Keeps the bytecode of every shader we successfully customized, for the lifetime of the device
+* (the game may create several pipelines from the same shader, and the driver may read the code after pipeline creation).
+* Code is copied into a bump allocator that is only freed all at once, so there is no per-shader heap allocation.
+* Shaders that failed to customize are remembered only by hash, so we don't keep the game's original bytes.
+*/
+class customized_shader_store {
+	static constexpr size_t arena_block_size = 1u << 20;
+	static constexpr size_t arena_alignment = 16;
+
+	mutable std::mutex mut;
+	std::vector<std::unique_ptr<uint8_t[]>> arena_blocks;
+	size_t arena_block_used = arena_block_size; // bytes used in the last block of arena_blocks
+	std::unordered_map<shader_hash_t, customized_shader> customized;
+	std::unordered_set<shader_hash_t> failed;
+	customized_shader_store_stats stats;
+
+	// assumes lock is held
+	inline uint8_t* arena_alloc(size_t nbytes) {
+		nbytes = (nbytes + arena_alignment - 1) & ~(arena_alignment - 1);
+		if (nbytes > arena_block_size / 4) {
+			// big shaders get their own block, inserted before the current block so its remaining space isn't wasted
+			auto where = arena_blocks.empty() ? arena_blocks.end() : (arena_blocks.end() - 1);
+			uint8_t* ret = arena_blocks.insert(where, std::unique_ptr<uint8_t[]>(new uint8_t[nbytes]))->get();
+			stats.arena_bytes_reserved += nbytes;
+			stats.arena_bytes_used += nbytes;
+			return ret;
+		}
+		if (arena_block_used + nbytes > arena_block_size) {
+			arena_blocks.emplace_back(new uint8_t[arena_block_size]);
+			arena_block_used = 0;
+			stats.arena_bytes_reserved += arena_block_size;
+		}
+		uint8_t* ret = arena_blocks.back().get() + arena_block_used;
+		arena_block_used += nbytes;
+		stats.arena_bytes_used += nbytes;
+		return ret;
+	}
+
+public:
+	enum lookup_result {
+		not_seen = 0,
+		known_customized,
+		known_failed,
+	};
+
+	inline lookup_result find(shader_hash_t hash, customized_shader& shader) const {
+		std::lock_guard<std::mutex> lock(mut);
+		if (auto it = customized.find(hash); it != customized.end()) {
+			shader = it->second;
+			return known_customized;
+		}
+		return failed.count(hash) ? known_failed : not_seen;
+	}
+
+	// copies the code into the arena; if another thread already added this hash, returns that one instead
+	inline customized_shader add_customized_copy(shader_hash_t hash, const uint8_t* code, uint32_t code_size, const custom_shader_layout_registers& registers) {
+		std::lock_guard<std::mutex> lock(mut);
+		if (auto it = customized.find(hash); it != customized.end()) return it->second;
+		customized_shader& shader = customized[hash];
+		uint8_t* dst = arena_alloc(code_size);
+		std::memcpy(dst, code, code_size);
+		shader.code = dst;
+		shader.code_size = code_size;
+		shader.registers = registers;
+		stats.num_customized++;
+		return shader;
+	}
+
+	// doesn't copy: the code must outlive this store (i.e. it is in the memory-mapped disk cache)
+	inline customized_shader add_customized_external(shader_hash_t hash, const uint8_t* code, uint32_t code_size, const custom_shader_layout_registers& registers) {
+		std::lock_guard<std::mutex> lock(mut);
+		if (auto it = customized.find(hash); it != customized.end()) return it->second;
+		customized_shader& shader = customized[hash];
+		shader.code = code;
+		shader.code_size = code_size;
+		shader.registers = registers;
+		stats.num_customized++;
+		stats.num_from_disk_cache++;
+		return shader;
+	}
+
+	inline void add_failed(shader_hash_t hash) {
+		std::lock_guard<std::mutex> lock(mut);
+		if (failed.insert(hash).second) stats.num_failed++;
+	}
+
+	inline customized_shader_store_stats get_stats() const {
+		std::lock_guard<std::mutex> lock(mut);
+		return stats;
+	}
+};
@@ -15,25 +15,97 @@
 * A custom shader can draw that "draw index" as a pixel segmentation map.
 * Meanwhile, metadata for each draw call is stashed here to interpret that segmentation map.
 *
+* The views (and the metadata slots) are created lazily in chunks: the buffer is sized for the maximum number of draws,
+* but we only create views for as many draws as have been seen in a frame (plus some headroom).
+* They only grow at the end of a frame, so the draw hook never allocates: draws beyond the current capacity
+* are left unsegmented for that frame, and the next frame has room for them. Views are kept and reused across frames.
+*
 * UPDATE: The above works for DirectX 10 and 11. For DirectX 12, instead of creating lots of views,
 * we can just bind a counter offset to the resource using "SetGraphicsRootShaderResourceView()".
 */
 
+struct draws_counting_data_buffer_stats {
+	uint32_t num_views = 0u;
+	uint32_t max_num_views = 0u;
+	uint32_t last_frame_num_draws = 0u;
+	uint32_t peak_frame_num_draws = 0u;
+	uint64_t num_frames_wrapped = 0ull;
+	bool last_frame_wrapped = false;
+};
+
 template<typename MetaT>
 class draws_counting_data_buffer : public resource_helper {
-	std::vector<uint32_t> cpu_data;
+	static constexpr uint32_t max_num_views = 1u << 20; // the buffer itself is cheap (4 MB); the views are not
+	static constexpr uint32_t views_chunk_size = 2048u;
+
 	std::vector<reshade::api::resource_view> ridiculous_number_of_views;
+	bool binds_offsets_not_views = false; // D3D12: no views are created, only the metadata is stashed
+	bool view_creation_failed = false; // stop trying to grow if the driver refused
+	bool logged_wrap_at_max_capacity = false;
 
 	std::mutex frame_mut;
 	bool counter_wrapped = false;
-	std::vector<MetaT> perdraw_meta;
+	std::vector<MetaT> perdraw_meta; // its size is the capacity for this frame
 	uint32_t perdraw_counter = 1u;
+	uint32_t perdraw_requested = 1u; // including draws beyond the capacity
+	draws_counting_data_buffer_stats stats;
+
+	// assumes frame_mut is locked; only called between frames
+	inline bool create_next_chunk_of_views(reshade::api::device* device) {
+		if (device == nullptr || !isvalid || view_creation_failed || binds_offsets_not_views) return false;
+		const size_t oldsize = ridiculous_number_of_views.size();
+		const size_t newsize = std::min<size_t>(max_num_views, oldsize + views_chunk_size);
+		if (newsize <= oldsize) return false;
+		ridiculous_number_of_views.resize(newsize, { 0ull });
+		for (size_t ii = oldsize; ii < newsize; ++ii) {
+			if (!device->create_resource_view(rsc, reshade::api::resource_usage::shader_resource, reshade::api::resource_view_desc(reshade::api::format::r32_uint, ii, 1u), &(ridiculous_number_of_views[ii]))) {
+				reshade::log_message(reshade::log_level::error, std::string(std::string("draws_counting_data_buffer: Failed to create resource view ") + std::to_string(ii)).c_str());
+				ridiculous_number_of_views.resize(ii);
+				view_creation_failed = true;
+				break;
+			}
+		}
+		perdraw_meta.resize(ridiculous_number_of_views.size());
+		stats.num_views = static_cast<uint32_t>(ridiculous_number_of_views.size());
+		if (ridiculous_number_of_views.size() > oldsize)
+			reshade::log_message(reshade::log_level::info, std::string(std::string("draws_counting_data_buffer: grew to ")+std::to_string(ridiculous_number_of_views.size())+std::string(" draw views")).c_str());
+		return ridiculous_number_of_views.size() > oldsize;
+	}
+	// assumes frame_mut is locked; only called between frames
+	inline bool grow_by_one_chunk(reshade::api::device* device) {
+		if (device == nullptr || !isvalid) return false;
+		if (!binds_offsets_not_views) return create_next_chunk_of_views(device);
+		// D3D12 binds offsets into the buffer, so only the metadata grows
+		const size_t oldsize = perdraw_meta.size();
+		perdraw_meta.resize(std::min<size_t>(max_num_views, oldsize + views_chunk_size));
+		stats.num_views = static_cast<uint32_t>(perdraw_meta.size());
+		return perdraw_meta.size() > oldsize;
+	}
 
 public:
-	inline void reset_at_end_of_frame() {
+	// Call once per frame. If last frame came close to (or went beyond) the capacity, grow it now rather than mid-frame.
+	inline void reset_at_end_of_frame(reshade::api::device* device) {
 		std::lock_guard<std::mutex> lock(frame_mut);
+		stats.last_frame_num_draws = perdraw_requested - 1u;
+		stats.peak_frame_num_draws = std::max(stats.peak_frame_num_draws, stats.last_frame_num_draws);
+		stats.last_frame_wrapped = counter_wrapped;
+		if (counter_wrapped) stats.num_frames_wrapped++;
+		const size_t wanted = std::min<size_t>(max_num_views, static_cast<size_t>(perdraw_requested) + views_chunk_size / 4u);
+		while (!perdraw_meta.empty() && perdraw_meta.size() < wanted && grow_by_one_chunk(device)) {}
 		counter_wrapped = false;
 		perdraw_counter = 1u; // the 0th entry is for "null" case and its metadata is never touched
+		perdraw_requested = 1u;
+	}
+
+	// draws given a view since the last reset_at_end_of_frame
+	inline uint32_t num_draws_this_frame() {
+		std::lock_guard<std::mutex> lock(frame_mut);
+		return perdraw_requested - 1u;
+	}
+
+	inline draws_counting_data_buffer_stats get_stats() {
+		std::lock_guard<std::mutex> lock(frame_mut);
+		return stats;
 	}
 
 	inline reshade::api::resource_view get_view_for_blank_or_null_draw() const {
@@ -54,18 +126,29 @@ public:
 		return std::vector<MetaT>(perdraw_meta.begin(), perdraw_meta.begin()+perdraw_counter);
 	}
 
+	// On D3D12 this returns a null view, but still stashes the metadata: the draw's offset into the buffer
+	// is num_draws_this_frame() before the call, plus one (or 0, the "null" case, if the capacity ran out).
 	template<typename MetaT>
 	inline reshade::api::resource_view stash_metadata_and_get_view_for_draw(const MetaT meta) {
 		std::lock_guard<std::mutex> lock(frame_mut);
-		if (ridiculous_number_of_views.empty() || perdraw_meta.empty()) {
+		if (perdraw_meta.empty() || (!binds_offsets_not_views && ridiculous_number_of_views.empty())) {
 			reshade::log_message(reshade::log_level::error, "draws_counting_data_buffer: need to create buffer before using");
 			return { 0ull };
 		}
+		perdraw_requested++;
 		if (perdraw_counter >= perdraw_meta.size()) {
+			if (!counter_wrapped && !logged_wrap_at_max_capacity && perdraw_meta.size() >= max_num_views) {
+				logged_wrap_at_max_capacity = true;
+				reshade::log_message(reshade::log_level::warning, "draws_counting_data_buffer: ran out of draw views at max capacity; further draws this frame are not segmented");
+			}
 			counter_wrapped = true;
-			return ridiculous_number_of_views[0]; // "null" case
+			return binds_offsets_not_views ? reshade::api::resource_view{ 0ull } : ridiculous_number_of_views[0]; // "null" case
 		}
 		perdraw_meta[perdraw_counter] = meta;
+		if (binds_offsets_not_views) {
+			perdraw_counter++;
+			return { 0ull };
+		}
 		return ridiculous_number_of_views[perdraw_counter++];
 	}
 
@@ -76,10 +159,8 @@ public:
 		attemptedcreation = true;
 		const reshade::api::resource_usage resourceusage = reshade::api::resource_usage::shader_resource;
 
-		const uint64_t num_views = 16384ull;
-
-		reshade::api::resource_desc desc(num_views*4ull, reshade::api::memory_heap::gpu_only, resourceusage);
-		cpu_data.resize(num_views*4ull);
+		reshade::api::resource_desc desc(max_num_views*sizeof(uint32_t), reshade::api::memory_heap::gpu_only, resourceusage);
+		std::vector<uint32_t> cpu_data(max_num_views);
 		for (uint32_t ii = 0; ii < cpu_data.size(); ++ii) cpu_data[ii] = ii;
 		reshade::api::subresource_data initial_data;
 		initial_data.data = cpu_data.data();
@@ -88,21 +169,24 @@ public:
 			reshade::log_message(reshade::log_level::error, "draws_counting_data_buffer: Failed to create resource!");
 			return false;
 		}
-
-		perdraw_meta.resize(num_views);
-
-		if (device->get_api() != reshade::api::device_api::d3d12) {
-			ridiculous_number_of_views.resize(num_views);
-			for (size_t ii = 0; ii < ridiculous_number_of_views.size(); ++ii)
-				if (!device->create_resource_view(rsc, resourceusage, reshade::api::resource_view_desc(reshade::api::format::r32_uint, ii, 1u), &(ridiculous_number_of_views[ii]))) {
-					reshade::log_message(reshade::log_level::error, std::string(std::string("draws_counting_data_buffer: Failed to create resource view ") + std::to_string(ii)).c_str());
-					device->destroy_resource(rsc);
-					return false;
-				}
+		isvalid = true;
+		stats = draws_counting_data_buffer_stats();
+		stats.max_num_views = max_num_views;
+
+		binds_offsets_not_views = device->get_api() == reshade::api::device_api::d3d12;
+		if (!binds_offsets_not_views) {
+			if (!create_next_chunk_of_views(device)) {
+				device->destroy_resource(rsc);
+				rsc.handle = 0ull;
+				isvalid = false;
+				return false;
+			}
+		} else {
+			perdraw_meta.resize(views_chunk_size);
+			stats.num_views = views_chunk_size;
 		}
 
-		isvalid = true;
-		reshade::log_message(reshade::log_level::info, std::string(std::string("draws_counting_data_buffer: successfully created counter for up to ")+std::to_string(num_views)+std::string(" draws")).c_str());
+		reshade::log_message(reshade::log_level::info, std::string(std::string("draws_counting_data_buffer: successfully created counter for up to ")+std::to_string(max_num_views)+std::string(" draws")).c_str());
 		return isvalid;
 	}
 
@@ -113,6 +197,8 @@ public:
 			for (auto& rsv : ridiculous_number_of_views)
 				device->destroy_resource_view(rsv);
 			ridiculous_number_of_views.clear();
+			perdraw_meta.clear();
+			view_creation_failed = false;
 			device->destroy_resource(rsc);
 			rsc.handle = 0ull;
 		}
@@ -0,0 +1,157 @@
+// Copyright (C) 2023 Jason Bunk
+#include "instance_grouping.hpp"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <cmath>
+
+static constexpr uint32_t grouping_band_rows = 64;
+
+// the root of each set is its smallest pixel index, so roots are the first pixel of their group in raster order
+static inline uint32_t find_root(uint32_t* parent, uint32_t ii) {
+	while (parent[ii] != ii) {
+		parent[ii] = parent[parent[ii]]; // path halving
+		ii = parent[ii];
+	}
+	return ii;
+}
+static inline uint32_t find_root_readonly(const uint32_t* parent, uint32_t ii) {
+	while (parent[ii] != ii) ii = parent[ii];
+	return ii;
+}
+static inline void unite(uint32_t* parent, uint32_t aa, uint32_t bb) {
+	aa = find_root(parent, aa);
+	bb = find_root(parent, bb);
+	if (aa < bb) parent[bb] = aa;
+	else if (bb < aa) parent[aa] = bb;
+}
+
+// runs fn(band) for every band, spread over threads which take the next band as they finish one
+template<typename FnT>
+static void parallel_for_bands(uint32_t num_bands, uint32_t num_threads, const FnT& fn) {
+	num_threads = std::max(1u, std::min(num_threads, num_bands));
+	std::atomic<uint32_t> next_band = { 0 };
+	auto worker = [&]() {
+		for (uint32_t band = next_band++; band < num_bands; band = next_band++) fn(band);
+	};
+	std::vector<std::thread> threads;
+	for (uint32_t tt = 1; tt < num_threads; ++tt) threads.emplace_back(worker);
+	worker();
+	for (std::thread& thr : threads) thr.join();
+}
+
+namespace {
+struct part_connectivity {
+	const instance_grouping_input& in;
+	const instance_grouping_rules& rules;
+	std::vector<uint64_t> draw_merge_keys; // parts of draws with equal keys may be merged
+	bool check_depth;
+
+	part_connectivity(const instance_grouping_input& input, const instance_grouping_rules& rules_)
+		: in(input), rules(rules_), check_depth(input.depth != nullptr && rules_.max_relative_depth_step > 0.0f) {
+		if (rules.merges_different_parts()) {
+			draw_merge_keys.resize(in.draw_metadata->size());
+			for (size_t dd = 0; dd < draw_merge_keys.size(); ++dd) {
+				const perdraw_metadata_type& meta = (*in.draw_metadata)[dd];
+				uint64_t key = 0ull;
+				if (rules.merge_parts_with_same_vertex_shader) key ^= meta[pdm_vertex_shader_hash];
+				if (rules.merge_parts_with_same_pixel_shader) key ^= meta[pdm_pixel_shader_hash] * 0x9E3779B97F4A7C15ull;
+				draw_merge_keys[dd] = key;
+			}
+		}
+	}
+
+	inline const uint32_t* pixel(uint32_t y, uint32_t x) const {
+		return reinterpret_cast<const uint32_t*>(in.seg_rows + y * in.seg_row_pitch) + x * 4u;
+	}
+
+	// pixel indices are y*width+x; pa and pb point at the segmentation data of those pixels
+	inline bool connected(const uint32_t* pa, const uint32_t* pb, size_t ia, size_t ib) const {
+		if (pa[0] == pb[0] && pa[1] == pb[1]) return true; // same part: (draw, instance)
+		if (draw_merge_keys.empty()) return false;
+		const size_t last = draw_merge_keys.size() - 1ull;
+		if (draw_merge_keys[std::min<size_t>(pa[0], last)] != draw_merge_keys[std::min<size_t>(pb[0], last)]) return false;
+		if (!check_depth) return true;
+		const float za = std::abs(in.depth[ia]);
+		const float zb = std::abs(in.depth[ib]);
+		return std::abs(za - zb) <= rules.max_relative_depth_step * std::max(std::min(za, zb), 1e-20f);
+	}
+};
+}
+
+uint32_t group_connected_instances(const instance_grouping_input& input, const instance_grouping_rules& rules,
+	uint32_t num_threads, std::vector<uint32_t>& workspace, uint32_t* out_group_ids)
+{
+	const uint32_t width = input.width;
+	const uint32_t height = input.height;
+	if (width == 0 || height == 0 || input.seg_rows == nullptr || input.draw_metadata == nullptr || input.draw_metadata->empty()) return 0;
+	const part_connectivity conn(input, rules);
+	const uint32_t num_bands = (height + grouping_band_rows - 1u) / grouping_band_rows;
+	workspace.resize(static_cast<size_t>(width) * height);
+	uint32_t* const parent = workspace.data();
+
+	// 1: label each band independently; unions only touch pixels of the band
+	parallel_for_bands(num_bands, num_threads, [&](uint32_t band) {
+		const uint32_t y0 = band * grouping_band_rows;
+		const uint32_t y1 = std::min(y0 + grouping_band_rows, height);
+		for (uint32_t y = y0; y < y1; ++y) {
+			const uint32_t rowstart = y * width;
+			for (uint32_t x = 0; x < width; ++x) {
+				const uint32_t ii = rowstart + x;
+				const uint32_t* pp = conn.pixel(y, x);
+				// ii is still a singleton here, so joining the left neighbor is just pointing at its root
+				parent[ii] = (x > 0 && conn.connected(pp, pp - 4, ii, ii - 1u)) ? find_root(parent, ii - 1u) : ii;
+				if (y > y0 && conn.connected(pp, conn.pixel(y - 1u, x), ii, ii - width)) unite(parent, ii, ii - width);
+			}
+		}
+	});
+
+	// 2: merge across band boundaries (only one row per band, so this is cheap to do on one thread)
+	for (uint32_t band = 1; band < num_bands; ++band) {
+		const uint32_t y = band * grouping_band_rows;
+		for (uint32_t x = 0; x < width; ++x) {
+			const uint32_t ii = y * width + x;
+			if (conn.connected(conn.pixel(y, x), conn.pixel(y - 1u, x), ii, ii - width)) unite(parent, ii, ii - width);
+		}
+	}
+
+	// 3: resolve every pixel's root (read-only, so bands can follow chains into each other), and count roots per band
+	std::vector<uint32_t> band_num_roots(num_bands, 0u);
+	parallel_for_bands(num_bands, num_threads, [&](uint32_t band) {
+		const uint32_t i0 = band * grouping_band_rows * width;
+		const uint32_t i1 = std::min(band * grouping_band_rows + grouping_band_rows, height) * width;
+		uint32_t nroots = 0;
+		for (uint32_t ii = i0; ii < i1; ++ii) {
+			// parents always have smaller indices, so a parent in this band was already resolved
+			const uint32_t pp = parent[ii];
+			out_group_ids[ii] = (pp == ii) ? ii : ((pp >= i0) ? out_group_ids[pp] : find_root_readonly(parent, pp));
+			nroots += (pp == ii) ? 1u : 0u;
+		}
+		band_num_roots[band] = nroots;
+	});
+
+	// 4: number the roots in raster order; parent[] is no longer needed as a forest, so a root's slot now holds its group ID
+	std::vector<uint32_t> band_first_group(num_bands, 0u);
+	uint32_t num_groups = 0;
+	for (uint32_t band = 0; band < num_bands; ++band) {
+		band_first_group[band] = num_groups;
+		num_groups += band_num_roots[band];
+	}
+	parallel_for_bands(num_bands, num_threads, [&](uint32_t band) {
+		const uint32_t i0 = band * grouping_band_rows * width;
+		const uint32_t i1 = std::min(band * grouping_band_rows + grouping_band_rows, height) * width;
+		uint32_t gid = band_first_group[band];
+		for (uint32_t ii = i0; ii < i1; ++ii) {
+			if (out_group_ids[ii] == ii) parent[ii] = gid++;
+		}
+	});
+
+	// 5: replace roots by group IDs
+	parallel_for_bands(num_bands, num_threads, [&](uint32_t band) {
+		const uint32_t i0 = band * grouping_band_rows * width;
+		const uint32_t i1 = std::min(band * grouping_band_rows + grouping_band_rows, height) * width;
+		for (uint32_t ii = i0; ii < i1; ++ii) out_group_ids[ii] = parent[out_group_ids[ii]];
+	});
+	return num_groups;
+}
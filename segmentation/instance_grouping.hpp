@@ -0,0 +1,34 @@
+// Copyright (C) 2023 Jason Bunk
+#pragma once
+#include "shader_types.hpp"
+#include <vector>
+#include <cstddef>
+
+/*
+* Many objects are drawn in several parts (e.g. a car's body and wheels are separate draws), so the (draw, instance) pairs
+* in the segmentation buffer are parts rather than objects. This groups them: 4-connected pixels are in the same group
+* if they are the same part, or if they are parts of different draws that the rules say could be one object.
+* Parallel union-find: the image is cut into bands of rows, each band is labeled by one thread, then the band boundaries are merged.
+* Group IDs are numbered 0,1,2,... in raster order of the first pixel of each group, so the output is deterministic.
+*/
+struct instance_grouping_rules {
+	bool merge_parts_with_same_vertex_shader = true;
+	bool merge_parts_with_same_pixel_shader = false;
+	// adjacent parts are only merged if their depths are within this fraction of each other (<= 0 disables, as does not having depth)
+	float max_relative_depth_step = 0.02f;
+
+	inline bool merges_different_parts() const { return merge_parts_with_same_vertex_shader || merge_parts_with_same_pixel_shader; }
+};
+
+struct instance_grouping_input {
+	const uint8_t* seg_rows = nullptr; // r32g32b32a32_uint: (draw index, instance ID, primitive ID, unused)
+	size_t seg_row_pitch = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	const std::vector<perdraw_metadata_type>* draw_metadata = nullptr; // draw indices beyond the end are clamped to the last one
+	const float* depth = nullptr; // optional, row-major width x height
+};
+
+// writes width*height group IDs into out_group_ids and returns the number of groups
+uint32_t group_connected_instances(const instance_grouping_input& input, const instance_grouping_rules& rules,
+	uint32_t num_threads, std::vector<uint32_t>& workspace, uint32_t* out_group_ids);
@@ -0,0 +1,146 @@
+// Copyright (C) 2023 Jason Bunk
+#pragma once
+#include "shader_types.hpp"
+#include "segmentation_shadering/custom_shader_layout_registers.hpp"
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+
+// What we learned about a pipeline (shader) when it was created and successfully customized
+struct pipeline_registration_record {
+	shader_hash_t vertex_shader_hash = 0ull;
+	shader_hash_t pixel_shader_hash = 0ull;
+	uint64_t pipeline_layout_handle = 0ull;
+	bool has_custom_registers = false; // only for pixel shaders
+	custom_shader_layout_registers registers;
+};
+
+/*
+* Open-addressing (linear probing) hash table from pipeline handle to registration record.
+* Pipelines are created (written) on loader threads, and bound (read) on render threads,
+* so the table is split into shards, each with its own reader/writer lock:
+* readers only contend with a writer if it happens to be writing into the same shard.
+* Entries are erased when the pipeline is destroyed, so games that stream shaders don't grow this forever.
+*/
+class pipeline_registration_table {
+	static constexpr uint64_t empty_key = 0ull; // pipeline handles are never null
+	static constexpr uint64_t tombstone_key = ~0ull;
+	static constexpr size_t num_shards = 16;
+	static constexpr size_t min_shard_capacity = 64;
+
+	struct slot {
+		uint64_t key = empty_key;
+		pipeline_registration_record rec;
+	};
+	struct alignas(64) shard {
+		mutable std::shared_mutex mut;
+		std::vector<slot> slots;
+		size_t num_live = 0;
+		size_t num_tombstones = 0;
+	};
+	std::array<shard, num_shards> shards;
+	std::atomic<size_t> total_live = { 0 };
+
+	static inline uint64_t mix_handle(uint64_t h) {
+		// splitmix64 finalizer: pipeline handles are pointers, so the low bits are mostly alignment
+		h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ull;
+		h ^= h >> 27; h *= 0x94d049bb133111ebull;
+		h ^= h >> 31;
+		return h;
+	}
+	static inline size_t shard_index(uint64_t mixed) { return static_cast<size_t>(mixed >> 60) & (num_shards - 1); }
+
+	// assumes shard is locked; returns index of the slot holding key, or slots.size() if not present
+	static size_t find_slot(const shard& sh, uint64_t key, uint64_t mixed) {
+		if (sh.slots.empty()) return 0;
+		const size_t mask = sh.slots.size() - 1;
+		for (size_t ii = static_cast<size_t>(mixed) & mask, probes = 0; probes < sh.slots.size(); ii = (ii + 1) & mask, ++probes) {
+			if (sh.slots[ii].key == key) return ii;
+			if (sh.slots[ii].key == empty_key) break;
+		}
+		return sh.slots.size();
+	}
+
+	// assumes shard is write-locked
+	static void rehash(shard& sh, size_t newcapacity) {
+		std::vector<slot> old;
+		old.swap(sh.slots);
+		sh.slots.resize(newcapacity);
+		sh.num_tombstones = 0;
+		const size_t mask = newcapacity - 1;
+		for (const slot& os : old) {
+			if (os.key == empty_key || os.key == tombstone_key) continue;
+			size_t ii = static_cast<size_t>(mix_handle(os.key)) & mask;
+			while (sh.slots[ii].key != empty_key) ii = (ii + 1) & mask;
+			sh.slots[ii] = os;
+		}
+	}
+
+public:
+	inline void insert_or_assign(uint64_t handle, const pipeline_registration_record& rec) {
+		if (handle == empty_key || handle == tombstone_key) return;
+		const uint64_t mixed = mix_handle(handle);
+		shard& sh = shards[shard_index(mixed)];
+		std::unique_lock<std::shared_mutex> lock(sh.mut);
+		if (size_t found = find_slot(sh, handle, mixed); found < sh.slots.size()) {
+			sh.slots[found].rec = rec;
+			return;
+		}
+		// keep load factor (including tombstones) under 3/4
+		if ((sh.num_live + sh.num_tombstones + 1) * 4 > sh.slots.size() * 3) {
+			size_t newcap = std::max(min_shard_capacity, sh.slots.size());
+			while ((sh.num_live + 1) * 2 > newcap) newcap *= 2;
+			rehash(sh, newcap);
+		}
+		const size_t mask = sh.slots.size() - 1;
+		size_t ii = static_cast<size_t>(mixed) & mask;
+		while (sh.slots[ii].key != empty_key && sh.slots[ii].key != tombstone_key) ii = (ii + 1) & mask;
+		if (sh.slots[ii].key == tombstone_key) sh.num_tombstones--;
+		sh.slots[ii].key = handle;
+		sh.slots[ii].rec = rec;
+		sh.num_live++;
+		total_live++;
+	}
+
+	// copies the record out, since it may be erased by another thread right after we return
+	inline bool find(uint64_t handle, pipeline_registration_record& rec) const {
+		if (handle == empty_key || handle == tombstone_key) return false;
+		const uint64_t mixed = mix_handle(handle);
+		const shard& sh = shards[shard_index(mixed)];
+		std::shared_lock<std::shared_mutex> lock(sh.mut);
+		const size_t found = find_slot(sh, handle, mixed);
+		if (found >= sh.slots.size()) return false;
+		rec = sh.slots[found].rec;
+		return true;
+	}
+
+	inline bool erase(uint64_t handle) {
+		if (handle == empty_key || handle == tombstone_key) return false;
+		const uint64_t mixed = mix_handle(handle);
+		shard& sh = shards[shard_index(mixed)];
+		std::unique_lock<std::shared_mutex> lock(sh.mut);
+		const size_t found = find_slot(sh, handle, mixed);
+		if (found >= sh.slots.size()) return false;
+		sh.slots[found].key = tombstone_key;
+		sh.slots[found].rec = pipeline_registration_record();
+		sh.num_live--;
+		sh.num_tombstones++;
+		total_live--;
+		return true;
+	}
+
+	inline size_t size() const { return total_live.load(); }
+
+	inline void clear() {
+		for (shard& sh : shards) {
+			std::unique_lock<std::shared_mutex> lock(sh.mut);
+			sh.slots.clear();
+			sh.num_live = 0;
+			sh.num_tombstones = 0;
+		}
+		total_live = 0;
+	}
+};
@@ -7,9 +7,12 @@
 #include "semseg_shader_register_bind.hpp"
 #include "command_list_state.hpp"
 #include "buffer_indexing_colorization.hpp"
+#include "gcv_utils/hook_activity.hpp"
 
 static void on_device_init(reshade::api::device* device) {
 	device->create_private_data<segmentation_app_data>();
+	open_customized_shader_disk_cache(device);
+	load_semantic_label_table(device);
 }
 static void on_device_destroy(reshade::api::device* device) {
 	{
@@ -32,7 +35,7 @@ static void on_reset_cmdlist(reshade::api::command_list* cmd_list) {
 
 static void on_bind_pipeline(reshade::api::command_list* cmd_list, reshade::api::pipeline_stage stages, reshade::api::pipeline pipeline) {
 	auto& state = cmd_list->get_private_data<segmentation_app_cmdlist_state>();
-	state.pipelines[stages] = pipeline;
+	cache_bound_pipeline_semseg_shader_info(cmd_list->get_device(), state, stages, pipeline);
 }
 
 
@@ -45,6 +48,7 @@ static void on_bind_render_targets_and_depth_stencil(reshade::api::command_list*
 
 template<bool draw_is_indexed>
 bool segmapp_on_draw_plain_or_indexed(reshade::api::command_list* cmd_list, uint32_t vertices_per_instance, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance) {
+	if (!hook_activity_enabled(HookFeature_SegmentationDraws)) return false;
 	auto& cmdlst_state = cmd_list->get_private_data<segmentation_app_cmdlist_state>();
 	if (vertices_per_instance > 1 && !cmdlst_state.rtvs.empty() && cmdlst_state.rtvs[0].handle != 0ull && cmdlst_state.dsv.handle != 0ull) {
 		reshade::api::device* const device = cmd_list->get_device();
@@ -63,13 +67,13 @@ bool segmapp_on_draw_plain_or_indexed(reshade::api::command_list* cmd_list, uint
 							cmd_list->clear_render_target_view(mapp.r_accum_bonus.rtv, mapp.r_accum_bonus.clear_color);
 						}
 					}
-					reshade::api::resource_view bindme_bonusbufview = mapp.r_counter_buf.stash_metadata_and_get_view_for_draw(get_draw_metadata_including_shader_info(device, cmd_list, vertices_per_instance));
+					reshade::api::resource_view bindme_bonusbufview = mapp.r_counter_buf.stash_metadata_and_get_view_for_draw(cmdlst_state.get_draw_metadata(vertices_per_instance));
 					uint64_t oldrsc = 0ull;
-					if (pipeline_bind_bonus_tex_for_a_draw(device, cmd_list, mapp, bindme_bonusbufview, oldrsc)) {
+					if (pipeline_bind_bonus_tex_for_a_draw(device, cmd_list, cmdlst_state, mapp, bindme_bonusbufview, oldrsc)) {
 						if (draw_is_indexed) cmd_list->draw_indexed(vertices_per_instance, instance_count, first_index, vertex_offset, first_instance);
 						else cmd_list->draw(vertices_per_instance, instance_count, first_index, first_instance);
 						uint64_t tmp;
-						pipeline_bind_bonus_tex_for_a_draw(device, cmd_list, mapp, { oldrsc }, tmp);
+						pipeline_bind_bonus_tex_for_a_draw(device, cmd_list, cmdlst_state, mapp, { oldrsc }, tmp);
 						return true; // we just did our own draw, so skip what it would have done
 					}
 				}
@@ -81,10 +85,12 @@ bool segmapp_on_draw_plain_or_indexed(reshade::api::command_list* cmd_list, uint
 }
 
 static bool on_draw(reshade::api::command_list* cmd_list, uint32_t vertices, uint32_t instances, uint32_t first_vertex, uint32_t first_instance) {
+	const hook_cost_sample costsample(HookFeature_SegmentationDraws);
 	return segmapp_on_draw_plain_or_indexed<false>(cmd_list, vertices, instances, first_vertex, 0, first_instance);
 }
 // index_count == vertices == The number of indices read from the index buffer for each instance.
 static bool on_draw_indexed(reshade::api::command_list* cmd_list, uint32_t vertices_per_instance, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance) {
+	const hook_cost_sample costsample(HookFeature_SegmentationDraws);
 	return segmapp_on_draw_plain_or_indexed<true>(cmd_list, vertices_per_instance, instance_count, first_index, vertex_offset, first_instance);
 }
 // TODO
@@ -111,10 +117,7 @@ static bool set_or_resize_app_texture(segmentation_app_data& mapp, reshade::api:
 	return true;
 }
 
-bool segmentation_app_update_on_finish_effects(reshade::api::effect_runtime* runtime, bool requested_draw) {
-	reshade::api::device* const device = runtime->get_device();
-	if (device->get_api() != reshade::api::device_api::d3d10 && device->get_api() != reshade::api::device_api::d3d11) return requested_draw;
-	auto& mapp = device->get_private_data<segmentation_app_data>();
+static bool update_capture_state(segmentation_app_data& mapp, reshade::api::effect_runtime* runtime, reshade::api::device* device, bool requested_draw) {
 	auto& clicked = device->get_private_data<clicked_rgb_rendertargets>();
 	if (mapp.save_buf_tex_at_end_of_draw) {
 		mapp.save_buf_tex_at_end_of_draw = false;
@@ -142,6 +145,33 @@ bool segmentation_app_update_on_finish_effects(reshade::api::effect_runtime* run
 	return false;
 }
 
+bool segmentation_app_update_on_finish_effects(reshade::api::effect_runtime* runtime, bool requested_draw, bool overlay_open) {
+	constexpr uint32_t published_features = hook_activity_bit(HookFeature_RenderTargetStats) | hook_activity_bit(HookFeature_SegmentationDraws);
+	reshade::api::device* const device = runtime->get_device();
+	if (device->get_api() != reshade::api::device_api::d3d10 && device->get_api() != reshade::api::device_api::d3d11) {
+		hook_activity_publish(overlay_open ? hook_activity_bit(HookFeature_RenderTargetStats) : 0u, published_features);
+		return requested_draw;
+	}
+	auto& mapp = device->get_private_data<segmentation_app_data>();
+	// a capture segments the render targets suggested by the render target stats: if those were idle this frame, wait a frame for them
+	if (requested_draw && !hook_activity_enabled(HookFeature_RenderTargetStats)) {
+		mapp.capture_waiting_for_render_target_stats = true;
+		requested_draw = false;
+	} else if (mapp.capture_waiting_for_render_target_stats) {
+		mapp.capture_waiting_for_render_target_stats = false;
+		requested_draw = true;
+	}
+	const bool capture_ready = update_capture_state(mapp, runtime, device, requested_draw);
+
+	// draws only need to be segmented for a capture in progress, the live visualization, or the overlay's debug info
+	const bool segment_draws = mapp.do_intercept_draw && (mapp.save_buf_tex_at_end_of_draw || overlay_open || live_segmentation_view_is_enabled(runtime));
+	uint32_t activity = 0u;
+	if (segment_draws) activity |= hook_activity_bit(HookFeature_SegmentationDraws);
+	if (segment_draws || overlay_open || mapp.capture_waiting_for_render_target_stats) activity |= hook_activity_bit(HookFeature_RenderTargetStats);
+	hook_activity_publish(activity, published_features);
+	return capture_ready;
+}
+
 static void on_reshade_finish_effects(reshade::api::effect_runtime* runtime,
 	reshade::api::command_list* cmd_list, reshade::api::resource_view rtv, reshade::api::resource_view rtv_srgb)
 {
@@ -162,6 +192,7 @@ void register_segmentation_app_hooks() {
 
 	reshade::register_event<reshade::addon_event::create_pipeline>(on_create_pipeline_add_semseg);
 	reshade::register_event<reshade::addon_event::init_pipeline>(on_after_create_pipeline_register_semseg);
+	reshade::register_event<reshade::addon_event::destroy_pipeline>(on_destroy_pipeline_unregister_semseg);
 
 	reshade::register_event<reshade::addon_event::draw>(on_draw);
 	reshade::register_event<reshade::addon_event::draw_indexed>(on_draw_indexed);
@@ -181,6 +212,7 @@ void unregister_segmentation_app_hooks() {
 
 	reshade::unregister_event<reshade::addon_event::create_pipeline>(on_create_pipeline_add_semseg);
 	reshade::unregister_event<reshade::addon_event::init_pipeline>(on_after_create_pipeline_register_semseg);
+	reshade::unregister_event<reshade::addon_event::destroy_pipeline>(on_destroy_pipeline_unregister_semseg);
 
 	reshade::unregister_event<reshade::addon_event::draw>(on_draw);
 	reshade::unregister_event<reshade::addon_event::draw_indexed>(on_draw_indexed);
@@ -5,5 +5,5 @@
 void register_segmentation_app_hooks();
 void unregister_segmentation_app_hooks();
 
-// return true if capture successful and ready for saving
-bool segmentation_app_update_on_finish_effects(reshade::api::effect_runtime* runtime, bool requested_draw);
+// return true if capture successful and ready for saving; also publishes which draw hooks need to be active next frame
+bool segmentation_app_update_on_finish_effects(reshade::api::effect_runtime* runtime, bool requested_draw, bool overlay_open);
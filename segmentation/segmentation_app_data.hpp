@@ -3,6 +3,11 @@
 #include "shader_types.hpp"
 #include "resource_helper.hpp"
 #include "draws_counting_data_buffer.hpp"
+#include "pipeline_registration_table.hpp"
+#include "customized_shader_disk_cache.hpp"
+#include "customized_shader_store.hpp"
+#include "semantic_label_table.hpp"
+#include "instance_grouping.hpp"
 #include "segmentation_shadering/custom_shader_layout_registers.hpp"
 #include "buffer_indexing_colorization.hpp"
 #include <reshade.hpp>
@@ -14,20 +19,26 @@ struct __declspec(uuid("bab8ffb9-5e8b-4b48-b4f2-4bac4bf87e82")) segmentation_app
 	reshade::api::resource rsrc_of_presented_depth;
 	bool do_intercept_draw = false;
 	bool save_buf_tex_at_end_of_draw = false;
+	bool capture_waiting_for_render_target_stats = false; // capture was requested while the draw hooks were idle
 
 	// log once across threads
 	std::atomic<int> logged_device_on_draw_bind_api_compatibility = { 0 };
 
 	// shader customization data
-	std::unordered_map<shader_hash_t, bytebuf*> shader_hash_to_custom_shader_bytes;
-	std::unordered_map<uint64_t, custom_shader_layout_registers> pipeline_handle_to_shader_layout_registers;
-	std::unordered_map<uint64_t, uint64_t> pipeline_handle_to_pipeline_layout_handle;
-	std::unordered_map<uint64_t, shader_hash_t> pipeline_handle_to_pixel_shader_hash;
-	std::unordered_map<uint64_t, shader_hash_t> pipeline_handle_to_vertex_shader_hash;
+	customized_shader_disk_cache shader_disk_cache; // consulted before customizing a shader not yet seen in this process
+	customized_shader_store customized_shaders; // declared after the disk cache: may point into its mapped file
+	pipeline_registration_table registered_pipelines; // written on pipeline creation (loader threads), read on bind (render threads)
 	resource_helper_texture r_accum_bonus; // our custom render target texture
 	draws_counting_data_buffer<perdraw_metadata_type> r_counter_buf; // store metadata for tracked draws
+	semantic_label_table semantic_labels; // optional: if loaded, captures also save a dense class-ID image
+	bool save_grouped_instances = false; // if set, captures also save an image of connected parts grouped into objects
+	instance_grouping_rules instance_grouping;
+	std::vector<uint32_t> instance_grouping_workspace;
 
-	// for saving segmentation results to disk
-	bool copy_and_index_seg_tex_needing_resource_barrier_into_packedbuf_and_metajson(
-		reshade::api::command_queue* queue, simple_packed_buf& segBuf, simple_packed_buf& triBuf, nlohmann::json& dstMetaJson);
+	// for saving segmentation results to disk; classBuf is only filled if not null and semantic_labels isn't empty;
+	// colormapsBuf gets the binary tables mapping colors in segBuf and triBuf to their metadata;
+	// instanceBuf (if not null) gets the grouped instance IDs, using depthBuf (GRAYF32, may be null) for the depth continuity rule
+	bool copy_and_index_seg_tex_needing_resource_barrier_into_packedbufs(
+		reshade::api::command_queue* queue, simple_packed_buf& segBuf, simple_packed_buf& triBuf, simple_packed_buf* classBuf, simple_packed_buf& colormapsBuf,
+		simple_packed_buf* instanceBuf, const simple_packed_buf* depthBuf);
 };
@@ -0,0 +1,100 @@
+// Copyright (C) 2023 Jason Bunk
+#pragma once
+#include "shader_types.hpp"
+#include <nlohmann/json.hpp>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <tuple>
+
+/*
+* Maps draw metadata (vertex shader hash, pixel shader hash, and optionally the number of vertices) to a semantic class ID,
+* so that captures can directly write a dense class-ID image instead of needing the per-frame color->metadata tables.
+* Loaded once at startup from a json file like:
+*   { "default_label": 0, "labels": [ {"vs": 123, "ps": 456, "class": 7}, {"vs": 123, "ps": 789, "num_vertices": 1020, "class": 3} ] }
+* where the hashes are as in the "seg" table of the capture's "*_colormaps.bin" (named by "seg_tri_colormaps_file" in the capture json,
+* readable with python_threedee/load_colormaps.py). Entries without "num_vertices" match any vertex count;
+* if both match, the entry with the vertex count wins.
+* Stored as a sorted flat array, looked up once per draw (not per pixel).
+*/
+class semantic_label_table {
+public:
+	static constexpr uint64_t any_num_vertices = ~0ull;
+
+	struct entry {
+		shader_hash_t vs = 0ull;
+		shader_hash_t ps = 0ull;
+		uint64_t num_vertices = any_num_vertices;
+		uint16_t label = 0;
+		inline bool operator<(const entry& other) const {
+			return std::tie(vs, ps, num_vertices) < std::tie(other.vs, other.ps, other.num_vertices);
+		}
+	};
+
+private:
+	std::vector<entry> entries;
+	uint16_t default_label = 0;
+
+	inline const entry* find_exact(shader_hash_t vs, shader_hash_t ps, uint64_t num_vertices) const {
+		entry key;
+		key.vs = vs;
+		key.ps = ps;
+		key.num_vertices = num_vertices;
+		auto it = std::lower_bound(entries.begin(), entries.end(), key);
+		if (it != entries.end() && it->vs == vs && it->ps == ps && it->num_vertices == num_vertices) return &(*it);
+		return nullptr;
+	}
+
+public:
+	inline bool empty() const { return entries.empty(); }
+	inline size_t size() const { return entries.size(); }
+	inline uint16_t get_default_label() const { return default_label; }
+
+	inline uint16_t lookup(const perdraw_metadata_type& drawmeta) const {
+		const shader_hash_t vs = drawmeta[pdm_vertex_shader_hash];
+		const shader_hash_t ps = drawmeta[pdm_pixel_shader_hash];
+		if (const entry* ee = find_exact(vs, ps, drawmeta[pdm_num_vertices])) return ee->label;
+		if (const entry* ee = find_exact(vs, ps, any_num_vertices)) return ee->label;
+		return default_label;
+	}
+
+	// returns false with an error message if the file exists but couldn't be parsed; a missing file just leaves the table empty
+	inline bool load_json_file(const std::filesystem::path& filepath, std::string& log) {
+		entries.clear();
+		default_label = 0;
+		if (!std::filesystem::exists(filepath)) {
+			log = std::string("no semantic label table ") + filepath.string();
+			return true;
+		}
+		try {
+			std::ifstream infile(filepath);
+			const nlohmann::json jj = nlohmann::json::parse(infile);
+			default_label = jj.value("default_label", static_cast<uint16_t>(0));
+			for (const nlohmann::json& jl : jj.at("labels")) {
+				entry ee;
+				ee.vs = jl.at("vs").get<shader_hash_t>();
+				ee.ps = jl.at("ps").get<shader_hash_t>();
+				if (jl.contains("num_vertices")) ee.num_vertices = jl.at("num_vertices").get<uint64_t>();
+				ee.label = jl.at("class").get<uint16_t>();
+				entries.push_back(ee);
+			}
+		} catch (const std::exception& ex) {
+			entries.clear();
+			log = std::string("failed to load semantic label table ") + filepath.string() + std::string(": ") + ex.what();
+			return false;
+		}
+		std::stable_sort(entries.begin(), entries.end());
+		// if there are duplicate keys, the last one in the file wins
+		std::vector<entry> deduped;
+		deduped.reserve(entries.size());
+		for (const entry& ee : entries) {
+			if (!deduped.empty() && !(deduped.back() < ee)) deduped.back() = ee;
+			else deduped.push_back(ee);
+		}
+		entries.swap(deduped);
+		log = std::string("loaded semantic label table ") + filepath.string() + std::string(" with ") + std::to_string(entries.size()) + std::string(" entries");
+		return true;
+	}
+};
@@ -3,15 +3,17 @@
 #include "segmentation_shadering/customize_dxbc.hpp"
 #include "reshade_graphics_api_util.hpp"
 #include "command_list_state.hpp"
+#include "customized_shader_disk_cache.hpp"
 #include "xxhash.h"
 #include <sstream>
 #include <fstream>
+#include <filesystem>
+#include <Windows.h>
 static constexpr bool verbose = false;
 using namespace reshade::api;
 using std::endl;
 
 struct shader_entry_workspace {
-	bytebuf* b = nullptr;
 	custom_shader_layout_registers r;
 	shader_hash_t hash = 0ull;
 	shader_desc* s = nullptr;
@@ -21,10 +23,38 @@ struct shader_entry_workspace {
 };
 
 static thread_local std::unordered_map<pipeline_subobject_type, shader_entry_workspace> shader_workspace;
+static thread_local bytebuf customization_scratch_buf; // shaders are customized here, then only kept (copied to the app's store) if it succeeded
 static std::atomic<int> numvalidshadersseen = { 0 };
 static std::atomic<int> numvalidshaderssuccessfullymodified = { 0 };
 
 
+static std::filesystem::path game_exe_directory() {
+	wchar_t exe_path[MAX_PATH] = L"";
+	GetModuleFileNameW(nullptr, exe_path, ARRAYSIZE(exe_path));
+	return std::filesystem::path(exe_path).parent_path();
+}
+
+
+void open_customized_shader_disk_cache(device* device) {
+#ifdef RENDERDOC_FOR_SHADERS
+	if (device->get_api() != device_api::d3d10 && device->get_api() != device_api::d3d11) return;
+	const std::filesystem::path cache_path = game_exe_directory() / L"gcv_customized_shaders_cache.bin";
+	std::string log;
+	const bool opened = device->get_private_data<segmentation_app_data>().shader_disk_cache.open(cache_path.wstring(), customize_shader_dxbc_or_dxil_version, log);
+	reshade::log_message(opened ? reshade::log_level::info : reshade::log_level::warning,
+		std::string(std::string("shader cache ") + cache_path.string() + std::string(": ") + log).c_str());
+#endif
+}
+
+
+void load_semantic_label_table(device* device) {
+	const std::filesystem::path table_path = game_exe_directory() / L"gcv_semantic_labels.json";
+	std::string log;
+	const bool loaded = device->get_private_data<segmentation_app_data>().semantic_labels.load_json_file(table_path, log);
+	reshade::log_message(loaded ? reshade::log_level::info : reshade::log_level::error, log.c_str());
+}
+
+
 bool on_create_pipeline_add_semseg(device* device, pipeline_layout playout, uint32_t subobject_count, const pipeline_subobject* subobjects) {
 
 #ifdef RENDERDOC_FOR_SHADERS
@@ -77,23 +107,33 @@ bool on_create_pipeline_add_semseg(device* device, pipeline_layout playout, uint
 				// TODO: this code considers a hash collision impossible... it's not, so this is wrong: a hash collision will provide the wrong shader
 				shws.hash = XXH64(shws.s->code, shws.s->code_size, 0);
 				bool modsucceeded = false;
-				if (auto shentry = mapp.shader_hash_to_custom_shader_bytes.find(shws.hash); shentry != mapp.shader_hash_to_custom_shader_bytes.end()) {
+				customized_shader customized;
+				const customized_shader_store::lookup_result seen = mapp.customized_shaders.find(shws.hash, customized);
+				if (seen == customized_shader_store::known_customized) {
 					modsucceeded = true;
-					shws.b = shentry->second;
-				} else {
-					shws.b = new bytebuf();
-					shws.b->resize(shws.s->code_size);
-					memcpy(shws.b->data(), shws.s->code, shws.s->code_size); // make a copy of the original shader
-					mapp.shader_hash_to_custom_shader_bytes.emplace(shws.hash, shws.b);
-					modsucceeded = customize_shader_dxbc_or_dxil(
-						subobjects[i].type == pipeline_subobject_type::pixel_shader,
-						graphics_api,
-						shws.b, shws.r, ss);
+				} else if (seen == customized_shader_store::not_seen) {
+					const bool truepixel = subobjects[i].type == pipeline_subobject_type::pixel_shader;
+					const shader_hash128_t hash128 = hash_original_shader_bytecode(shws.s->code, shws.s->code_size, truepixel, graphics_api);
+					customized_shader_cache_entry cached;
+					if (mapp.shader_disk_cache.find(hash128, cached)) {
+						modsucceeded = cached.succeeded; // if it's in the cache as failed, don't bother trying again
+						if (modsucceeded) customized = mapp.customized_shaders.add_customized_external(shws.hash, cached.code, cached.code_size, cached.registers);
+					} else {
+						bytebuf& buf = customization_scratch_buf;
+						buf.resize(shws.s->code_size);
+						memcpy(buf.data(), shws.s->code, shws.s->code_size); // make a copy of the original shader
+						modsucceeded = customize_shader_dxbc_or_dxil(truepixel, graphics_api, &buf, shws.r, ss);
+						const uint8_t* bufdata = reinterpret_cast<const uint8_t*>(buf.data());
+						mapp.shader_disk_cache.append(hash128, modsucceeded, shws.r, bufdata, static_cast<uint32_t>(buf.size()));
+						if (modsucceeded) customized = mapp.customized_shaders.add_customized_copy(shws.hash, bufdata, static_cast<uint32_t>(buf.size()), shws.r);
+					}
+					if (!modsucceeded) mapp.customized_shaders.add_failed(shws.hash);
 				}
 				if (modsucceeded) {
 					shws.good = true;
-					shws.s->code = shws.b->data(); // replace the original shader with data stored in thread_local map "shader_workspace"
-					shws.s->code_size = shws.b->size();
+					shws.r = customized.registers;
+					shws.s->code = customized.code; // replace the original shader with our customized copy, which lives as long as the device
+					shws.s->code_size = customized.code_size;
 					if (verbose) ss << "we (temporarily?) customized the shader" << endl;
 				} else {
 					shws.good = false;
@@ -154,68 +194,65 @@ void on_after_create_pipeline_register_semseg(device *device, pipeline_layout la
 		}
 		if (matchedpipeline) {
 			auto& mapp = device->get_private_data<segmentation_app_data>();
+			pipeline_registration_record rec;
 			if (shader_workspace.count(pipeline_subobject_type::pixel_shader)) {
 				const shader_entry_workspace& shws_px = shader_workspace.at(pipeline_subobject_type::pixel_shader);
-				mapp.pipeline_handle_to_shader_layout_registers[pipeline.handle] = shws_px.r;
-				mapp.pipeline_handle_to_pipeline_layout_handle[pipeline.handle] = layout.handle;
-				mapp.pipeline_handle_to_pixel_shader_hash[pipeline.handle] = shws_px.hash;
+				rec.has_custom_registers = true;
+				rec.registers = shws_px.r;
+				rec.pipeline_layout_handle = layout.handle;
+				rec.pixel_shader_hash = shws_px.hash;
 				if (verbose) reshade::log_message(reshade::log_level::info,
 					std::string(std::string("successfully registered shader pipeline ")+std::to_string(pipeline.handle)+std::string(" of hash ")+std::to_string(shws_px.hash)+std::string(", with shader registers ") + shws_px.r.to_string()).c_str());
 			}
 			if (shader_workspace.count(pipeline_subobject_type::vertex_shader)) {
-				mapp.pipeline_handle_to_vertex_shader_hash[pipeline.handle] = shader_workspace.at(pipeline_subobject_type::vertex_shader).hash;
+				rec.vertex_shader_hash = shader_workspace.at(pipeline_subobject_type::vertex_shader).hash;
 			}
+			mapp.registered_pipelines.insert_or_assign(pipeline.handle, rec);
 		}
 	}
 	shader_workspace.clear();
 }
 
 
-perdraw_metadata_type get_draw_metadata_including_shader_info(device* device, command_list* cmd_list, uint32_t draw_num_vertices) {
+void on_destroy_pipeline_unregister_semseg(device* device, pipeline pipeline) {
+	device->get_private_data<segmentation_app_data>().registered_pipelines.erase(pipeline.handle);
+}
+
+
+void cache_bound_pipeline_semseg_shader_info(device* device, segmentation_app_cmdlist_state& cmdlst_state, pipeline_stage stages, pipeline pipeline) {
 	auto& mapp = device->get_private_data<segmentation_app_data>();
-	auto& cmdlst_state = cmd_list->get_private_data<segmentation_app_cmdlist_state>();
-	perdraw_metadata_type ret = { draw_num_vertices, 0ull, 0ull };
-	for (const auto& [stages, pipeline] : cmdlst_state.pipelines) {
-		if (pipeline.handle != 0ull) {
-			if (static_cast<uint32_t>(stages) & static_cast<uint32_t>(pipeline_stage::vertex_shader) && mapp.pipeline_handle_to_vertex_shader_hash.count(pipeline.handle))
-				ret[1] = mapp.pipeline_handle_to_vertex_shader_hash.at(pipeline.handle);
-			if (static_cast<uint32_t>(stages) & static_cast<uint32_t>(pipeline_stage::pixel_shader) && mapp.pipeline_handle_to_pixel_shader_hash.count(pipeline.handle))
-				ret[2] = mapp.pipeline_handle_to_pixel_shader_hash.at(pipeline.handle);
+	pipeline_registration_record rec;
+	const bool registered = pipeline.handle != 0ull && mapp.registered_pipelines.find(pipeline.handle, rec);
+	for (uint32_t ts = 0; ts < segapp_num_tracked_stages; ++ts) {
+		if ((static_cast<uint32_t>(stages) & static_cast<uint32_t>(segapp_tracked_stage_flags[ts])) == 0) continue;
+		bound_shader_draw_info& info = cmdlst_state.bound_shaders[ts];
+		info = bound_shader_draw_info();
+		info.pipeline = pipeline;
+		if (!registered) continue;
+		if (ts == segapp_stage_vertex) {
+			info.shader_hash = rec.vertex_shader_hash;
+		} else if (ts == segapp_stage_pixel) {
+			info.shader_hash = rec.pixel_shader_hash;
+			info.has_custom_registers = rec.has_custom_registers;
+			info.registers = rec.registers;
 		}
 	}
-	return ret;
 }
 
 
 #include <d3d10_1.h>
 #include <d3d11.h>
 
-bool pipeline_bind_bonus_tex_for_a_draw(device* device, command_list* cmd_list, segmentation_app_data& mapp, resource_view tex_view, uint64_t &formerly_bound_rsc) {
-	auto& cmdlst_state = cmd_list->get_private_data<segmentation_app_cmdlist_state>();
-	if (cmdlst_state.pipelines.empty()) return false;
-	std::unordered_set<uint64_t> pixshaderhandles;
-	for (const auto& [stages, pipeline] : cmdlst_state.pipelines) {
-		if (pipeline.handle != 0ull && static_cast<uint32_t>(stages) & static_cast<uint32_t>(pipeline_stage::pixel_shader))
-			pixshaderhandles.insert(pipeline.handle);
-	}
-	if (pixshaderhandles.empty()) return false;
-	bool foundahandle = false;
-	uint64_t currpipehandle = 0ull;
-	for (const uint64_t possiblehandle : pixshaderhandles) {
-		if (mapp.pipeline_handle_to_shader_layout_registers.count(possiblehandle)
-		      && mapp.pipeline_handle_to_pipeline_layout_handle.count(possiblehandle)) {
-			foundahandle = true;
-			currpipehandle = possiblehandle;
-			break;
-		}
-	}
-	if (!foundahandle || currpipehandle == 0ull || !mapp.pipeline_handle_to_shader_layout_registers.count(currpipehandle)) {
+bool pipeline_bind_bonus_tex_for_a_draw(device* device, command_list* cmd_list, const segmentation_app_cmdlist_state& cmdlst_state, segmentation_app_data& mapp, resource_view tex_view, uint64_t &formerly_bound_rsc) {
+	const bound_shader_draw_info& bound_ps = cmdlst_state.bound_shaders[segapp_stage_pixel];
+	if (bound_ps.pipeline.handle == 0ull) return false;
+	if (!bound_ps.has_custom_registers) {
 		if (mapp.logged_device_on_draw_bind_api_compatibility.exchange(1) == 0)
-			reshade::log_message(reshade::log_level::warning, std::string(std::string("pipeline handle ") + std::to_string(currpipehandle)
-				+ std::string(" not found in pipeline handle map of size ") + std::to_string(mapp.pipeline_handle_to_shader_layout_registers.size())).c_str());
+			reshade::log_message(reshade::log_level::warning, std::string(std::string("pipeline handle ") + std::to_string(bound_ps.pipeline.handle)
+				+ std::string(" not found in pipeline handle map of size ") + std::to_string(mapp.registered_pipelines.size())).c_str());
 		return false;
 	}
-	const custom_shader_layout_registers& shreg = mapp.pipeline_handle_to_shader_layout_registers.at(currpipehandle);
+	const custom_shader_layout_registers& shreg = bound_ps.registers;
 
 	if (device->get_api() == device_api::d3d10) {
 		const int registerhere = shreg.perdrawbuf_tex_regL;
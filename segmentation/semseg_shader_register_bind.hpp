@@ -3,14 +3,25 @@
 #include <reshade.hpp>
 #include <unordered_map>
 #include "segmentation_app_data.hpp"
+#include "command_list_state.hpp"
 
 // Use this as a reshade event callback. Customizes shaders as they are being loaded
 bool on_create_pipeline_add_semseg(reshade::api::device* device, reshade::api::pipeline_layout playout, uint32_t subobject_count, const reshade::api::pipeline_subobject* subobjects);
 
+// Call on device init: loads shaders customized in previous runs, so they don't need to be customized again
+void open_customized_shader_disk_cache(reshade::api::device* device);
+
+// Call on device init: loads the optional (vs hash, ps hash, #vertices) -> class ID table, for saving dense class-ID images
+void load_semantic_label_table(reshade::api::device* device);
+
 // Use this as a reshade event callback to register the above modified shader to the pipeline object that was created
 void on_after_create_pipeline_register_semseg(reshade::api::device *device, reshade::api::pipeline_layout layout, uint32_t subobject_count, const reshade::api::pipeline_subobject *subobjects, reshade::api::pipeline pipeline);
 
-// The register at which to bind is different for each shader/pipeline, so we keep track of this in segmentation_app_data
-bool pipeline_bind_bonus_tex_for_a_draw(reshade::api::device* device, reshade::api::command_list* cmd_list, segmentation_app_data& mapp, reshade::api::resource_view tex_view, uint64_t& formerly_bound_rsc);
+// Use this as a reshade event callback to forget about pipelines that the game destroyed
+void on_destroy_pipeline_unregister_semseg(reshade::api::device* device, reshade::api::pipeline pipeline);
 
-perdraw_metadata_type get_draw_metadata_including_shader_info(reshade::api::device* device, reshade::api::command_list* cmd_list, uint32_t draw_num_vertices);
+// Call when a pipeline is bound: looks up what was registered above and caches it in the command list state, so draws don't need any lookups
+void cache_bound_pipeline_semseg_shader_info(reshade::api::device* device, segmentation_app_cmdlist_state& cmdlst_state, reshade::api::pipeline_stage stages, reshade::api::pipeline pipeline);
+
+// The register at which to bind is different for each shader/pipeline, so we keep track of this in segmentation_app_data
+bool pipeline_bind_bonus_tex_for_a_draw(reshade::api::device* device, reshade::api::command_list* cmd_list, const segmentation_app_cmdlist_state& cmdlst_state, segmentation_app_data& mapp, reshade::api::resource_view tex_view, uint64_t& formerly_bound_rsc);
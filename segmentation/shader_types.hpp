@@ -1,6 +1,7 @@
 // Copyright (C) 2023 Jason Bunk
 #pragma once
 #include <array>
+#include <cstdint>
 
 typedef std::array<uint64_t, 3> perdraw_metadata_type; // (#vertices, vertexshaderhash, pixelshaderhash)
 
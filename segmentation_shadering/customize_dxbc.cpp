@@ -16,14 +16,20 @@ bool customize_shader_dxbc_or_dxil(
 
 #else
 
-// you may want to #define: RENDERDOC_FOR_SHADERS;RENDERDOC_EXPORTS;RENDERDOC_PLATFORM_WIN32;
+// you may want to #define: RENDERDOC_FOR_SHADERS;RENDERDOC_EXPORTS;RENDERDOC_PLATFORM_WIN32; (or RENDERDOC_PLATFORM_LINUX, see shader_batch_customizer/Makefile)
 #include "rdoc_utils.hpp"
 #include "driver/shaders/dxbc/dxbc_container.h" // renderdoc header
 #include "driver/shaders/dxbc/dxbc_bytecode_editor.h" // renderdoc header
 #include <unordered_set>
+#ifdef _WIN32
 #include <d3d10_1.h>
 #include <d3d11.h>
 #include <d3d12.h>
+#else // the offline tools built on Linux (shader_batch_customizer) only need these from the d3d headers
+#define D3D10_SIMULTANEOUS_RENDER_TARGET_COUNT ( 8 )
+#define D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT ( 8 )
+#define D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT ( 8 )
+#endif
 static constexpr int verbose = 0;
 using std::endl;
 
@@ -136,7 +142,7 @@ bool customize_dxbc(bool b_truepixel_falsevertex, const my_graphics_api::api_enu
 
 	// count number of declared outputs
 	const int num_decl_outputs = 1 + highest_decl_register({ DXBCBytecode::OPCODE_DCL_OUTPUT, DXBCBytecode::OPCODE_DCL_OUTPUT_SGV, DXBCBytecode::OPCODE_DCL_OUTPUT_SIV }, &shadereditor, log);
-	if (num_decl_outputs <= 0 || (b_truepixel_falsevertex && num_decl_outputs >= max_num_bound_pixel_shader_outputs)) {
+	if (num_decl_outputs <= 0 || (b_truepixel_falsevertex && static_cast<uint64_t>(num_decl_outputs) >= max_num_bound_pixel_shader_outputs)) {
 		log << "bad number of declared outputs " << num_decl_outputs << ": shader with #ins " << shadereditor.GetNumInstructions() << " or #dec " << shadereditor.GetNumDeclarations() << endl;
 		{ const rdcstr astr = shadereditor.GetDisassembly(); log << std::string(astr.begin(), astr.end()) << endl; }
 		return false;
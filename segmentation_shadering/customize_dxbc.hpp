@@ -4,6 +4,9 @@
 #include "segmentation_shadering/graphics_api_enum.hpp"
 #include <sstream>
 
+// bump this whenever the customization below changes what it outputs: invalidates shader caches saved on disk
+static constexpr uint32_t customize_shader_dxbc_or_dxil_version = 1;
+
 bool customize_shader_dxbc_or_dxil(
     bool b_truepixel_falsevertex,
     const my_graphics_api::api_enum graphics_api,
@@ -0,0 +1,238 @@
+// Copyright (C) 2023 Jason Bunk
+//
+// Offline batch version of what the addon does to each shader as the game loads it:
+// customizes a directory of dumped .dxbc blobs in parallel, reports timings, success rates, and failure reasons,
+// and optionally writes a customized shader cache file, which the addon will load instead of customizing at runtime.
+// Copy the cache next to the game's executable as gcv_customized_shaders_cache.bin
+//
+#include "segmentation_shadering/customize_dxbc.hpp"
+#include "segmentation/customized_shader_disk_cache_format.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cctype>
+namespace fs = std::filesystem;
+using std::endl;
+
+enum dxbc_program_type : int {
+	dxbc_unknown = -1,
+	dxbc_pixel = 0,
+	dxbc_vertex = 1,
+};
+
+// reads the program type out of the version token of the SHDR/SHEX chunk, without needing the whole container parsed
+static dxbc_program_type find_dxbc_program_type(const std::vector<uint8_t>& blob) {
+	auto read_u32 = [&blob](size_t offset) -> uint32_t {
+		uint32_t val = 0;
+		if (offset + 4 <= blob.size()) memcpy(&val, blob.data() + offset, 4);
+		return val;
+	};
+	if (blob.size() < 32 || memcmp(blob.data(), "DXBC", 4) != 0) return dxbc_unknown;
+	const uint32_t num_chunks = read_u32(28);
+	for (uint32_t cc = 0; cc < num_chunks; ++cc) {
+		const uint32_t chunk_offset = read_u32(32 + cc * 4);
+		if (static_cast<size_t>(chunk_offset) + 12 > blob.size()) break;
+		if (memcmp(blob.data() + chunk_offset, "SHDR", 4) == 0 || memcmp(blob.data() + chunk_offset, "SHEX", 4) == 0) {
+			const uint32_t program_type = read_u32(chunk_offset + 8) >> 16;
+			if (program_type == dxbc_pixel || program_type == dxbc_vertex) return static_cast<dxbc_program_type>(program_type);
+			return dxbc_unknown;
+		}
+	}
+	return dxbc_unknown;
+}
+
+// the customizer's log has some informational lines before the error; digits are masked so that similar errors are counted together
+static std::string failure_reason_from_log(const std::string& log) {
+	std::istringstream lines(log);
+	std::string line;
+	while (std::getline(lines, line)) {
+		if (line.empty() || line.rfind("DXBC shader model detected", 0) == 0 || line.rfind("  renderdoc_shader_disassembly", 0) == 0 || line.rfind("  shadersigparam", 0) == 0) continue;
+		line.erase(0, line.find_first_not_of(' '));
+		std::string masked;
+		for (char ch : line) {
+			if (std::isdigit(static_cast<unsigned char>(ch))) {
+				if (masked.empty() || masked.back() != '#') masked.push_back('#');
+			} else {
+				masked.push_back(ch);
+			}
+		}
+		return masked;
+	}
+	return std::string("unknown (customizer gave no reason)");
+}
+
+struct shader_result {
+	fs::path path;
+	dxbc_program_type type = dxbc_unknown;
+	size_t original_size = 0;
+	double microseconds = 0.0;
+	bool succeeded = false;
+	std::string failure_reason;
+	shader_hash128_t key;
+	custom_shader_layout_registers registers;
+	std::vector<uint8_t> customized;
+};
+
+static void customize_one(shader_result& res, my_graphics_api::api_enum graphics_api) {
+	std::vector<uint8_t> blob;
+	{
+		std::ifstream infile(res.path, std::ios::binary);
+		blob.assign(std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>());
+	}
+	res.original_size = blob.size();
+	res.type = find_dxbc_program_type(blob);
+	if (res.type == dxbc_unknown) {
+		res.failure_reason = "skipped: not a DXBC pixel or vertex shader";
+		return;
+	}
+	const bool truepixel = res.type == dxbc_pixel;
+	res.key = hash_original_shader_bytecode(blob.data(), blob.size(), truepixel, graphics_api);
+
+	bytebuf buf;
+	buf.resize(blob.size());
+	memcpy(buf.data(), blob.data(), blob.size());
+	std::stringstream log;
+	const auto t0 = std::chrono::steady_clock::now();
+	res.succeeded = customize_shader_dxbc_or_dxil(truepixel, graphics_api, &buf, res.registers, log);
+	res.microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+	if (res.succeeded) {
+		res.customized.resize(buf.size());
+		memcpy(res.customized.data(), buf.data(), buf.size());
+	} else {
+		res.failure_reason = failure_reason_from_log(log.str());
+	}
+}
+
+static bool write_cache_file(const fs::path& outpath, const std::vector<shader_result>& results) {
+	std::ofstream outfile(outpath, std::ios::binary | std::ios::trunc);
+	if (!outfile) return false;
+	customized_shader_cache_file_header fhdr;
+	fhdr.init(customize_shader_dxbc_or_dxil_version);
+	outfile.write(reinterpret_cast<const char*>(&fhdr), sizeof(fhdr));
+	static constexpr char zeros[4] = { 0, 0, 0, 0 };
+	for (const shader_result& res : results) {
+		if (res.type == dxbc_unknown) continue;
+		customized_shader_cache_record_header rh;
+		rh.init(res.key, res.succeeded, res.registers, res.customized.data(), static_cast<uint32_t>(res.customized.size()));
+		outfile.write(reinterpret_cast<const char*>(&rh), sizeof(rh));
+		outfile.write(reinterpret_cast<const char*>(res.customized.data()), rh.code_size);
+		outfile.write(zeros, customized_shader_cache_record_header::padded_code_size(rh.code_size) - rh.code_size);
+	}
+	return static_cast<bool>(outfile);
+}
+
+static void print_usage() {
+	std::cout << "usage: shader_batch_customizer <dir of .dxbc files> [-o cache.bin] [-j num_threads] [--api d3d10|d3d11] [--csv timings.csv]" << endl;
+}
+
+int main(int argc, char** argv) {
+	fs::path indir, outcache, outcsv;
+	unsigned int num_threads = std::max(1u, std::thread::hardware_concurrency());
+	my_graphics_api::api_enum graphics_api = my_graphics_api::d3d11;
+	for (int ii = 1; ii < argc; ++ii) {
+		const std::string arg(argv[ii]);
+		const bool hasnext = ii + 1 < argc;
+		if (arg == "-o" && hasnext) outcache = argv[++ii];
+		else if (arg == "-j" && hasnext) num_threads = std::max(1, std::atoi(argv[++ii]));
+		else if (arg == "--csv" && hasnext) outcsv = argv[++ii];
+		else if (arg == "--api" && hasnext) {
+			const std::string api(argv[++ii]);
+			if (api == "d3d10") graphics_api = my_graphics_api::d3d10;
+			else if (api == "d3d11") graphics_api = my_graphics_api::d3d11;
+			else { print_usage(); return 1; }
+		}
+		else if (indir.empty() && arg[0] != '-') indir = arg;
+		else { print_usage(); return 1; }
+	}
+	if (indir.empty() || !fs::is_directory(indir)) {
+		print_usage();
+		return 1;
+	}
+
+	std::vector<shader_result> results;
+	for (const fs::directory_entry& entry : fs::recursive_directory_iterator(indir)) {
+		if (!entry.is_regular_file()) continue;
+		std::string ext = entry.path().extension().string();
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+		if (ext != ".dxbc") continue;
+		results.emplace_back();
+		results.back().path = entry.path();
+	}
+	std::sort(results.begin(), results.end(), [](const shader_result& a, const shader_result& b) { return a.path < b.path; });
+	std::cout << "customizing " << results.size() << " shaders from " << indir.string() << " with " << num_threads << " threads" << endl;
+
+	const auto wall0 = std::chrono::steady_clock::now();
+	std::atomic<size_t> next_shader = { 0 };
+	std::vector<std::thread> workers;
+	for (unsigned int tt = 0; tt < num_threads; ++tt) {
+		workers.emplace_back([&]() {
+			for (size_t idx = next_shader++; idx < results.size(); idx = next_shader++) {
+				customize_one(results[idx], graphics_api);
+			}
+		});
+	}
+	for (std::thread& worker : workers) worker.join();
+	const double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0).count();
+
+	size_t num_attempted = 0, num_succeeded = 0, num_pixel = 0, num_vertex = 0, num_skipped = 0;
+	std::vector<double> timings;
+	std::map<std::string, size_t> failure_reasons;
+	for (const shader_result& res : results) {
+		if (res.type == dxbc_unknown) {
+			num_skipped++;
+			continue;
+		}
+		num_attempted++;
+		(res.type == dxbc_pixel ? num_pixel : num_vertex)++;
+		timings.push_back(res.microseconds);
+		if (res.succeeded) num_succeeded++;
+		else failure_reasons[res.failure_reason]++;
+	}
+	std::sort(timings.begin(), timings.end());
+	auto percentile = [&timings](double pp) { return timings.empty() ? 0.0 : timings[std::min(timings.size() - 1, static_cast<size_t>(pp * timings.size()))]; };
+	double total_us = 0.0;
+	for (double tus : timings) total_us += tus;
+
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "attempted " << num_attempted << " (" << num_pixel << " pixel, " << num_vertex << " vertex), skipped " << num_skipped << endl;
+	std::cout << "succeeded " << num_succeeded << " (" << (num_attempted ? (100.0 * num_succeeded / num_attempted) : 0.0) << "%), failed " << (num_attempted - num_succeeded) << endl;
+	std::cout << "wall time " << wall_seconds << " s, summed customization time " << (total_us * 1e-6) << " s" << endl;
+	std::cout << "per shader (us): mean " << (timings.empty() ? 0.0 : total_us / timings.size()) << ", median " << percentile(0.5)
+		<< ", p95 " << percentile(0.95) << ", p99 " << percentile(0.99) << ", max " << (timings.empty() ? 0.0 : timings.back()) << endl;
+	if (!failure_reasons.empty()) {
+		std::vector<std::pair<std::string, size_t>> sorted_reasons(failure_reasons.begin(), failure_reasons.end());
+		std::sort(sorted_reasons.begin(), sorted_reasons.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+		std::cout << "failure reasons:" << endl;
+		for (const auto& reason : sorted_reasons) std::cout << "  " << reason.second << "  " << reason.first << endl;
+	}
+
+	if (!outcsv.empty()) {
+		std::ofstream csvfile(outcsv, std::ios::trunc);
+		csvfile << "file,type,original_bytes,customized_bytes,microseconds,succeeded,failure_reason" << endl;
+		for (const shader_result& res : results) {
+			std::string reason = res.failure_reason;
+			std::replace(reason.begin(), reason.end(), '"', '\'');
+			csvfile << '"' << res.path.string() << "\"," << (res.type == dxbc_pixel ? "pixel" : (res.type == dxbc_vertex ? "vertex" : "unknown"))
+				<< ',' << res.original_size << ',' << res.customized.size() << ',' << res.microseconds << ',' << (res.succeeded ? 1 : 0) << ",\"" << reason << '"' << endl;
+		}
+		std::cout << "wrote per-shader timings to " << outcsv.string() << endl;
+	}
+
+	if (!outcache.empty()) {
+		if (!write_cache_file(outcache, results)) {
+			std::cout << "failed to write cache file " << outcache.string() << endl;
+			return 1;
+		}
+		std::cout << "wrote customized shader cache " << outcache.string() << " (customizer version " << customize_shader_dxbc_or_dxil_version << ")" << endl;
+	}
+	return 0;
+}
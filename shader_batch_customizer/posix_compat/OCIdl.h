@@ -0,0 +1,3 @@
+// Copyright (C) 2023 Jason Bunk
+#pragma once
+#include "windows.h"
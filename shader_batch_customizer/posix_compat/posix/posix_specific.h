@@ -0,0 +1,66 @@
+// Copyright (C) 2023 Jason Bunk
+// The parts of renderdoc's platform layer (os/os_specific.h) that its DXBC code needs, for building the shader tools on Linux.
+#pragma once
+#include <stdlib.h>
+#include <stdint.h>
+
+#define EndianSwap16(x) __builtin_bswap16(x)
+#define EndianSwap32(x) __builtin_bswap32(x)
+#define EndianSwap64(x) __builtin_bswap64(x)
+
+#define EmbeddedResourceType int
+#define EmbeddedResource(filename) CONCAT(RESOURCE_, filename)
+
+#define GetEmbeddedResource(filename) GetDynamicEmbeddedResource(EmbeddedResource(filename))
+rdcstr GetDynamicEmbeddedResource(int resource);
+
+namespace OSUtility
+{
+inline void ForceCrash()
+{
+  __builtin_trap();
+}
+inline bool DebuggerPresent()
+{
+  return false;
+}
+};
+
+namespace Bits
+{
+inline uint32_t CountLeadingZeroes(uint32_t value)
+{
+  return value == 0 ? 32 : static_cast<uint32_t>(__builtin_clz(value));
+}
+
+#if ENABLED(RDOC_X64)
+inline uint64_t CountLeadingZeroes(uint64_t value)
+{
+  return value == 0 ? 64 : static_cast<uint64_t>(__builtin_clzll(value));
+}
+#endif
+
+inline uint32_t CountTrailingZeroes(uint32_t value)
+{
+  return value == 0 ? 32 : static_cast<uint32_t>(__builtin_ctz(value));
+}
+
+#if ENABLED(RDOC_X64)
+inline uint64_t CountTrailingZeroes(uint64_t value)
+{
+  return value == 0 ? 64 : static_cast<uint64_t>(__builtin_ctzll(value));
+}
+#endif
+
+inline uint32_t CountOnes(uint32_t value)
+{
+  return static_cast<uint32_t>(__builtin_popcount(value));
+}
+
+#if ENABLED(RDOC_X64)
+inline uint64_t CountOnes(uint64_t value)
+{
+  return static_cast<uint64_t>(__builtin_popcountll(value));
+}
+#endif
+};
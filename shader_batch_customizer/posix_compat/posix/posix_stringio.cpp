@@ -0,0 +1,109 @@
+// Copyright (C) 2023 Jason Bunk
+// The parts of renderdoc's os/win32/win32_stringio.cpp that its DXBC code links against, for building the shader tools on Linux.
+#include <stdio.h>
+#include <sys/stat.h>
+#include "os/os_specific.h"
+
+namespace FileIO
+{
+static const char *modeString[] = {
+    "r", "rb", "w", "wb", "r+b", "w+b",
+};
+
+FILE *fopen(const rdcstr &filename, FileMode mode)
+{
+  return ::fopen(filename.c_str(), modeString[mode]);
+}
+
+size_t fread(void *buf, size_t elementSize, size_t count, FILE *f)
+{
+  return ::fread(buf, elementSize, count, f);
+}
+size_t fwrite(const void *buf, size_t elementSize, size_t count, FILE *f)
+{
+  return ::fwrite(buf, elementSize, count, f);
+}
+
+bool exists(const rdcstr &filename)
+{
+  struct stat st;
+  return stat(filename.c_str(), &st) == 0;
+}
+
+uint64_t ftell64(FILE *f)
+{
+  return (uint64_t)::ftello(f);
+}
+void fseek64(FILE *f, uint64_t offset, int origin)
+{
+  ::fseeko(f, (off_t)offset, origin);
+}
+
+bool fflush(FILE *f)
+{
+  return ::fflush(f) == 0;
+}
+
+bool feof(FILE *f)
+{
+  return ::feof(f) != 0;
+}
+
+int fclose(FILE *f)
+{
+  return ::fclose(f);
+}
+};
+
+namespace StringFormat
+{
+// wchar_t is UTF-32 here
+rdcstr Wide2UTF8(const rdcwstr &s)
+{
+  rdcstr ret;
+  for(const wchar_t *w = s.c_str(); w && *w; w++)
+  {
+    uint32_t c = (uint32_t)*w;
+    if(c < 0x80)
+    {
+      ret.push_back((char)c);
+    }
+    else if(c < 0x800)
+    {
+      ret.push_back((char)(0xC0 | (c >> 6)));
+      ret.push_back((char)(0x80 | (c & 0x3F)));
+    }
+    else if(c < 0x10000)
+    {
+      ret.push_back((char)(0xE0 | (c >> 12)));
+      ret.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+      ret.push_back((char)(0x80 | (c & 0x3F)));
+    }
+    else
+    {
+      ret.push_back((char)(0xF0 | (c >> 18)));
+      ret.push_back((char)(0x80 | ((c >> 12) & 0x3F)));
+      ret.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+      ret.push_back((char)(0x80 | (c & 0x3F)));
+    }
+  }
+  return ret;
+}
+
+rdcwstr UTF82Wide(const rdcstr &s)
+{
+  rdcarray<wchar_t> chars;
+  for(size_t i = 0; i < s.size();)
+  {
+    uint32_t c = (uint8_t)s[i];
+    size_t extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+    if(extra > 0)
+      c &= 0x3F >> extra;
+    for(size_t e = 1; e <= extra && i + e < s.size(); e++)
+      c = (c << 6) | ((uint8_t)s[i + e] & 0x3F);
+    chars.push_back((wchar_t)c);
+    i += extra + 1;
+  }
+  return rdcwstr(chars.data(), chars.size());
+}
+};
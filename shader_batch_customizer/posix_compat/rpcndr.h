@@ -0,0 +1,5 @@
+// Copyright (C) 2023 Jason Bunk
+#pragma once
+#define __RPCNDR_H_VERSION__ 500
+#include "windows.h"
+typedef unsigned char byte;
@@ -0,0 +1,12 @@
+// Copyright (C) 2023 Jason Bunk
+#pragma once
+#define WINAPI_PARTITION_DESKTOP 1
+#define WINAPI_PARTITION_APP 2
+#define WINAPI_PARTITION_GAMES 4
+#define WINAPI_FAMILY_PARTITION(partitions) 1
+
+// older annotations used by d3dcompiler.h, the only includer of this header;
+// they would break libstdc++ headers (which use these names) included after it, but its includers include those first
+#define __in
+#define __out
+#define __in_bcount(x)
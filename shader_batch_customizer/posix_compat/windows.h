@@ -0,0 +1,114 @@
+// Copyright (C) 2023 Jason Bunk
+// Just enough of the Windows SDK for renderdoc's vendored d3dcommon.h and d3dcompiler.h to parse on Linux:
+// the DXBC code only uses their enums and flags, never the COM objects or functions they declare.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#define __int8 char
+#define __int16 short
+#define __int32 int
+#define __int64 long long
+#define _stricmp strcasecmp
+
+typedef int32_t HRESULT;
+typedef int BOOL;
+typedef int INT;
+typedef unsigned int UINT;
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint32_t ULONG;
+typedef int32_t LONG;
+typedef uint64_t UINT64;
+typedef float FLOAT;
+typedef size_t SIZE_T;
+typedef void* LPVOID;
+typedef const void* LPCVOID;
+typedef char CHAR;
+typedef char* LPSTR;
+typedef const char* LPCSTR;
+typedef wchar_t WCHAR;
+typedef const wchar_t* LPCWSTR;
+typedef void* HANDLE;
+typedef void* HMODULE;
+typedef void* RPC_IF_HANDLE;
+
+#define GUID_DEFINED
+typedef struct _GUID {
+	uint32_t Data1;
+	uint16_t Data2;
+	uint16_t Data3;
+	uint8_t Data4[8];
+} GUID;
+typedef GUID IID;
+typedef const GUID& REFGUID;
+typedef const IID& REFIID;
+inline bool operator==(const GUID& a, const GUID& b) { return memcmp(&a, &b, sizeof(GUID)) == 0; }
+inline bool operator!=(const GUID& a, const GUID& b) { return !(a == b); }
+
+#define S_OK ((HRESULT)0L)
+#define S_FALSE ((HRESULT)1L)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+#define FAR
+#define __stdcall
+#define CONST const
+#define WINAPI
+#define STDMETHODCALLTYPE
+#define STDMETHOD(method) virtual HRESULT STDMETHODCALLTYPE method
+#define STDMETHOD_(type, method) virtual type STDMETHODCALLTYPE method
+#define PURE = 0
+#define THIS_
+#define THIS void
+#define DECLARE_INTERFACE(iface) struct iface
+#define DECLARE_INTERFACE_(iface, base) struct iface : public base
+#define DECLSPEC_UUID(x)
+#define DECLSPEC_NOVTABLE
+#define MIDL_INTERFACE(x) struct
+#define BEGIN_INTERFACE
+#define END_INTERFACE
+#define EXTERN_C extern "C"
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) EXTERN_C const GUID name
+#ifndef interface
+#define interface struct
+#endif
+
+struct IUnknown {
+	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) = 0;
+	virtual ULONG STDMETHODCALLTYPE AddRef(void) = 0;
+	virtual ULONG STDMETHODCALLTYPE Release(void) = 0;
+};
+
+// MSVC intrinsic
+inline unsigned char _BitScanForward(unsigned long* index, unsigned long mask) {
+	if (mask == 0ul) return 0;
+	*index = static_cast<unsigned long>(__builtin_ctzl(mask));
+	return 1;
+}
+
+// source annotation language
+#define _In_
+#define _In_opt_
+#define _In_z_
+#define _In_reads_(x)
+#define _In_reads_opt_(x)
+#define _In_reads_bytes_(x)
+#define _In_reads_bytes_opt_(x)
+#define _Out_
+#define _Out_opt_
+#define _Out_writes_(x)
+#define _Out_writes_to_opt_(x, y)
+#define _Outptr_opt_result_maybenull_
+#define _COM_Outptr_
+#define _COM_Outptr_opt_
+#define _Always_(x)
+#define _Inexpressible_(x)
+#define __RPC__in
+#define __RPC__out
+#define __RPC__deref_out
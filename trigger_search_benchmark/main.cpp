@@ -0,0 +1,173 @@
+// Copyright (C) 2023 Jason Bunk
+//
+// Benchmark of the trigger byte search of the memory scanner (gcv_utils/trigger_search_simd.h), on a large synthetic buffer:
+// random bytes, with the trigger planted at known offsets, and many decoys that share only the trigger's first 4 bytes.
+// Scans it in chunks as the scanner reads process memory, once over the whole (cold) buffer, and once with one chunk kept in cache,
+// with the scalar loop the scanner used before and with each vectorized version this CPU supports, for the fast (every 4 bytes) and slow (every byte) scans.
+// Checks that every method finds exactly the planted triggers, then reports timings.
+//
+#include "gcv_utils/trigger_search_simd.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <string>
+using std::endl;
+
+constexpr uint64_t trigger = 0x3D7A41C09B5E2F16ull;
+constexpr uint64_t buffer_padding = 64; // searches read up to 8 bytes past their last candidate
+
+struct synthetic_buffer {
+	std::vector<uint8_t> bytes;
+	uint64_t size = 0;
+	std::vector<uint64_t> triggers; // sorted
+};
+
+static synthetic_buffer make_synthetic_buffer(uint64_t size, uint32_t num_triggers, uint32_t decoys_per_mb, uint32_t seed) {
+	synthetic_buffer buf;
+	buf.size = size;
+	buf.bytes.resize(size + buffer_padding);
+	std::mt19937_64 rng(seed);
+	for (uint64_t ii = 0; ii + 8 <= buf.bytes.size(); ii += 8) {
+		const uint64_t val = rng();
+		memcpy(&buf.bytes[ii], &val, sizeof(val));
+	}
+	const uint64_t decoy = trigger ^ (0xFFull << 48); // same first 4 bytes, so it passes the vector prefilter
+	const uint64_t num_decoys = (size >> 20) * decoys_per_mb;
+	for (uint64_t dd = 0; dd < num_decoys; ++dd) {
+		const uint64_t offset = rng() % (size - 8);
+		memcpy(&buf.bytes[offset], &decoy, sizeof(decoy));
+	}
+	// half of the triggers are 4-byte aligned, so that the fast scan finds those
+	for (uint32_t tt = 0; tt < num_triggers; ++tt) {
+		uint64_t offset = rng() % (size - 16);
+		if ((tt & 1u) == 0u) offset &= ~3ull;
+		memcpy(&buf.bytes[offset], &trigger, sizeof(trigger));
+	}
+	for (uint64_t ii = 0; ii + 8 <= size; ++ii) {
+		if (trigger_search::matches_u64(&buf.bytes[ii], trigger)) buf.triggers.push_back(ii);
+	}
+	return buf;
+}
+
+// the loop the scanner used before find_u64_pattern
+template<uint32_t step_t, typename OnMatchT>
+uint64_t find_old_loop(const uint8_t* dptr, uint64_t llast, uint64_t triggerbytes, const OnMatchT& onmatch) {
+	for (uint64_t ii = 0; ii <= llast; ii += step_t) {
+		if (*reinterpret_cast<const uint64_t*>(dptr + ii) == triggerbytes && onmatch(ii)) return ii;
+	}
+	return trigger_search_notfound;
+}
+
+enum search_method { method_old_loop, method_sse2, method_avx2, method_dispatched };
+const char* method_names[] = { "old scalar loop", "SSE2", "AVX2", "find_u64_pattern" };
+
+// every candidate offset in [0, len) of each chunk is checked once; onmatch rejects every match, so the whole chunk is searched
+template<uint32_t step_t>
+static void search_chunk(search_method method, const uint8_t* chunk, uint64_t len, uint64_t chunkstart, std::vector<uint64_t>& found) {
+	const uint64_t llast = len - step_t;
+	auto onmatch = [&](uint64_t offset) { found.push_back(chunkstart + offset); return false; };
+	switch (method) {
+	case method_old_loop: find_old_loop<step_t>(chunk, llast, trigger, onmatch); break;
+#if GCV_TRIGGER_SEARCH_SSE2
+	case method_sse2: trigger_search::find_sse2<step_t>(chunk, llast, trigger, onmatch); break;
+#endif
+#if GCV_TRIGGER_SEARCH_AVX2
+	case method_avx2: trigger_search::find_avx2<step_t>(chunk, llast, trigger, onmatch); break;
+#endif
+	default: find_u64_pattern<step_t>(chunk, llast, trigger, onmatch); break;
+	}
+}
+
+template<uint32_t step_t>
+static void search_buffer(search_method method, const synthetic_buffer& buf, uint64_t chunkbytes, std::vector<uint64_t>& found) {
+	for (uint64_t start = 0; start < buf.size; start += chunkbytes) {
+		search_chunk<step_t>(method, buf.bytes.data() + start, std::min(chunkbytes, buf.size - start), start, found);
+	}
+}
+
+// the first chunk, searched as many times as there are chunks in the buffer
+template<uint32_t step_t>
+static void search_hot_chunk(search_method method, const synthetic_buffer& buf, uint64_t chunkbytes, std::vector<uint64_t>& found) {
+	const uint64_t len = std::min(chunkbytes, buf.size);
+	for (uint64_t start = 0; start < buf.size; start += chunkbytes) search_chunk<step_t>(method, buf.bytes.data(), len, 0, found);
+}
+
+// median and min of the runs, in milliseconds
+static void time_method(const std::function<void()>& method, uint32_t iterations, double& median_ms, double& min_ms) {
+	std::vector<double> ms;
+	for (uint32_t it = 0; it < iterations; ++it) {
+		const auto t0 = std::chrono::steady_clock::now();
+		method();
+		ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+	}
+	std::sort(ms.begin(), ms.end());
+	median_ms = ms[ms.size() / 2];
+	min_ms = ms.front();
+}
+
+int main(int argc, char** argv) {
+	uint32_t buffer_mb = 1024, chunk_kb = 1024, decoys_per_mb = 64, iterations = 3;
+	for (int ii = 1; ii + 1 < argc; ii += 2) {
+		const std::string arg(argv[ii]);
+		const uint32_t val = static_cast<uint32_t>(std::max(1, std::atoi(argv[ii + 1])));
+		if (arg == "-m") buffer_mb = val;
+		else if (arg == "-c") chunk_kb = val;
+		else if (arg == "-d") decoys_per_mb = val;
+		else if (arg == "-i") iterations = val;
+		else {
+			std::cout << "usage: trigger_search_benchmark [-m buffer_MB] [-c chunk_KB] [-d decoys_per_MB] [-i iterations]" << endl;
+			return 1;
+		}
+	}
+	const uint64_t chunkbytes = static_cast<uint64_t>(chunk_kb) << 10;
+	const synthetic_buffer buf = make_synthetic_buffer(static_cast<uint64_t>(buffer_mb) << 20, 32u, decoys_per_mb, 12345u);
+	std::vector<uint64_t> aligned_triggers;
+	for (uint64_t offset : buf.triggers) if ((offset & 3ull) == 0ull) aligned_triggers.push_back(offset);
+	std::cout << "synthetic buffer of " << buffer_mb << " MB with " << buf.triggers.size() << " triggers (" << aligned_triggers.size()
+		<< " 4-byte aligned) and " << decoys_per_mb << " decoys per MB, searched in chunks of " << chunk_kb << " KB" << endl;
+
+	std::vector<search_method> methods = { method_old_loop };
+#if GCV_TRIGGER_SEARCH_SSE2
+	methods.push_back(method_sse2);
+#endif
+#if GCV_TRIGGER_SEARCH_AVX2
+	if (trigger_search::cpu_has_avx2()) methods.push_back(method_avx2);
+#endif
+	if (methods.size() == 1) methods.push_back(method_dispatched);
+
+	bool all_ok = true;
+	std::cout << std::fixed << std::setprecision(1);
+	double median_ms, min_ms;
+	std::vector<uint64_t> found;
+	for (uint32_t step : { 4u, 1u }) {
+		for (bool hot : { false, true }) {
+			std::vector<uint64_t> expected;
+			if (hot) search_hot_chunk<1>(method_old_loop, buf, chunkbytes, expected);
+			for (search_method method : methods) {
+				time_method([&] {
+					found.clear();
+					if (step == 4u) (hot ? search_hot_chunk<4> : search_buffer<4>)(method, buf, chunkbytes, found);
+					else (hot ? search_hot_chunk<1> : search_buffer<1>)(method, buf, chunkbytes, found);
+				}, iterations, median_ms, min_ms);
+				bool ok;
+				if (!hot) {
+					ok = found == (step == 4u ? aligned_triggers : buf.triggers);
+				} else {
+					std::vector<uint64_t> want;
+					for (uint64_t offset : expected) if (offset % step == 0ull) want.push_back(offset);
+					ok = found == want;
+				}
+				all_ok = all_ok && ok;
+				std::cout << (step == 4u ? "fast scan" : "slow scan") << (hot ? ", chunk in cache, " : ", whole buffer,   ")
+					<< std::setw(16) << method_names[method] << ": median " << std::setw(7) << median_ms << " ms, min " << std::setw(7) << min_ms
+					<< " ms (" << std::setw(6) << (min_ms * 1024.0 / buffer_mb) << " ms per GB)" << (ok ? "" : "  MISMATCH vs planted triggers") << endl;
+			}
+		}
+	}
+	return all_ok ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+// Copyright (C) 2023 Jason Bunk
+//
+// Benchmark of the 4-byte XXH32 kernels (gcv_utils/xxh32_4byte_simd.h) used to colorize IndexedSeg debug captures:
+// on a synthetic r32g32b32a32_uint texture, times the 2x2 hash mosaic made the old way (four passes, one XXH32 call
+// per channel per pixel) and the current way (one pass, four channels per SIMD call), plus the bare kernels.
+// Checks that every method gives byte-identical output to XXH32, then reports timings.
+//
+#include "gcv_utils/xxh32_4byte_simd.h"
+#include "xxhash.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <string>
+using std::endl;
+
+// segmentation-like indices: runs of equal values, as draw/instance/primitive IDs would be
+static std::vector<uint32_t> make_synthetic_texture(uint32_t width, uint32_t height, uint32_t seed) {
+	std::vector<uint32_t> tex(static_cast<size_t>(width) * height * 4u);
+	std::mt19937 rng(seed);
+	uint32_t run[4] = { 0u, 0u, 0u, 0u };
+	for (size_t ii = 0; ii < tex.size(); ii += 4u) {
+		if (rng() % 16u == 0u) for (int ch = 0; ch < 4; ++ch) run[ch] = rng() % (ch == 2 ? 100000u : 2000u);
+		for (int ch = 0; ch < 4; ++ch) tex[ii + ch] = run[ch];
+	}
+	return tex;
+}
+
+// as copy_texture_into_packedbuf.cpp did before the SIMD kernel: one pass per quadrant
+static void mosaic_four_pass_xxh32(const std::vector<uint32_t>& tex, uint32_t width, uint32_t height, std::vector<uint8_t>& mosaic) {
+	const size_t row_pitch = static_cast<size_t>(width) * 16u;
+	const size_t dst_pitch = static_cast<size_t>(width) * 2u * 3u;
+	uint32_t seg_idx_color;
+	uint8_t* const hash_color_channels = reinterpret_cast<uint8_t*>(&seg_idx_color);
+	size_t chC = 0;
+	for (size_t chY = 0; chY < 2; ++chY) {
+		for (size_t chX = 0; chX < 2; ++chX) {
+			const uint8_t* data_p = reinterpret_cast<const uint8_t*>(tex.data());
+			for (size_t y = 0; y < height; ++y, data_p += row_pitch) {
+				uint8_t* dst = mosaic.data() + (y + chY * height) * dst_pitch + chX * width * 3u;
+				for (size_t x = 0; x < width; ++x) {
+					seg_idx_color = XXH32(data_p + x * 16 + chC * 4, 4, 0);
+					for (int cc = 0; cc < 3; ++cc) *(dst++) = hash_color_channels[cc];
+				}
+			}
+			++chC;
+		}
+	}
+}
+
+// as indexed_seg_rgba32_hash_mosaic in gcv_reshade/tex_buffer_utils.cpp
+static void mosaic_one_pass_x4(const std::vector<uint32_t>& tex, uint32_t width, uint32_t height, std::vector<uint8_t>& mosaic) {
+	const size_t dst_pitch = static_cast<size_t>(width) * 2u * 3u;
+	uint32_t hashes[4];
+	for (size_t y = 0; y < height; ++y) {
+		const uint32_t* const src = tex.data() + y * width * 4u;
+		uint8_t* const top = mosaic.data() + y * dst_pitch;
+		uint8_t* const bottom = mosaic.data() + (y + height) * dst_pitch;
+		for (size_t x = 0; x < width; ++x) {
+			xxh32_of_4_bytes_x4(src + x * 4, 0u, hashes);
+			memcpy(top + x * 3, &hashes[0], 3);
+			memcpy(top + (x + width) * 3, &hashes[1], 3);
+			memcpy(bottom + x * 3, &hashes[2], 3);
+			memcpy(bottom + (x + width) * 3, &hashes[3], 3);
+		}
+	}
+}
+
+static void hash_all_xxh32(const std::vector<uint32_t>& in, std::vector<uint32_t>& out) {
+	for (size_t ii = 0; ii < in.size(); ++ii) out[ii] = XXH32(&in[ii], 4, 0);
+}
+static void hash_all_unrolled(const std::vector<uint32_t>& in, std::vector<uint32_t>& out) {
+	for (size_t ii = 0; ii < in.size(); ++ii) out[ii] = xxh32_of_4_bytes(in[ii], 0u);
+}
+static void hash_all_x4(const std::vector<uint32_t>& in, std::vector<uint32_t>& out) {
+	for (size_t ii = 0; ii < in.size(); ii += 4u) xxh32_of_4_bytes_x4(&in[ii], 0u, &out[ii]);
+}
+
+// median and min of the runs, in milliseconds
+static void time_method(const std::function<void()>& method, uint32_t iterations, double& median_ms, double& min_ms) {
+	std::vector<double> ms;
+	for (uint32_t it = 0; it < iterations; ++it) {
+		const auto t0 = std::chrono::steady_clock::now();
+		method();
+		ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+	}
+	std::sort(ms.begin(), ms.end());
+	median_ms = ms[ms.size() / 2];
+	min_ms = ms.front();
+}
+
+int main(int argc, char** argv) {
+	uint32_t width = 2560, height = 1440, iterations = 20;
+	for (int ii = 1; ii + 1 < argc; ii += 2) {
+		const std::string arg(argv[ii]);
+		const uint32_t val = static_cast<uint32_t>(std::max(1, std::atoi(argv[ii + 1])));
+		if (arg == "-w") width = val;
+		else if (arg == "-h") height = val;
+		else if (arg == "-i") iterations = val;
+		else {
+			std::cout << "usage: xxh32_4byte_benchmark [-w width] [-h height] [-i iterations]" << endl;
+			return 1;
+		}
+	}
+	const std::vector<uint32_t> tex = make_synthetic_texture(width, height, 12345u);
+	std::cout << "synthetic r32g32b32a32_uint texture " << width << "x" << height
+#if GCV_XXH32_4BYTE_SSE2
+		<< ", SSE2 kernel" << endl;
+#else
+		<< ", scalar fallback kernel" << endl;
+#endif
+
+	bool all_ok = true;
+	std::cout << std::fixed << std::setprecision(2);
+	double median_ms, min_ms;
+
+	const size_t mosaic_bytes = static_cast<size_t>(width) * height * 4u * 3u;
+	std::vector<uint8_t> reference_mosaic(mosaic_bytes), mosaic(mosaic_bytes);
+	time_method([&] { mosaic_four_pass_xxh32(tex, width, height, reference_mosaic); }, iterations, median_ms, min_ms);
+	std::cout << std::setw(30) << "mosaic, 4 passes of XXH32" << ": median " << median_ms << " ms, min " << min_ms << " ms" << endl;
+	time_method([&] { mosaic_one_pass_x4(tex, width, height, mosaic); }, iterations, median_ms, min_ms);
+	const bool mosaic_ok = mosaic == reference_mosaic;
+	all_ok = all_ok && mosaic_ok;
+	std::cout << std::setw(30) << "mosaic, 1 pass of x4 kernel" << ": median " << median_ms << " ms, min " << min_ms << " ms"
+		<< (mosaic_ok ? "" : "  MISMATCH vs XXH32") << endl;
+
+	std::vector<uint32_t> reference_hashes(tex.size()), hashes(tex.size());
+	const std::pair<const char*, void (*)(const std::vector<uint32_t>&, std::vector<uint32_t>&)> kernels[] = {
+		{ "hash only, XXH32", hash_all_xxh32 },
+		{ "hash only, unrolled scalar", hash_all_unrolled },
+		{ "hash only, x4 kernel", hash_all_x4 },
+	};
+	for (const auto& kernel : kernels) {
+		std::vector<uint32_t>& out = kernel.second == hash_all_xxh32 ? reference_hashes : hashes;
+		time_method([&] { kernel.second(tex, out); }, iterations, median_ms, min_ms);
+		const bool ok = out == reference_hashes;
+		all_ok = all_ok && ok;
+		std::cout << std::setw(30) << kernel.first << ": median " << median_ms << " ms, min " << min_ms << " ms ("
+			<< (1e-6 * tex.size() / (min_ms * 1e-3)) << " Mhash/s)" << (ok ? "" : "  MISMATCH vs XXH32") << endl;
+	}
+	return all_ok ? 0 : 1;
+}